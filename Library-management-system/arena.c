@@ -0,0 +1,68 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_chunk
+{
+    arena_chunk_t *prev;
+    size_t cap;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+};
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_chunk_t *chunk = arena->chunk;
+    if (chunk == NULL || chunk->cap - chunk->used < size)
+    {
+        size_t cap = chunk ? chunk->cap * 2 : ARENA_CHUNK_SIZE;
+        while (cap < size)
+        {
+            cap *= 2;
+        }
+        arena_chunk_t *grown = malloc(sizeof(*grown) + cap);
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        grown->prev = chunk;
+        grown->cap = cap;
+        grown->used = 0;
+        arena->chunk = chunk = grown;
+    }
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+void arena_reset(arena_t *arena)
+{
+    arena_chunk_t *chunk = arena->chunk;
+    if (chunk == NULL)
+    {
+        return;
+    }
+    while (chunk->prev)
+    {
+        arena_chunk_t *prev = chunk->prev->prev;
+        free(chunk->prev);
+        chunk->prev = prev;
+    }
+    if (chunk->cap > ARENA_MAX_KEPT)
+    {
+        free(chunk);
+        arena->chunk = NULL;
+        return;
+    }
+    chunk->used = 0;
+}
+
+void arena_release(arena_t *arena)
+{
+    arena_reset(arena);
+    free(arena->chunk);
+    arena->chunk = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// A bump allocator for memory that lives as long as one request. Each
+// connection has one (session.h): the request body is copied into it,
+// and handlers may take scratch space from it too. Nothing is freed on
+// its own; arena_reset() drops everything at once when the request is
+// done. A request that outgrows the current chunk gets a larger one. A
+// reset keeps only the largest chunk, so after the first few requests a
+// connection allocates nothing more.
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_MAX_KEPT (256 * 1024) // larger chunks go back to malloc on reset
+
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct
+{
+    arena_chunk_t *chunk; // the newest and largest, or NULL
+} arena_t;
+
+// Returns size bytes aligned for any type, or NULL if out of memory.
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Frees everything allocated so far and keeps one chunk for reuse.
+void arena_reset(arena_t *arena);
+
+// Frees the arena's memory; it can be used again afterwards.
+void arena_release(arena_t *arena);
+
+#endif // ARENA_H
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "table.h"
+#include "hash_index.h"
+#include "shared_mem.h"
+
+// Microbenchmark of account lookup by email: the hash index the server
+// uses (hash_index.h) against the linear scan it replaced, which walked
+// the accounts and branched on the account type for each one. For each
+// table size it fills an account table, indexes it, and times lookups of
+// random existing emails both ways. It also renames a tenth of the
+// accounts while the index grows and checks that every one is still
+// found.
+
+#define DEFAULT_SIZES "200,10000,100000,1000000,4000000"
+#define HASH_LOOKUPS 1000000
+#define SCAN_BUDGET 200000000LL // rows compared per size, to bound the scan's run time
+
+static table_t *accounts;
+static volatile int sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static account_t *account_row(int row)
+{
+    return table_row(accounts, row);
+}
+
+static const char *account_email(int row)
+{
+    const account_t *account = account_row(row);
+    return account->type == 0 ? account->data.member.email : account->data.user.email;
+}
+
+// The lookup from before the index.
+static int scan_find(const char *email)
+{
+    for (int i = 0; i < accounts->count; i++)
+    {
+        const account_t *account = account_row(i);
+        if (account->type == 0)
+        {
+            if (strcmp(account->data.member.email, email) == 0)
+            {
+                return i;
+            }
+        }
+        else if (strcmp(account->data.user.email, email) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void set_email(int row, const char *prefix, int n)
+{
+    account_t *account = account_row(row);
+    char *email = account->type == 0 ? account->data.member.email : account->data.user.email;
+    snprintf(email, MAX_EMAIL_LEN, "%s%d@lib.org", prefix, n);
+}
+
+static int run_size(int size)
+{
+    accounts = table_create(sizeof(account_t));
+    hash_index_t *index = hash_index_create(TABLE_CHUNK_ROWS, account_email);
+    if (accounts == NULL || index == NULL)
+    {
+        fprintf(stderr, "Out of arena memory.\n");
+        return -1;
+    }
+    // Every tenth account is renamed half-way through, as an email change
+    // is: removed under the old key, re-added under the new one.
+    for (int i = 0; i < size; i++)
+    {
+        int row = table_append(accounts);
+        if (row < 0)
+        {
+            fprintf(stderr, "Out of arena memory.\n");
+            return -1;
+        }
+        account_row(row)->type = i % 8 == 0 ? 0 : 1;
+        set_email(row, "u", i);
+        hash_index_insert(index, row);
+        if (i % 2 == 1 && (i / 2) % 10 == 0)
+        {
+            int renamed = i / 2;
+            char old_email[MAX_EMAIL_LEN];
+            strcpy(old_email, account_email(renamed));
+            set_email(renamed, "renamed", renamed);
+            hash_index_remove(index, old_email, renamed);
+            hash_index_insert(index, renamed);
+        }
+    }
+    for (int i = 0; i < size; i++)
+    {
+        if (hash_index_find(index, account_email(i)) != i)
+        {
+            fprintf(stderr, "Row %d (%s) not found.\n", i, account_email(i));
+            return -1;
+        }
+    }
+
+    // Keys are picked up front so that both loops look up the same ones.
+    int *rows = malloc(HASH_LOOKUPS * sizeof(*rows));
+    if (rows == NULL)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    unsigned seed = 12345;
+    for (int i = 0; i < HASH_LOOKUPS; i++)
+    {
+        rows[i] = rand_r(&seed) % size;
+    }
+    double started = now_ns();
+    for (int i = 0; i < HASH_LOOKUPS; i++)
+    {
+        sink += hash_index_find(index, account_email(rows[i]));
+    }
+    double hash_ns = (now_ns() - started) / HASH_LOOKUPS;
+
+    int scans = (int)(SCAN_BUDGET / size);
+    scans = scans < 10 ? 10 : scans > HASH_LOOKUPS ? HASH_LOOKUPS : scans;
+    started = now_ns();
+    for (int i = 0; i < scans; i++)
+    {
+        sink += scan_find(account_email(rows[i]));
+    }
+    double scan_ns = (now_ns() - started) / scans;
+    printf("%12d %10.0f ns %12.0f ns\n", size, hash_ns, scan_ns);
+    free(rows);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char default_sizes[] = DEFAULT_SIZES;
+    char *sizes = argc > 1 ? argv[1] : default_sizes;
+    if (shared_arena_init(SHARED_ARENA_SIZE) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    printf("%12s %13s %15s\n", "accounts", "hash", "scan");
+    for (char *size = strtok(sizes, ","); size; size = strtok(NULL, ","))
+    {
+        if (atoi(size) < 1)
+        {
+            fprintf(stderr, "Usage: %s [size,size,...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (run_size(atoi(size)) < 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,493 @@
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "book_columns.h"
+#include "hash_index.h"
+#include "shared_mem.h"
+#include "table.h"
+#include "posting_list.h"
+
+#define HEAP_CHUNK_SIZE (64 * 1024)
+#define DICTIONARY_CAPACITY 1024
+#define NO_ID -1
+
+// Distinct strings, numbered in the order they were first seen. Ids are
+// never reused, so a column entry stays valid for as long as the string
+// exists. Each id also has the slots that use it, in slot order: the
+// subject and author indexes behind book_columns_list().
+typedef struct
+{
+    table_t *names;    // const char * into the string heap, by id
+    table_t *postings; // posting_list_t, by id
+    hash_index_t *index;
+} dictionary_t;
+
+typedef struct
+{
+    table_t *price;
+    table_t *copies;
+    table_t *subject;
+    table_t *author;
+    dictionary_t subjects;
+    dictionary_t authors;
+    char *heap; // free part of the current heap chunk
+    size_t heap_left;
+    posting_pool_t pool; // arrays given up by the posting lists of both dictionaries
+} columns_t;
+
+static columns_t *columns = NULL;
+static int use_avx2 = 0;
+
+static const char *dictionary_name(const dictionary_t *dictionary, int id)
+{
+    return *(const char **)table_row(dictionary->names, id);
+}
+
+static posting_list_t *postings(const dictionary_t *dictionary, int id)
+{
+    return table_row(dictionary->postings, id);
+}
+
+static const char *subject_name(int id)
+{
+    return dictionary_name(&columns->subjects, id);
+}
+
+static const char *author_name(int id)
+{
+    return dictionary_name(&columns->authors, id);
+}
+
+static char *heap_copy(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    if (columns->heap_left < len)
+    {
+        char *chunk = shared_alloc(HEAP_CHUNK_SIZE);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        columns->heap = chunk;
+        columns->heap_left = HEAP_CHUNK_SIZE;
+    }
+    char *copy = columns->heap;
+    memcpy(copy, str, len);
+    columns->heap += len;
+    columns->heap_left -= len;
+    return copy;
+}
+
+// Id of a string, adding it if it is new; -1 if the arena is out of memory.
+static int dictionary_id(dictionary_t *dictionary, const char *name)
+{
+    int id = hash_index_find(dictionary->index, name);
+    if (id != -1)
+    {
+        return id;
+    }
+    char *copy = heap_copy(name);
+    if (copy == NULL || (id = table_append(dictionary->names)) < 0)
+    {
+        return -1;
+    }
+    *(const char **)table_row(dictionary->names, id) = copy;
+    if (table_append(dictionary->postings) < 0)
+    {
+        table_remove(dictionary->names, id);
+        return -1;
+    }
+    if (hash_index_insert(dictionary->index, id) < 0)
+    {
+        table_remove(dictionary->postings, id);
+        table_remove(dictionary->names, id);
+        return -1;
+    }
+    return id;
+}
+
+static int32_t *column(table_t *table, int slot)
+{
+    return table_row(table, slot);
+}
+
+int book_columns_create(void)
+{
+#ifdef __x86_64__
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    columns = shared_alloc(sizeof(*columns));
+    if (columns == NULL)
+    {
+        return -1;
+    }
+    columns->price = table_create(sizeof(int32_t));
+    columns->copies = table_create(sizeof(int32_t));
+    columns->subject = table_create(sizeof(int32_t));
+    columns->author = table_create(sizeof(int32_t));
+    columns->subjects.names = table_create(sizeof(const char *));
+    columns->subjects.postings = table_create(sizeof(posting_list_t));
+    columns->subjects.index = hash_index_create(DICTIONARY_CAPACITY, subject_name);
+    columns->authors.names = table_create(sizeof(const char *));
+    columns->authors.postings = table_create(sizeof(posting_list_t));
+    columns->authors.index = hash_index_create(DICTIONARY_CAPACITY, author_name);
+    return columns->price && columns->copies && columns->subject && columns->author &&
+                   columns->subjects.names && columns->subjects.postings && columns->subjects.index &&
+                   columns->authors.names && columns->authors.postings && columns->authors.index
+               ? 0
+               : -1;
+}
+
+// Makes sure the columns reach slot; new entries are free slots.
+static int reach(int slot)
+{
+    while (columns->price->count <= slot)
+    {
+        int row = table_append(columns->price);
+        if (row < 0 || table_append(columns->copies) < 0 || table_append(columns->subject) < 0 ||
+            table_append(columns->author) < 0)
+        {
+            return -1;
+        }
+        *column(columns->subject, row) = NO_ID;
+        *column(columns->author, row) = NO_ID;
+    }
+    return 0;
+}
+
+// Moves a slot to the id of name, and to its posting list. Looks the
+// string up only when it is not the one the slot has already.
+static int refile(dictionary_t *dictionary, int slot, int32_t *id, const char *name)
+{
+    if (*id != NO_ID && strcmp(dictionary_name(dictionary, *id), name) == 0)
+    {
+        return 0;
+    }
+    int new_id = dictionary_id(dictionary, name);
+    if (new_id < 0 || posting_list_add(&columns->pool, postings(dictionary, new_id), slot) < 0)
+    {
+        return -1;
+    }
+    if (*id != NO_ID)
+    {
+        posting_list_remove(&columns->pool, postings(dictionary, *id), slot);
+    }
+    *id = new_id;
+    return 0;
+}
+
+int book_columns_set(int slot, const book_t *book)
+{
+    if (reach(slot) < 0 ||
+        refile(&columns->subjects, slot, column(columns->subject, slot), book->subject) < 0 ||
+        refile(&columns->authors, slot, column(columns->author, slot), book->author) < 0)
+    {
+        return -1;
+    }
+    *column(columns->price, slot) = book->price;
+    *column(columns->copies, slot) = book->copies;
+    return 0;
+}
+
+void book_columns_clear(int slot)
+{
+    if (slot < columns->price->count)
+    {
+        int32_t *subject = column(columns->subject, slot);
+        int32_t *author = column(columns->author, slot);
+        if (*subject != NO_ID)
+        {
+            posting_list_remove(&columns->pool, postings(&columns->subjects, *subject), slot);
+        }
+        if (*author != NO_ID)
+        {
+            posting_list_remove(&columns->pool, postings(&columns->authors, *author), slot);
+        }
+        *column(columns->price, slot) = 0;
+        *column(columns->copies, slot) = 0;
+        *column(columns->subject, slot) = NO_ID;
+        *column(columns->author, slot) = NO_ID;
+    }
+}
+
+void book_columns_reset(void)
+{
+    for (int id = 0; id < columns->subjects.names->count; id++)
+    {
+        postings(&columns->subjects, id)->count = 0;
+    }
+    for (int id = 0; id < columns->authors.names->count; id++)
+    {
+        postings(&columns->authors, id)->count = 0;
+    }
+    table_clear(columns->price);
+    table_clear(columns->copies);
+    table_clear(columns->subject);
+    table_clear(columns->author);
+}
+
+// The kernels work on one table chunk at a time: n entries of each
+// column, contiguous and 64-byte aligned. A subject of -1 matches every
+// book in use.
+
+static void totals_scalar(const int32_t *price, const int32_t *copies, const int32_t *subject, int n,
+                          int32_t id, catalog_totals_t *totals)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (id == NO_ID ? subject[i] != NO_ID : subject[i] == id)
+        {
+            totals->titles++;
+            totals->copies += copies[i];
+            totals->value += (int64_t)price[i] * copies[i];
+        }
+    }
+}
+
+static int copies_scalar(const int32_t *copies, const int32_t *subject, int n, int32_t min, int32_t max,
+                         uint8_t *hits)
+{
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        hits[i] = subject[i] != NO_ID && copies[i] >= min && copies[i] <= max;
+        count += hits[i];
+    }
+    return count;
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2"))) static void totals_avx2(const int32_t *price, const int32_t *copies,
+                                                         const int32_t *subject, int n, int32_t id,
+                                                         catalog_totals_t *totals)
+{
+    const __m256i no_id = _mm256_set1_epi32(NO_ID);
+    const __m256i want = _mm256_set1_epi32(id);
+    __m256i copies_sum = _mm256_setzero_si256();
+    __m256i value_sum = _mm256_setzero_si256();
+    int64_t titles = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i s = _mm256_load_si256((const __m256i *)(subject + i));
+        __m256i match = id == NO_ID ? _mm256_xor_si256(_mm256_cmpeq_epi32(s, no_id), _mm256_set1_epi32(-1))
+                                    : _mm256_cmpeq_epi32(s, want);
+        __m256i p = _mm256_and_si256(_mm256_load_si256((const __m256i *)(price + i)), match);
+        __m256i c = _mm256_and_si256(_mm256_load_si256((const __m256i *)(copies + i)), match);
+        titles += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(match)));
+        copies_sum = _mm256_add_epi64(copies_sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(c)));
+        copies_sum = _mm256_add_epi64(copies_sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(c, 1)));
+        // Signed 32 x 32 -> 64 products of the even lanes, then of the odd
+        // ones shifted down into their place.
+        value_sum = _mm256_add_epi64(value_sum, _mm256_mul_epi32(p, c));
+        value_sum = _mm256_add_epi64(value_sum,
+                                     _mm256_mul_epi32(_mm256_srli_epi64(p, 32), _mm256_srli_epi64(c, 32)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, copies_sum);
+    totals->copies += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, value_sum);
+    totals->value += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    totals->titles += titles;
+    totals_scalar(price + i, copies + i, subject + i, n - i, id, totals);
+}
+
+__attribute__((target("avx2"))) static int copies_avx2(const int32_t *copies, const int32_t *subject, int n,
+                                                        int32_t min, int32_t max, uint8_t *hits)
+{
+    const __m256i no_id = _mm256_set1_epi32(NO_ID);
+    // min <= copies <= max as copies > min - 1 and max + 1 > copies; the
+    // caller keeps min above INT32_MIN and max below INT32_MAX.
+    const __m256i below = _mm256_set1_epi32(min - 1);
+    const __m256i above = _mm256_set1_epi32(max + 1);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i s = _mm256_load_si256((const __m256i *)(subject + i));
+        __m256i c = _mm256_load_si256((const __m256i *)(copies + i));
+        __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi32(c, below), _mm256_cmpgt_epi32(above, c));
+        __m256i match = _mm256_andnot_si256(_mm256_cmpeq_epi32(s, no_id), in_range);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+        count += __builtin_popcount(mask);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            hits[i + bit] = (mask >> bit) & 1;
+        }
+    }
+    return count + copies_scalar(copies + i, subject + i, n - i, min, max, hits + i);
+}
+#endif
+
+static void totals_chunk(int chunk, int n, int32_t id, catalog_totals_t *totals)
+{
+    const int32_t *price = (const int32_t *)columns->price->chunks[chunk];
+    const int32_t *copies = (const int32_t *)columns->copies->chunks[chunk];
+    const int32_t *subject = (const int32_t *)columns->subject->chunks[chunk];
+#ifdef __x86_64__
+    if (use_avx2)
+    {
+        totals_avx2(price, copies, subject, n, id, totals);
+        return;
+    }
+#endif
+    totals_scalar(price, copies, subject, n, id, totals);
+}
+
+// Sets hits[i] for the books in the chunk with min to max copies and
+// returns how many there are.
+static int copies_chunk(int chunk, int n, int32_t min, int32_t max, uint8_t *hits)
+{
+    const int32_t *copies = (const int32_t *)columns->copies->chunks[chunk];
+    const int32_t *subject = (const int32_t *)columns->subject->chunks[chunk];
+    // Copies never reach either end of the int range.
+    min = min == INT32_MIN ? INT32_MIN + 1 : min;
+    max = max == INT32_MAX ? INT32_MAX - 1 : max;
+#ifdef __x86_64__
+    if (use_avx2)
+    {
+        return copies_avx2(copies, subject, n, min, max, hits);
+    }
+#endif
+    return copies_scalar(copies, subject, n, min, max, hits);
+}
+
+static int chunk_rows(int chunk)
+{
+    int rows = columns->price->count - chunk * TABLE_CHUNK_ROWS;
+    return rows < TABLE_CHUNK_ROWS ? rows : TABLE_CHUNK_ROWS;
+}
+
+int book_columns_totals(const char *subject, catalog_totals_t *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    int32_t id = NO_ID;
+    if (subject != NULL && (id = hash_index_find(columns->subjects.index, subject)) == -1)
+    {
+        return -1;
+    }
+    for (int chunk = 0; chunk * TABLE_CHUNK_ROWS < columns->price->count; chunk++)
+    {
+        totals_chunk(chunk, chunk_rows(chunk), id, totals);
+    }
+    return 0;
+}
+
+int book_columns_count_low_stock(int threshold)
+{
+    uint8_t hits[TABLE_CHUNK_ROWS];
+    int count = 0;
+    for (int chunk = 0; chunk * TABLE_CHUNK_ROWS < columns->price->count; chunk++)
+    {
+        count += copies_chunk(chunk, chunk_rows(chunk), INT32_MIN, threshold, hits);
+    }
+    return count;
+}
+
+// Collects the slots from start on with min to max copies, as
+// book_columns_low_stock() describes.
+static int scan_copies(int32_t min, int32_t max, int start, int *slots, int max_slots, int *next)
+{
+    uint8_t hits[TABLE_CHUNK_ROWS];
+    int found = 0;
+    *next = -1;
+    for (int chunk = start / TABLE_CHUNK_ROWS; chunk * TABLE_CHUNK_ROWS < columns->price->count; chunk++)
+    {
+        int base = chunk * TABLE_CHUNK_ROWS;
+        if (copies_chunk(chunk, chunk_rows(chunk), min, max, hits) == 0)
+        {
+            continue;
+        }
+        for (int i = start > base ? start - base : 0; i < chunk_rows(chunk); i++)
+        {
+            if (!hits[i])
+            {
+                continue;
+            }
+            if (found == max_slots)
+            {
+                *next = base + i;
+                return found;
+            }
+            slots[found++] = base + i;
+        }
+    }
+    return found;
+}
+
+int book_columns_low_stock(int threshold, int start, int *slots, int max, int *next)
+{
+    return scan_copies(INT32_MIN, threshold, start, slots, max, next);
+}
+
+// With a subject or an author, the matches come from the posting lists.
+// The shorter list leads, and each of its slots is looked for in the
+// other list by galloping from where the last one was found, so a page
+// costs time in the slots the lead list has from the cursor on, not in
+// the size of the catalog.
+int book_columns_list(const book_filter_t *filter, int start, int *slots, int max, int *next)
+{
+    int32_t min_copies = filter->available ? 1 : INT32_MIN;
+    const posting_list_t *lists[2];
+    int list_count = 0;
+    *next = -1;
+    if (filter->subject != NULL || filter->author != NULL)
+    {
+        int subject = filter->subject ? hash_index_find(columns->subjects.index, filter->subject) : NO_ID;
+        int author = filter->author ? hash_index_find(columns->authors.index, filter->author) : NO_ID;
+        if ((filter->subject && subject == -1) || (filter->author && author == -1))
+        {
+            return 0;
+        }
+        if (subject != NO_ID)
+        {
+            lists[list_count++] = postings(&columns->subjects, subject);
+        }
+        if (author != NO_ID)
+        {
+            lists[list_count++] = postings(&columns->authors, author);
+        }
+    }
+    if (list_count == 0)
+    {
+        return scan_copies(min_copies, INT32_MAX, start, slots, max, next);
+    }
+    if (list_count == 2 && lists[1]->count < lists[0]->count)
+    {
+        const posting_list_t *shorter = lists[1];
+        lists[1] = lists[0];
+        lists[0] = shorter;
+    }
+    const posting_list_t *lead = lists[0];
+    int other_at = 0;
+    int found = 0;
+    for (int i = posting_list_seek(lead, 0, start); i < lead->count; i++)
+    {
+        int slot = lead->rows[i];
+        if (list_count == 2)
+        {
+            other_at = posting_list_seek(lists[1], other_at, slot);
+            if (other_at == lists[1]->count)
+            {
+                break;
+            }
+            if (lists[1]->rows[other_at] != slot)
+            {
+                continue;
+            }
+        }
+        if (*column(columns->copies, slot) < min_copies)
+        {
+            continue;
+        }
+        if (found == max)
+        {
+            *next = slot;
+            break;
+        }
+        slots[found++] = slot;
+    }
+    return found;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef BOOK_COLUMNS_H
+#define BOOK_COLUMNS_H
+
+#include <stdint.h>
+
+#include "book.h"
+
+// The catalog again, one column per field, for scans that need only a few
+// fields of every book. Price, copies, subject and author are dense int32
+// columns indexed by book store slot. Subject and author hold ids into
+// dictionaries of the distinct strings, which sit once each in a string
+// heap. A valuation of 10M books then reads 120 MB of columns rather than
+// 2 GB of slots, and does it eight books at a time with AVX2 where the
+// CPU has it.
+//
+// Each subject and each author also has a posting list (posting_list.h)
+// of its slots in order. These are the secondary indexes behind
+// LIST_BOOKS.
+//
+// The columns live in the shared arena. The book store (book_store.h)
+// keeps them in step with every change and rebuilds them when it is
+// opened. A free slot has subject and author -1 and no price or copies.
+// Reads need the books read lock, changes the write lock.
+
+// Allocates the columns and dictionaries. Call before forking.
+int book_columns_create(void);
+
+// Files the fields of the book in a slot, which may be past the end.
+// Returns -1 if the arena is out of memory.
+int book_columns_set(int slot, const book_t *book);
+
+// Marks a slot free.
+void book_columns_clear(int slot);
+
+// Drops every slot. The dictionaries are kept.
+void book_columns_reset(void);
+
+typedef struct
+{
+    int64_t titles;
+    int64_t copies;
+    int64_t value; // sum of price * copies
+} catalog_totals_t;
+
+// Totals for the whole catalog, or for one subject if subject is not
+// NULL. Returns -1 if no book was ever filed under that subject.
+int book_columns_totals(const char *subject, catalog_totals_t *totals);
+
+// How many books have no more than threshold copies.
+int book_columns_count_low_stock(int threshold);
+
+// Stores up to max slots, from start on, of books with no more than
+// threshold copies. Returns how many it stored; *next is the slot to go
+// on from, or -1 if the scan reached the end.
+int book_columns_low_stock(int threshold, int start, int *slots, int max, int *next);
+
+// LIST_BOOKS filters; a NULL string or 0 leaves that filter out.
+typedef struct
+{
+    const char *subject;
+    const char *author;
+    int available; // only books with copies left
+} book_filter_t;
+
+// Stores up to max slots, from start on and in slot order, of books that
+// pass the filter; returns and sets *next as book_columns_low_stock()
+// does.
+int book_columns_list(const book_filter_t *filter, int start, int *slots, int max, int *next);
+
+#endif // BOOK_COLUMNS_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "book_store.h"
+#include "storage.h"
+#include "shared_mem.h"
+
+// One-shot converter from the text catalog to the book store. The server
+// does the same on its first start if books.db is missing; this is for
+// converting a catalog offline or into another file.
+int main(int argc, char *argv[])
+{
+    const char *text_path = argc > 1 ? argv[1] : BOOK_FILE;
+    const char *store_path = argc > 2 ? argv[2] : BOOK_STORE_FILE;
+    if (argc > 3)
+    {
+        fprintf(stderr, "Usage: %s [books.txt] [books.db]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (access(store_path, F_OK) == 0)
+    {
+        fprintf(stderr, "%s already exists; not overwriting it.\n", store_path);
+        return EXIT_FAILURE;
+    }
+    int created;
+    // The title index comes from the arena, as in the server.
+    if (shared_arena_init(SHARED_ARENA_SIZE) < 0 || book_store_open(store_path, INITIAL_BOOKS, &created) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    int added = book_store_import(text_path);
+    if (added < 0)
+    {
+        perror(text_path);
+        unlink(store_path);
+        return EXIT_FAILURE;
+    }
+    if (book_store_sync() < 0)
+    {
+        unlink(store_path);
+        return EXIT_FAILURE;
+    }
+    printf("Imported %d books from %s into %s.\n", added, text_path, store_path);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "book_store.h"
+#include "hash_index.h"
+#include "book_columns.h"
+#include "text_scan.h"
+
+// Address space for the largest store, reserved at open so that the file
+// can be mapped further as it grows without anything moving. Only the
+// part up to map_size is mapped to the file.
+#define BOOK_STORE_RESERVE ((size_t)1 << 39)
+
+static book_store_header_t *header = NULL;
+static book_slot_t *slots = NULL;
+static int store_fd = -1;
+
+// How much of the file this process has mapped, and the capacity that
+// covers. Another process can grow the file at any time; follow_growth()
+// catches up before a slot past mapped_capacity is touched.
+static size_t map_size;
+static int mapped_capacity;
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Slots by title, in the shared arena. Titles are unique except in data
+// from older versions, where UPDATE_BOOK could copy one title over
+// another; only the lowest such slot is indexed, which is the one a scan
+// used to find. has_duplicates is set once that is seen.
+static hash_index_t *title_index = NULL;
+static int has_duplicates = 0;
+
+static size_t store_size(int capacity)
+{
+    return sizeof(book_store_header_t) + (size_t)capacity * sizeof(book_slot_t);
+}
+
+// Maps the file up to capacity slots, past what is mapped already.
+// Called with map_lock held, or before there are other threads.
+static int map_to(int capacity)
+{
+    size_t size = store_size(capacity);
+    if (size > map_size)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t offset = map_size & ~(size_t)(page - 1);
+        if (mmap((char *)header + offset, size - offset, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 store_fd, offset) == MAP_FAILED)
+        {
+            perror("Error mapping book store");
+            return -1;
+        }
+        map_size = size;
+    }
+    __atomic_store_n(&mapped_capacity, capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int follow_growth(void)
+{
+    int capacity = __atomic_load_n(&header->capacity, __ATOMIC_ACQUIRE);
+    if (capacity <= __atomic_load_n(&mapped_capacity, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&map_lock);
+    int rc = capacity > mapped_capacity ? map_to(capacity) : 0;
+    pthread_mutex_unlock(&map_lock);
+    return rc;
+}
+
+// Doubles the capacity: the file is extended and mapped further here, and
+// other processes follow once they see the new capacity in the header.
+static int grow(void)
+{
+    int capacity = header->capacity;
+    int new_capacity = capacity < 64 ? 64 : (capacity > INT32_MAX / 2 ? INT32_MAX : capacity * 2);
+    if (new_capacity == capacity || store_size(new_capacity) > BOOK_STORE_RESERVE)
+    {
+        return -1;
+    }
+    if (ftruncate(store_fd, store_size(new_capacity)) < 0)
+    {
+        perror("Error growing book store");
+        return -1;
+    }
+    pthread_mutex_lock(&map_lock);
+    int rc = map_to(new_capacity);
+    pthread_mutex_unlock(&map_lock);
+    if (rc < 0)
+    {
+        return -1;
+    }
+    __atomic_store_n(&header->capacity, new_capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static const char *slot_title(int slot)
+{
+    return slots[slot].book.title;
+}
+
+// Files a slot under its title unless an earlier slot has it.
+static int index_slot(int slot)
+{
+    if (hash_index_find(title_index, slots[slot].book.title) != -1)
+    {
+        has_duplicates = 1;
+        return 0;
+    }
+    return hash_index_insert(title_index, slot);
+}
+
+// After the indexed slot for title went away, files the next one that
+// has the same title, if any.
+static void index_duplicate(const char *title)
+{
+    if (!has_duplicates)
+    {
+        return;
+    }
+    for (int i = 0; i < header->high_water; i++)
+    {
+        if (slots[i].in_use && strcmp(slots[i].book.title, title) == 0)
+        {
+            hash_index_insert(title_index, i);
+            return;
+        }
+    }
+}
+
+// Byte range changed since the last flush, per process; only written under
+// the books write lock. dirty_end == 0 means nothing is dirty.
+static size_t dirty_start;
+static size_t dirty_end;
+
+static void mark_range(const void *p, size_t len)
+{
+    size_t start = (const char *)p - (const char *)header;
+    if (dirty_end == 0 || start < dirty_start)
+    {
+        dirty_start = start;
+    }
+    if (start + len > dirty_end)
+    {
+        dirty_end = start + len;
+    }
+}
+
+int book_store_open(const char *path, int capacity, int *created)
+{
+    *created = 0;
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT)
+    {
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0)
+        {
+            size_t size = sizeof(book_store_header_t) + (size_t)capacity * sizeof(book_slot_t);
+            if (ftruncate(fd, size) < 0)
+            {
+                perror("Error sizing book store");
+                close(fd);
+                unlink(path);
+                return -1;
+            }
+            *created = 1;
+        }
+    }
+    if (fd < 0)
+    {
+        perror("Error opening book store");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(book_store_header_t) ||
+        (size_t)st.st_size > BOOK_STORE_RESERVE)
+    {
+        fprintf(stderr, "Book store %s is damaged.\n", path);
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, BOOK_STORE_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED ||
+        mmap(base, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        perror("Error mapping book store");
+        close(fd);
+        return -1;
+    }
+    store_fd = fd;
+    map_size = st.st_size;
+    header = base;
+    slots = (book_slot_t *)(header + 1);
+    if (*created)
+    {
+        memcpy(header->magic, BOOK_STORE_UNCOUNTED_MAGIC, sizeof(header->magic));
+        header->slot_size = sizeof(book_slot_t);
+        header->capacity = capacity;
+        header->free_head = -1;
+        book_store_sync();
+    }
+    if ((memcmp(header->magic, BOOK_STORE_MAGIC, sizeof(header->magic)) != 0 &&
+         memcmp(header->magic, BOOK_STORE_UNCOUNTED_MAGIC, sizeof(header->magic)) != 0) ||
+        header->slot_size != sizeof(book_slot_t) || header->capacity < 0 ||
+        map_size < store_size(header->capacity) || header->high_water < 0 ||
+        header->high_water > header->capacity || header->count < 0 || header->count > header->high_water ||
+        header->free_head >= header->high_water)
+    {
+        fprintf(stderr, "Book store %s is damaged; refusing to start without it.\n", path);
+        munmap(base, BOOK_STORE_RESERVE);
+        close(fd);
+        store_fd = -1;
+        header = NULL;
+        return -1;
+    }
+    mapped_capacity = header->capacity;
+    title_index = hash_index_create(header->capacity, slot_title);
+    if (title_index == NULL || book_columns_create() < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < header->high_water; i++)
+    {
+        if (slots[i].in_use && (index_slot(i) < 0 || book_columns_set(i, &slots[i].book) < 0))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int book_store_find(const char *title)
+{
+    follow_growth();
+    return hash_index_find(title_index, title);
+}
+
+book_t *book_store_get(int slot)
+{
+    follow_growth();
+    return &slots[slot].book;
+}
+
+int book_store_next(int slot)
+{
+    follow_growth();
+    for (; slot < header->high_water; slot++)
+    {
+        if (slots[slot].in_use)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+int book_store_count(void)
+{
+    return header->count;
+}
+
+int book_store_add(const book_t *book)
+{
+    follow_growth();
+    int slot = header->free_head;
+    if (slot >= 0)
+    {
+        header->free_head = slots[slot].next_free;
+    }
+    else if (header->high_water < header->capacity || grow() == 0)
+    {
+        slot = header->high_water++;
+    }
+    else
+    {
+        return -1;
+    }
+    slots[slot].book = *book;
+    slots[slot].on_loan = 0;
+    slots[slot].in_use = 1;
+    if (index_slot(slot) < 0 || book_columns_set(slot, book) < 0)
+    {
+        hash_index_remove(title_index, book->title, slot);
+        book_columns_clear(slot);
+        memset(&slots[slot].book, 0, sizeof(book_t));
+        slots[slot].in_use = 0;
+        slots[slot].next_free = header->free_head;
+        header->free_head = slot;
+        return -1;
+    }
+    header->count++;
+    mark_range(header, sizeof(*header));
+    mark_range(&slots[slot], sizeof(book_slot_t));
+    return slot;
+}
+
+void book_store_remove(int slot)
+{
+    char title[MAX_TITLE_LEN];
+    strcpy(title, slots[slot].book.title);
+    int indexed = hash_index_remove(title_index, title, slot);
+    book_columns_clear(slot);
+    memset(&slots[slot].book, 0, sizeof(book_t));
+    slots[slot].in_use = 0;
+    slots[slot].next_free = header->free_head;
+    header->free_head = slot;
+    header->count--;
+    mark_range(header, sizeof(*header));
+    mark_range(&slots[slot], sizeof(book_slot_t));
+    if (indexed)
+    {
+        index_duplicate(title);
+    }
+}
+
+void book_store_retitle(int slot, const char *old_title)
+{
+    if (strcmp(old_title, slots[slot].book.title) == 0)
+    {
+        return;
+    }
+    if (hash_index_remove(title_index, old_title, slot))
+    {
+        index_duplicate(old_title);
+    }
+    index_slot(slot);
+}
+
+void book_store_mark(int slot)
+{
+    book_columns_set(slot, &slots[slot].book);
+    mark_range(&slots[slot].book, sizeof(book_t));
+}
+
+void book_store_lend(int slot, int change)
+{
+    slots[slot].book.copies -= change;
+    slots[slot].on_loan += change;
+    book_columns_set(slot, &slots[slot].book);
+    mark_range(&slots[slot], sizeof(book_slot_t));
+}
+
+void book_store_set_on_loan(int slot, int on_loan)
+{
+    slots[slot].on_loan = on_loan;
+    mark_range(&slots[slot], sizeof(book_slot_t));
+}
+
+void book_store_settle_loans(int (*loans_of)(const char *title))
+{
+    follow_growth();
+    int counted = memcmp(header->magic, BOOK_STORE_MAGIC, sizeof(header->magic)) == 0;
+    int corrected = 0;
+    for (int i = 0; i < header->high_water; i++)
+    {
+        if (!slots[i].in_use)
+        {
+            continue;
+        }
+        // Borrowings reach only the slot their title finds.
+        const char *title = slots[i].book.title;
+        int loans = hash_index_find(title_index, title) == i ? loans_of(title) : 0;
+        if (counted && slots[i].on_loan != loans)
+        {
+            slots[i].book.copies += slots[i].on_loan - loans;
+            book_columns_set(i, &slots[i].book);
+            corrected++;
+        }
+        slots[i].on_loan = loans;
+    }
+    memcpy(header->magic, BOOK_STORE_MAGIC, sizeof(header->magic));
+    if (corrected > 0)
+    {
+        printf("Corrected the copies of %d books to match the borrowings.\n", corrected);
+    }
+}
+
+int book_store_dirty(void)
+{
+    return dirty_end != 0;
+}
+
+int book_store_flush(void)
+{
+    if (dirty_end == 0)
+    {
+        return 0;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    size_t start = dirty_start & ~(size_t)(page - 1);
+    size_t end = dirty_end;
+    dirty_end = 0;
+    if (msync((char *)header + start, end - start, MS_ASYNC) < 0)
+    {
+        perror("Error flushing book store");
+        return -1;
+    }
+    return 0;
+}
+
+int book_store_sync(void)
+{
+    follow_growth();
+    if (msync(header, map_size, MS_SYNC) < 0)
+    {
+        perror("Error syncing book store");
+        return -1;
+    }
+    return 0;
+}
+
+void book_store_clear(void)
+{
+    follow_growth();
+    hash_index_clear(title_index);
+    book_columns_reset();
+    memset(slots, 0, (size_t)header->high_water * sizeof(book_slot_t));
+    header->count = 0;
+    header->high_water = 0;
+    header->free_head = -1;
+    // Whatever fills it again comes with its own copy counts.
+    memcpy(header->magic, BOOK_STORE_UNCOUNTED_MAGIC, sizeof(header->magic));
+}
+
+static int parse_book(text_field_t *fields, int count, book_t *book)
+{
+    static const char *const labels[5] = {"Title", "Author", "Subject", "Price", "Copies"};
+    if (count < 5)
+    {
+        return -1;
+    }
+    if (text_field_int(fields[3], &book->price) != 0 || text_field_int(fields[4], &book->copies) < 0)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            if (text_field_unlabel(&fields[i], labels[i]) < 0)
+            {
+                return -1;
+            }
+        }
+        if (text_field_int(fields[3], &book->price) != 0 || text_field_int(fields[4], &book->copies) < 0)
+        {
+            return -1;
+        }
+    }
+    return text_field_copy(book->title, sizeof(book->title), fields[0]) == 0 &&
+                   text_field_copy(book->author, sizeof(book->author), fields[1]) == 0 &&
+                   text_field_copy(book->subject, sizeof(book->subject), fields[2]) == 0
+               ? 0
+               : -1;
+}
+
+int book_store_import(const char *path)
+{
+    text_file_t file;
+    if (text_file_open(&file, path) < 0)
+    {
+        return -1;
+    }
+    int added = 0;
+    text_field_t fields[5];
+    int count;
+    while ((count = text_file_next_line(&file, fields, 5)) >= 0)
+    {
+        book_t book;
+        memset(&book, 0, sizeof(book));
+        if (parse_book(fields, count, &book) < 0)
+        {
+            continue;
+        }
+        // A title seen before gets the copies added, as ADD_BOOK does.
+        int existing = book_store_find(book.title);
+        if (existing != -1)
+        {
+            book_store_get(existing)->copies += book.copies;
+            book_store_mark(existing);
+        }
+        else if (book_store_add(&book) < 0)
+        {
+            fprintf(stderr, "Could not grow the book store; skipping the rest of %s.\n", path);
+            break;
+        }
+        added++;
+    }
+    text_file_close(&file);
+    return added;
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef BOOK_STORE_H
+#define BOOK_STORE_H
+
+#include <stdint.h>
+
+#include "book.h"
+
+// The catalog lives in books.db, a file mapped shared into every server
+// process. It is a header followed by fixed-width slots; removed books go
+// on a free-slot list and their slots are reused. A change writes the
+// slot in place (a borrow or return touches only its copy counts) and
+// storage_flush() hands the dirty pages to msync, so a change costs no
+// log record and restart needs no parsing or replay for books. When every
+// slot is taken the file doubles in size; slots keep their number and
+// address, so a slot index is a stable handle for a book. The numbers
+// are also kept column by column for scans (book_columns.h).
+//
+// Borrowings, unlike books, are logged (storage.h), and the two are not
+// written together: a borrow changes the slot before the log record is
+// appended, and the slot's page and the log reach the disk on their own
+// schedules. A crash in between leaves copies out of step with the
+// borrowings loaded back. Each slot therefore also counts its copies on
+// loan, and load corrects copies by the difference between that count and
+// the borrowings of the title (book_store_settle_loans()).
+#define BOOK_STORE_FILE "books.db"
+#define BOOK_STORE_MAGIC "LMSBOOK2"
+// The same layout before slots counted their loans, or a store whose
+// loans have not been counted yet. Its copies are taken as they are.
+#define BOOK_STORE_UNCOUNTED_MAGIC "LMSBOOK1"
+
+typedef struct
+{
+    char magic[8];
+    uint32_t slot_size; // sizeof(book_slot_t) when the file was created
+    int32_t capacity;   // slots the file has room for
+    int32_t count;      // books in use
+    int32_t high_water; // slots ever used; scans stop here
+    int32_t free_head;  // first free slot below high_water, or -1
+} book_store_header_t;
+
+typedef struct
+{
+    int32_t in_use;
+    union
+    {
+        int32_t next_free; // next free slot while this one is free
+        int32_t on_loan;   // borrowings of the title while in use
+    };
+    book_t book;
+} book_slot_t;
+
+// Maps path, creating it with room for capacity books if it does not
+// exist (*created is then set), and builds the title index in the shared
+// arena. Call once, before forking. Returns -1 if the file is unusable.
+int book_store_open(const char *path, int capacity, int *created);
+
+// Slot index of the book, or -1. A hash probe on the title index.
+int book_store_find(const char *title);
+
+// The book in a slot in use. Writes through it change the file; call
+// book_store_mark() afterwards, and book_store_retitle() if the title
+// changed.
+book_t *book_store_get(int slot);
+
+// The first slot in use at or after slot, or -1; for walking the store.
+int book_store_next(int slot);
+
+int book_store_count(void);
+
+// Copies book into a free slot, growing the store if there is none, and
+// returns it; -1 if the store could not grow.
+int book_store_add(const book_t *book);
+
+// Frees a slot for reuse.
+void book_store_remove(int slot);
+
+// Re-files a slot whose title was changed from old_title through
+// book_store_get(); a no-op if it is the same.
+void book_store_retitle(int slot, const char *old_title);
+
+// Notes that a slot changed and refreshes its columns. The caller holds
+// the books write lock.
+void book_store_mark(int slot);
+
+// Lends out a copy (change 1) or takes one back (change -1): copies goes
+// down by change and the loan count up by it. BORROW_BOOK and RETURN_BOOK
+// use this rather than writing copies. The caller holds the books write
+// lock.
+void book_store_lend(int slot, int change);
+
+// Sets the loan count of a slot. ADD_BOOK, REMOVE_BOOK and UPDATE_BOOK
+// set it from the borrowings when they change which slot a title finds.
+void book_store_set_on_loan(int slot, int on_loan);
+
+// Called once at load, with every borrowing in place: loans_of counts the
+// borrowings of a title. Moves copies by whatever the slot's loan count
+// and the borrowings disagree on, then sets the count. A store with the
+// older magic only has its loans counted.
+void book_store_settle_loans(int (*loans_of)(const char *title));
+
+// Whether anything was marked since the last flush.
+int book_store_dirty(void);
+
+// Starts writeback of the slots marked since the last call. The change is
+// in the shared page cache as soon as it is made, so it survives the
+// process; this bounds how long it waits for the disk.
+int book_store_flush(void);
+
+// Waits until the whole store is on disk. Needs no lock.
+int book_store_sync(void);
+
+// Empties the store.
+void book_store_clear(void);
+
+// Adds the books listed in a books.txt file, in either the
+// title|author|subject|price|copies form or the older
+// "Title : ...|Author : ...|..." form. A title already in the store has
+// the listed copies added to it. Returns the number of books read, or -1
+// if the file could not be opened.
+int book_store_import(const char *path);
+
+#endif // BOOK_STORE_H
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+
+void *buffer_pool_get(buffer_pool_t *pool)
+{
+    void *buf = pool->free_list;
+    if (buf == NULL)
+    {
+        return malloc(pool->size);
+    }
+    // A free buffer holds the link to the next one in its first bytes.
+    pool->free_list = *(void **)buf;
+    pool->free_count--;
+    return buf;
+}
+
+void buffer_pool_put(buffer_pool_t *pool, void *buf)
+{
+    if (pool->free_count >= pool->max_free)
+    {
+        free(buf);
+        return;
+    }
+    *(void **)buf = pool->free_list;
+    pool->free_list = buf;
+    pool->free_count++;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+// A free list of same-size buffers: work items with their reply buffers
+// (worker_pool.h) and connection input buffers (session.h). A steady
+// load then reuses the same few thousand buffers and stays out of
+// malloc. At most max_free buffers are kept, and the rest are freed.
+// Buffers come back uninitialised. A pool is not locked: only the event
+// loop thread takes buffers from it or returns them.
+typedef struct
+{
+    size_t size;
+    int max_free;
+    int free_count;
+    void *free_list;
+} buffer_pool_t;
+
+#define BUFFER_POOL_INIT(size, max_free) {(size), (max_free), 0, NULL}
+
+// Returns a buffer of pool->size bytes, or NULL if out of memory.
+void *buffer_pool_get(buffer_pool_t *pool);
+
+void buffer_pool_put(buffer_pool_t *pool, void *buf);
+
+#endif // BUFFER_POOL_H
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "types.h"
 #include "config.h"
 #include "book.h"
+#include "protocol.h"
 
 // Function Prototypes
 void main_menu_logged_out();
@@ -25,9 +26,27 @@ void handle_delete_user(int sock);
 void handle_update_user_info(int sock);
 void handle_borrow_book(int sock);
 void handle_return_book(int sock);
+void handle_my_borrowings(int sock);
+void handle_title_holders(int sock);
+
+void handle_check_copies_many(int sock);
+void handle_run_batch_file(int sock);
+
+// Requests queued for pipelined sending. Everything queued is written in
+// one go; the replies are then read back in the same order, so a gateway
+// can keep several requests in flight per socket.
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+    int in_flight;
+} request_pipeline_t;
 
 void send_request(int sock, const char *command, const char *payload);
-int receive_response(int sock, char *response);
+int send_request_pipelined(request_pipeline_t *pipeline, const char *command, const char *payload);
+int flush_pipeline(int sock, request_pipeline_t *pipeline);
+int receive_response(int sock, char *response, size_t size);
 
 int main()
 {
@@ -99,8 +118,20 @@ int main()
                 handle_return_book(sock);
                 break;
             case 12:
+                handle_check_copies_many(sock);
+                break;
+            case 13:
+                handle_run_batch_file(sock);
+                break;
+            case 14:
+                handle_my_borrowings(sock);
+                break;
+            case 15:
+                handle_title_holders(sock);
+                break;
+            case 16:
                 send_request(sock, "LOGOUT", "");
-                if (receive_response(sock, response) > 0)
+                if (receive_response(sock, response, sizeof(response)) > 0)
                 {
                     printf("Server response: %s\n", response);
                     signed_in = 0;
@@ -120,7 +151,7 @@ int main()
             {
             case 1:
                 handle_sign_in(sock);
-                if (receive_response(sock, response) > 0)
+                if (receive_response(sock, response, sizeof(response)) > 0)
                 {
                     printf("Server response: %s\n", response);
                     if (strncmp(response, "Success", 7) == 0)
@@ -168,7 +199,11 @@ void main_menu_logged_in()
     printf("9. Delete a User\n");
     printf("10. Borrow a Book\n");
     printf("11. Return a Book\n");
-    printf("12. Logout\n");
+    printf("12. Check Copies of Several Books\n");
+    printf("13. Run Commands from a File\n");
+    printf("14. My Borrowings\n");
+    printf("15. Who Has a Book\n");
+    printf("16. Logout\n");
 }
 
 void handle_sign_in(int sock)
@@ -207,7 +242,7 @@ void handle_add_user(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s|%s|%s|%d", name, email, phone, password, payment);
     send_request(sock, "SIGN_UP", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -236,7 +271,7 @@ void handle_add_book(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s|%s|%d|%d", title, author, subject, price, copies);
     send_request(sock, "ADD_BOOK", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -251,7 +286,7 @@ void handle_remove_book(int sock)
     scanf(" %[^\n]", title);
     snprintf(payload, sizeof(payload), "%s", title);
     send_request(sock, "REMOVE_BOOK", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -277,7 +312,7 @@ void handle_update_my_info(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s|%s|%s", name, email, phone, password);
     send_request(sock, "UPDATE_INFO", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -309,7 +344,7 @@ void handle_update_book(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s|%s|%s|%d|%d", old_title, new_title, new_author, new_subject, new_price, new_copies);
     send_request(sock, "UPDATE_BOOK", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -324,7 +359,7 @@ void handle_check_copies(int sock)
     scanf(" %[^\n]", title);
     snprintf(payload, sizeof(payload), "%s", title);
     send_request(sock, "CHECK_COPIES", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -344,20 +379,64 @@ void handle_collect_payment(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%d", email, amount);
     send_request(sock, "COLLECT_PAYMENT", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
 }
 
+// Pages through the listing until the server stops handing out a cursor.
 void handle_view_users(int sock)
 {
-    char response[2048];
-    send_request(sock, "VIEW_USERS", "");
-    if (receive_response(sock, response) > 0)
+    char role[16];
+    char dues[16];
+    char payload[128];
+    size_t size = 64 * 1024;
+    char *response = malloc(size);
+    if (response == NULL)
     {
-        printf("Server response: %s\n", response);
+        perror("Error allocating response buffer");
+        return;
+    }
+    printf("Enter role (all, member, user): ");
+    scanf(" %15s", role);
+    printf("Enter dues filter (any, payment, fines, owing, clear): ");
+    scanf(" %15s", dues);
+
+    int cursor = 0;
+    while (1)
+    {
+        snprintf(payload, sizeof(payload), "%d|%d|%s|%s", DEFAULT_USERS_PAGE, cursor, role, dues);
+        send_request(sock, "VIEW_USERS", payload);
+        if (receive_response(sock, response, size) <= 0)
+        {
+            break;
+        }
+        char *next = strstr(response, "Next cursor: ");
+        if (next == NULL)
+        {
+            printf("Server response: %s\n", response);
+            break;
+        }
+        cursor = atoi(next + strlen("Next cursor: "));
+        *next = '\0';
+        printf("Server response: %s", response);
+        printf("Press Enter for the next page or q to stop: ");
+        int c = getchar();
+        while (c == '\n')
+        {
+            c = getchar();
+        }
+        if (c == 'q' || c == EOF)
+        {
+            while (c != '\n' && c != EOF)
+            {
+                c = getchar();
+            }
+            break;
+        }
     }
+    free(response);
 }
 
 void handle_delete_user(int sock)
@@ -369,7 +448,7 @@ void handle_delete_user(int sock)
     scanf(" %s", email);
     snprintf(payload, sizeof(payload), "%s", email);
     send_request(sock, "DELETE_USER", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -398,7 +477,7 @@ void handle_update_user_info(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s|%s|%s|%s", target_email, name, email, phone, password);
     send_request(sock, "UPDATE_USER_INFO", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -418,7 +497,7 @@ void handle_borrow_book(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s", email, title);
     send_request(sock, "BORROW_BOOK", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
@@ -438,25 +517,147 @@ void handle_return_book(int sock)
 
     snprintf(payload, sizeof(payload), "%s|%s", email, title);
     send_request(sock, "RETURN_BOOK", payload);
-    if (receive_response(sock, response) > 0)
+    if (receive_response(sock, response, sizeof(response)) > 0)
+    {
+        printf("Server response: %s\n", response);
+    }
+}
+
+void handle_my_borrowings(int sock)
+{
+    char response[64 * 1024];
+    send_request(sock, "MY_BORROWINGS", "");
+    if (receive_response(sock, response, sizeof(response)) > 0)
+    {
+        printf("Server response: %s\n", response);
+    }
+}
+
+void handle_title_holders(int sock)
+{
+    char title[MAX_TITLE_LEN];
+    char payload[1024];
+    char response[64 * 1024];
+    printf("Enter the title of the book: ");
+    scanf(" %[^\n]", title);
+    snprintf(payload, sizeof(payload), "%s", title);
+    send_request(sock, "TITLE_HOLDERS", payload);
+    if (receive_response(sock, response, sizeof(response)) > 0)
     {
         printf("Server response: %s\n", response);
     }
 }
 
+void handle_check_copies_many(int sock)
+{
+    request_pipeline_t pipeline = {0};
+    char title[MAX_TITLE_LEN];
+    char response[1024];
+    int count;
+
+    printf("How many titles? ");
+    scanf("%d", &count);
+    for (int i = 0; i < count; i++)
+    {
+        printf("Enter title %d: ", i + 1);
+        scanf(" %[^\n]", title);
+        send_request_pipelined(&pipeline, "CHECK_COPIES", title);
+    }
+    if (flush_pipeline(sock, &pipeline) < 0)
+    {
+        perror("Send failed");
+    }
+    while (pipeline.in_flight > 0)
+    {
+        if (receive_response(sock, response, sizeof(response)) <= 0)
+        {
+            break;
+        }
+        pipeline.in_flight--;
+        printf("Server response: %s\n", response);
+    }
+    free(pipeline.buf);
+}
+
+// Sends every line of a file (e.g. "ADD_BOOK|title|author|subject|price|copies")
+// as one BATCH request, so a whole intake costs a single round trip.
+void handle_run_batch_file(int sock)
+{
+    char path[256];
+    printf("Enter the path of the command file: ");
+    scanf(" %255[^\n]", path);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror("Error opening command file");
+        return;
+    }
+    char *commands = malloc(MAX_FRAME_LEN);
+    char *response = malloc(MAX_FRAME_LEN);
+    if (commands == NULL || response == NULL)
+    {
+        perror("Out of memory");
+        fclose(file);
+        free(commands);
+        free(response);
+        return;
+    }
+    size_t len = fread(commands, 1, MAX_FRAME_LEN - 1, file);
+    commands[len] = '\0';
+    fclose(file);
+
+    send_request(sock, "BATCH", commands);
+    if (receive_response(sock, response, MAX_FRAME_LEN) > 0)
+    {
+        printf("Server response: %s\n", response);
+    }
+    free(commands);
+    free(response);
+}
+
+// Sends one request right away: a pipeline of depth one.
 void send_request(int sock, const char *command, const char *payload)
 {
-    char request[1024];
-    snprintf(request, sizeof(request), "%s|%s", command, payload);
-    send(sock, request, strlen(request), 0);
+    request_pipeline_t pipeline = {0};
+    if (send_request_pipelined(&pipeline, command, payload) < 0 ||
+        flush_pipeline(sock, &pipeline) < 0)
+    {
+        perror("Send failed");
+    }
+    free(pipeline.buf);
 }
 
-int receive_response(int sock, char *response)
+// Queues a request without sending it. Returns -1 if out of memory.
+int send_request_pipelined(request_pipeline_t *pipeline, const char *command, const char *payload)
 {
-    int bytes_received = recv(sock, response, 1024 - 1, 0);
-    if (bytes_received > 0)
+    return frame_append_request(&pipeline->buf, &pipeline->len, &pipeline->cap, command, payload);
+}
+
+// Sends every queued request in one write. Each one then awaits a
+// receive_response() call; in_flight counts how many are outstanding.
+int flush_pipeline(int sock, request_pipeline_t *pipeline)
+{
+    size_t sent = 0;
+    while (sent < pipeline->len)
+    {
+        ssize_t n = send(sock, pipeline->buf + sent, pipeline->len - sent, 0);
+        if (n < 0)
+        {
+            return -1;
+        }
+        sent += n;
+    }
+    for (size_t off = 0; off < pipeline->len;)
     {
-        response[bytes_received] = '\0';
+        off += FRAME_HEADER_LEN + frame_get_header((const unsigned char *)pipeline->buf + off);
+        pipeline->in_flight++;
     }
-    return bytes_received;
+    pipeline->len = 0;
+    return 0;
+}
+
+int receive_response(int sock, char *response, size_t size)
+{
+    return frame_recv(sock, response, size);
 }
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "command.h"
+#include "locks.h"
+#include "storage.h"
+#include "metrics.h"
+
+// Most sub-requests a single BATCH may carry.
+#define MAX_BATCH_COMMANDS 1000
+// Bytes reserved per sub-request for its "[i] <reply>" line.
+#define BATCH_RESULT_ESTIMATE 64
+
+typedef enum
+{
+    FIELD_END,
+    FIELD_STR,
+    FIELD_INT,
+    FIELD_REST,
+    FIELD_OPT_STR,
+    FIELD_OPT_INT
+} field_type_t;
+
+typedef struct
+{
+    field_type_t type;
+    size_t offset;
+    size_t max_len;
+} field_spec_t;
+
+typedef struct
+{
+    const char *name;
+    size_t name_len;
+    int access;
+    int read_locks;
+    int write_locks;
+    const char *format_error;
+    const field_spec_t *fields;
+    void (*run)(client_session_t *session, const void *args, reply_t *reply);
+} command_t;
+
+// Per command: the field layout of its argument struct and a thunk that
+// calls the typed handler.
+#define FIELD_SPEC(S, type, name, max) {FIELD_##type, offsetof(S, name), max},
+
+#define DEFINE_COMMAND(NAME, name, access, read_locks, write_locks, format_error)      \
+    static const field_spec_t name##_fields[] = {                                     \
+        NAME##_FIELDS(FIELD_SPEC, name##_args_t){FIELD_END, 0, 0}};                   \
+    static void run_##name(client_session_t *session, const void *args, reply_t *reply) \
+    {                                                                                 \
+        handle_##name(session, args, reply);                                          \
+    }
+
+COMMAND_LIST(DEFINE_COMMAND)
+
+#define COMMAND_ENTRY(NAME, name, access, read_locks, write_locks, format_error) \
+    {#NAME, sizeof(#NAME) - 1, access, read_locks, write_locks, format_error, name##_fields, run_##name},
+
+static const command_t commands[] = {COMMAND_LIST(COMMAND_ENTRY)};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+_Static_assert(NUM_COMMANDS < METRICS_MAX_COMMANDS, "metrics registry has too few command slots");
+
+#define ARGS_MEMBER(NAME, name, ...) name##_args_t name;
+
+typedef union
+{
+    COMMAND_LIST(ARGS_MEMBER)
+} command_args_t;
+
+// Open-addressing index from command name to table entry.
+#define COMMAND_INDEX_SIZE 64
+
+_Static_assert(NUM_COMMANDS * 2 <= COMMAND_INDEX_SIZE, "command index too small");
+
+static const command_t *command_index[COMMAND_INDEX_SIZE];
+
+static uint32_t hash_name(const char *name, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void command_table_init(void)
+{
+    for (size_t i = 0; i < NUM_COMMANDS; i++)
+    {
+        uint32_t slot = hash_name(commands[i].name, commands[i].name_len) & (COMMAND_INDEX_SIZE - 1);
+        while (command_index[slot] != NULL)
+        {
+            slot = (slot + 1) & (COMMAND_INDEX_SIZE - 1);
+        }
+        command_index[slot] = &commands[i];
+    }
+}
+
+int command_count(void)
+{
+    return NUM_COMMANDS;
+}
+
+const char *command_name(int index)
+{
+    return commands[index].name;
+}
+
+static const command_t *find_command(const char *name, size_t len)
+{
+    uint32_t slot = hash_name(name, len) & (COMMAND_INDEX_SIZE - 1);
+    while (command_index[slot] != NULL)
+    {
+        const command_t *command = command_index[slot];
+        if (command->name_len == len && memcmp(command->name, name, len) == 0)
+        {
+            return command;
+        }
+        slot = (slot + 1) & (COMMAND_INDEX_SIZE - 1);
+    }
+    return NULL;
+}
+
+// Splits payload into the fields described by spec, writing them into args.
+// Separators are overwritten with NUL so string fields can point straight
+// into the payload. Fields beyond the schema are ignored. Returns -1 if a
+// field is missing, empty, too long or not a number; a missing or empty
+// optional field is set to NULL or 0 instead.
+static int parse_fields(char *payload, const field_spec_t *spec, void *args)
+{
+    char *p = payload;
+    int count = 0;
+
+    for (; spec->type != FIELD_END; spec++)
+    {
+        char *field = (char *)args + spec->offset;
+        int optional = spec->type == FIELD_OPT_STR || spec->type == FIELD_OPT_INT;
+        if (optional)
+        {
+            if (spec->type == FIELD_OPT_STR)
+            {
+                *(const char **)field = NULL;
+            }
+            else
+            {
+                *(int *)field = 0;
+            }
+        }
+        if (p == NULL)
+        {
+            if (optional)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (spec->type == FIELD_REST)
+        {
+            if (*p == '\0')
+            {
+                return -1;
+            }
+            *(char **)field = p;
+            p = NULL;
+            count++;
+            continue;
+        }
+        char *end = strchr(p, '|');
+        char *next = NULL;
+        if (end)
+        {
+            *end = '\0';
+            next = end + 1;
+        }
+        else
+        {
+            end = p + strlen(p);
+        }
+        while (end > p && (end[-1] == '\n' || end[-1] == '\r'))
+        {
+            *--end = '\0';
+        }
+        size_t len = end - p;
+        if (len == 0)
+        {
+            if (optional)
+            {
+                p = next;
+                continue;
+            }
+            return -1;
+        }
+
+        if (spec->type == FIELD_STR || spec->type == FIELD_OPT_STR)
+        {
+            if (len >= spec->max_len)
+            {
+                return -1;
+            }
+            *(const char **)field = p;
+        }
+        else
+        {
+            char *num_end;
+            errno = 0;
+            long value = strtol(p, &num_end, 10);
+            if (num_end != end || errno != 0 || value < INT_MIN || value > INT_MAX)
+            {
+                return -1;
+            }
+            *(int *)field = (int)value;
+        }
+        p = next;
+        count++;
+    }
+    // field_count is the first member of every argument struct.
+    *(int *)args = count;
+    return 0;
+}
+
+void reply_set(reply_t *reply, const char *text)
+{
+    size_t len = strlen(text);
+    if (len >= reply->cap)
+    {
+        len = reply->cap - 1;
+    }
+    memcpy(reply->buf, text, len);
+    reply->buf[len] = '\0';
+    reply->len = len;
+}
+
+void reply_printf(reply_t *reply, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(reply->buf, reply->cap, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+    {
+        n = 0;
+        reply->buf[0] = '\0';
+    }
+    reply->len = (size_t)n < reply->cap ? (size_t)n : reply->cap - 1;
+}
+
+void reply_append(reply_t *reply, const char *fmt, ...)
+{
+    // Format straight into the free space; only retry after growing.
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(reply->buf + reply->len, reply->cap - reply->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+    {
+        reply->buf[reply->len] = '\0';
+        return;
+    }
+    if (reply->len + n + 1 > reply->cap)
+    {
+        reply->buf[reply->len] = '\0';
+        size_t new_cap = reply->cap * 2;
+        while (new_cap < reply->len + n + 1)
+        {
+            new_cap *= 2;
+        }
+        char *new_buf = reply->heap ? realloc(reply->buf, new_cap) : malloc(new_cap);
+        if (new_buf == NULL)
+        {
+            return;
+        }
+        if (!reply->heap)
+        {
+            memcpy(new_buf, reply->buf, reply->len + 1);
+        }
+        reply->buf = new_buf;
+        reply->cap = new_cap;
+        reply->heap = 1;
+        va_start(ap, fmt);
+        vsnprintf(reply->buf + reply->len, n + 1, fmt, ap);
+        va_end(ap);
+    }
+    reply->len += n;
+}
+
+void reply_free(reply_t *reply)
+{
+    if (reply->heap)
+    {
+        free(reply->buf);
+        reply->heap = 0;
+    }
+}
+
+// Splits "COMMAND|payload" at the first '|' and looks the command up.
+static const command_t *lookup_request(char *request, char **payload)
+{
+    char *sep = strchr(request, '|');
+    size_t name_len;
+    if (sep)
+    {
+        name_len = sep - request;
+        *payload = sep + 1;
+    }
+    else
+    {
+        name_len = strlen(request);
+        *payload = request + name_len;
+    }
+    return find_command(request, name_len);
+}
+
+// Parses the payload and runs the command. The caller holds its locks.
+static void run_command(client_session_t *session, const command_t *command, char *payload, reply_t *reply)
+{
+    command_args_t args;
+    if (parse_fields(payload, command->fields, &args) < 0)
+    {
+        reply_set(reply, command->format_error);
+    }
+    else
+    {
+        command->run(session, &args, reply);
+    }
+}
+
+// Runs one sub-request per line of the payload. The table locks every
+// sub-request needs are taken once up front and all log records are
+// written together at the end, so N changes cost one round trip and one
+// log append. Sub-requests are not atomic as a group: each succeeds or fails
+// exactly as it would on its own.
+void handle_batch(client_session_t *session, const batch_args_t *args, reply_t *reply)
+{
+    char *items = args->items;
+    char *items_end = items + strlen(items);
+    int read_locks = 0;
+    int write_locks = 0;
+    int count = 0;
+
+    // First pass: cut the lines apart and collect the locks.
+    for (char *line = items; line < items_end; line += strlen(line) + 1)
+    {
+        char *newline = strchr(line, '\n');
+        if (newline)
+        {
+            *newline = '\0';
+        }
+        if (line[0] == '\0' || line[0] == '\r')
+        {
+            continue;
+        }
+        char *sep = strchr(line, '|');
+        const command_t *command = find_command(line, sep ? (size_t)(sep - line) : strlen(line));
+        if (command && (command->access & ACCESS_BATCH))
+        {
+            read_locks |= command->read_locks;
+            write_locks |= command->write_locks;
+        }
+        count++;
+    }
+    if (count == 0 || count > MAX_BATCH_COMMANDS)
+    {
+        reply_printf(reply, "Error: A batch must hold 1 to %d commands.", MAX_BATCH_COMMANDS);
+        return;
+    }
+
+    // A large batch takes room for its result lines from the session's
+    // arena up front, rather than growing the buffer over and over.
+    char stack_buf[RESPONSE_BUF_LEN];
+    reply_t results = {stack_buf, 0, sizeof(stack_buf), 0};
+    size_t estimate = (size_t)count * BATCH_RESULT_ESTIMATE;
+    char *arena_buf = estimate > sizeof(stack_buf) ? arena_alloc(&session->arena, estimate) : NULL;
+    if (arena_buf)
+    {
+        results = (reply_t){arena_buf, 0, estimate, 0};
+    }
+    reply_set(&results, "");
+    int failed = 0;
+    int index = 0;
+
+    tables_lock(read_locks, write_locks);
+    char *next_line;
+    for (char *line = items; line < items_end; line = next_line)
+    {
+        // Parsing cuts the line up, so find the next one first.
+        next_line = line + strlen(line) + 1;
+        if (line[0] == '\0' || line[0] == '\r')
+        {
+            continue;
+        }
+        char sub_buf[RESPONSE_BUF_LEN];
+        reply_t sub_reply = {sub_buf, 0, sizeof(sub_buf), 0};
+        char *payload;
+        const command_t *command = lookup_request(line, &payload);
+        if (command == NULL)
+        {
+            reply_set(&sub_reply, "Error: Unknown command.");
+        }
+        else if (!(command->access & ACCESS_BATCH))
+        {
+            reply_set(&sub_reply, "Error: Command not allowed in a batch.");
+        }
+        else
+        {
+            run_command(session, command, payload, &sub_reply);
+        }
+        if (strncmp(sub_reply.buf, "Error", 5) == 0)
+        {
+            failed++;
+        }
+        reply_append(&results, "\n[%d] %s", ++index, sub_reply.buf);
+        reply_free(&sub_reply);
+    }
+    storage_flush(write_locks);
+    tables_unlock(read_locks | write_locks);
+
+    reply_printf(reply, "Success: Batch of %d commands, %d failed.", count, failed);
+    reply_append(reply, "%s", results.buf);
+    reply_free(&results);
+}
+
+void handle_client_request(client_session_t *session, char *request, reply_t *reply)
+{
+    printf("Client request: %s\n", request);
+
+    uint64_t started = metrics_now_ns();
+    char *payload;
+    const command_t *command = lookup_request(request, &payload);
+    if (command == NULL)
+    {
+        reply_set(reply, session->signed_in ? "Error: Unknown command." : "Error: Please sign in first.");
+    }
+    else if ((command->access & ACCESS_SIGNED_IN) && !session->signed_in)
+    {
+        reply_set(reply, "Error: Please sign in first.");
+    }
+    else
+    {
+        tables_lock(command->read_locks, command->write_locks);
+        run_command(session, command, payload, reply);
+        storage_flush(command->write_locks);
+        tables_unlock(command->read_locks | command->write_locks);
+    }
+    metrics_record_request(command ? (int)(command - commands) : -1, strncmp(reply->buf, "Error", 5) == 0,
+                           metrics_now_ns() - started);
+
+    printf("Server response: %s\n\n", reply->buf);
+}
\ No newline at end of file
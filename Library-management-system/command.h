@@ -0,0 +1,59 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+
+#include "session.h"
+#include "command_schema.h"
+
+// Reply being built for the client. Handlers write through reply_set and
+// reply_printf, which keep len up to date so nothing has to strlen the
+// response again on the way out. Text past cap - 1 bytes is truncated,
+// except with reply_append, which moves the reply to the heap when it
+// outgrows buf (the owner then releases it with reply_free).
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+    int heap;
+} reply_t;
+
+void reply_set(reply_t *reply, const char *text);
+void reply_printf(reply_t *reply, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void reply_append(reply_t *reply, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void reply_free(reply_t *reply);
+
+// Argument structs generated from the schema, e.g. check_copies_args_t.
+// String fields point into the request buffer.
+#define FIELD_DECL_STR(name) const char *name;
+#define FIELD_DECL_INT(name) int name;
+#define FIELD_DECL_REST(name) char *name;
+#define FIELD_DECL_OPT_STR(name) const char *name;
+#define FIELD_DECL_OPT_INT(name) int name;
+#define FIELD_DECL(S, type, name, max) FIELD_DECL_##type(name)
+
+#define DECLARE_COMMAND(NAME, name, access, read_locks, write_locks, format_error) \
+    typedef struct                                                               \
+    {                                                                            \
+        int field_count;                                                         \
+        NAME##_FIELDS(FIELD_DECL, name##_args_t)                                 \
+    } name##_args_t;                                                             \
+    void handle_##name(client_session_t *session, const name##_args_t *args, reply_t *reply);
+
+COMMAND_LIST(DECLARE_COMMAND)
+
+#undef DECLARE_COMMAND
+
+// Builds the command-name index. Call once before serving requests.
+void command_table_init(void);
+
+// Commands in schema order, for reporting.
+int command_count(void);
+const char *command_name(int index);
+
+// Runs one request body ("COMMAND|payload", NUL-terminated, modified in
+// place) for the session and writes the reply.
+void handle_client_request(client_session_t *session, char *request, reply_t *reply);
+
+#endif // COMMAND_H
\ No newline at end of file
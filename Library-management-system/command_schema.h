@@ -0,0 +1,171 @@
+#ifndef COMMAND_SCHEMA_H
+#define COMMAND_SCHEMA_H
+
+#include "types.h"
+#include "book.h"
+#include "locks.h"
+#include "session_tokens.h"
+
+// The request schema. Everything about a command lives here: its payload
+// fields, who may call it and which tables it locks. command.h and
+// command.c expand these lists into argument structs, field parsers and
+// the dispatch table, so adding a command means adding one row below plus
+// its handle_<name>() in server.c (BATCH, which runs other commands, is
+// handled in command.c).
+//
+// Payload fields are '|'-separated and parsed in place in the request
+// buffer. F(S, STR, field, max) is a non-empty string shorter than max
+// bytes; F(S, INT, field, 0) is a decimal integer; F(S, REST, field, 0)
+// takes the rest of the payload unsplit and must come last. OPT_STR and
+// OPT_INT may be left empty or cut off, in which case they read as NULL
+// or 0.
+
+#define SIGN_UP_FIELDS(F, S)              \
+    F(S, STR, name, MAX_NAME_LEN)         \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, phone, MAX_PHONE_LEN)       \
+    F(S, STR, password, MAX_PASSWD_LEN)   \
+    F(S, INT, payment, 0)
+
+#define SIGN_IN_FIELDS(F, S)              \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, password, MAX_PASSWD_LEN)
+
+#define RESUME_FIELDS(F, S)               \
+    F(S, STR, token, SESSION_TOKEN_LEN + 1)
+
+#define LOGOUT_FIELDS(F, S)
+
+#define ADD_BOOK_FIELDS(F, S)             \
+    F(S, STR, title, MAX_TITLE_LEN)       \
+    F(S, STR, author, MAX_AUTHOR_LEN)     \
+    F(S, STR, subject, MAX_SUBJECT_LEN)   \
+    F(S, INT, price, 0)                   \
+    F(S, INT, copies, 0)
+
+#define REMOVE_BOOK_FIELDS(F, S)          \
+    F(S, STR, title, MAX_TITLE_LEN)
+
+#define UPDATE_INFO_FIELDS(F, S)          \
+    F(S, STR, name, MAX_NAME_LEN)         \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, phone, MAX_PHONE_LEN)       \
+    F(S, STR, password, MAX_PASSWD_LEN)
+
+#define UPDATE_BOOK_FIELDS(F, S)          \
+    F(S, STR, old_title, MAX_TITLE_LEN)   \
+    F(S, STR, title, MAX_TITLE_LEN)       \
+    F(S, STR, author, MAX_AUTHOR_LEN)     \
+    F(S, STR, subject, MAX_SUBJECT_LEN)   \
+    F(S, INT, price, 0)                   \
+    F(S, INT, copies, 0)
+
+#define CHECK_COPIES_FIELDS(F, S)         \
+    F(S, STR, title, MAX_TITLE_LEN)
+
+#define COLLECT_PAYMENT_FIELDS(F, S)      \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, INT, amount, 0)
+
+#define COLLECT_FINE_FIELDS(F, S)         \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, INT, amount, 0)
+
+#define PAYMENTS_FIELDS(F, S)             \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, OPT_INT, limit, 0)
+
+#define BORROW_BOOK_FIELDS(F, S)          \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, title, MAX_TITLE_LEN)
+
+#define RETURN_BOOK_FIELDS(F, S)          \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, title, MAX_TITLE_LEN)
+
+#define MY_BORROWINGS_FIELDS(F, S)
+
+#define TITLE_HOLDERS_FIELDS(F, S)        \
+    F(S, STR, title, MAX_TITLE_LEN)
+
+#define OVERDUE_FIELDS(F, S)              \
+    F(S, OPT_INT, limit, 0)
+
+#define LIST_BOOKS_FIELDS(F, S)                 \
+    F(S, OPT_STR, subject, MAX_SUBJECT_LEN)     \
+    F(S, OPT_STR, author, MAX_AUTHOR_LEN)       \
+    F(S, OPT_STR, copies, 16)                   \
+    F(S, OPT_INT, page_size, 0)                 \
+    F(S, OPT_INT, cursor, 0)
+
+#define CATALOG_VALUE_FIELDS(F, S)        \
+    F(S, OPT_STR, subject, MAX_SUBJECT_LEN)
+
+#define LOW_STOCK_FIELDS(F, S)            \
+    F(S, OPT_INT, threshold, 0)           \
+    F(S, OPT_INT, page_size, 0)           \
+    F(S, OPT_INT, cursor, 0)
+
+#define VIEW_USERS_FIELDS(F, S)           \
+    F(S, OPT_INT, page_size, 0)           \
+    F(S, OPT_INT, cursor, 0)              \
+    F(S, OPT_STR, role, 16)               \
+    F(S, OPT_STR, dues, 16)
+
+#define DELETE_USER_FIELDS(F, S)          \
+    F(S, STR, email, MAX_EMAIL_LEN)
+
+#define UPDATE_USER_INFO_FIELDS(F, S)     \
+    F(S, STR, target_email, MAX_EMAIL_LEN) \
+    F(S, STR, name, MAX_NAME_LEN)         \
+    F(S, STR, email, MAX_EMAIL_LEN)       \
+    F(S, STR, phone, MAX_PHONE_LEN)       \
+    F(S, STR, password, MAX_PASSWD_LEN)
+
+#define BATCH_FIELDS(F, S)                \
+    F(S, REST, items, 0)
+
+#define STATS_FIELDS(F, S)
+
+// Access flags: ACCESS_SIGNED_IN commands need a signed-in session and
+// ACCESS_BATCH commands may also be sent inside a BATCH.
+#define ACCESS_PUBLIC 0
+#define ACCESS_SIGNED_IN (1 << 0)
+#define ACCESS_BATCH (1 << 1)
+#define ACCESS_BATCHABLE (ACCESS_SIGNED_IN | ACCESS_BATCH)
+
+// X(NAME, handler, access flags, read locks, write locks, error for a bad payload)
+#define COMMAND_LIST(X)                                                                                       \
+    X(SIGN_UP, sign_up, ACCESS_PUBLIC, 0, LOCK_ACCOUNTS, "Error: Invalid sign-up format.")                    \
+    X(SIGN_IN, sign_in, ACCESS_PUBLIC, LOCK_ACCOUNTS, LOCK_SESSIONS, "Error: Invalid sign-in format.")        \
+    X(RESUME, resume, ACCESS_PUBLIC, LOCK_ACCOUNTS, LOCK_SESSIONS, "Error: Invalid request format.")          \
+    X(LOGOUT, logout, ACCESS_PUBLIC, 0, LOCK_SESSIONS, "Error: Invalid request format.")                      \
+    X(ADD_BOOK, add_book, ACCESS_BATCHABLE, LOCK_BORROWINGS, LOCK_BOOKS, "Error: Invalid book format.")       \
+    X(REMOVE_BOOK, remove_book, ACCESS_BATCHABLE, LOCK_BORROWINGS, LOCK_BOOKS,                                \
+      "Error: Invalid request format.")                                                                       \
+    X(UPDATE_INFO, update_my_info, ACCESS_BATCHABLE, 0, LOCK_ACCOUNTS, "Error: Invalid update format.")       \
+    X(UPDATE_BOOK, update_book, ACCESS_BATCHABLE, LOCK_BORROWINGS, LOCK_BOOKS,                                \
+      "Error: Invalid update format.")                                                                        \
+    X(CHECK_COPIES, check_copies, ACCESS_BATCHABLE, LOCK_BOOKS, 0, "Error: Invalid request format.")          \
+    X(COLLECT_PAYMENT, collect_payment, ACCESS_BATCHABLE, 0, LOCK_ACCOUNTS,                                   \
+      "Error: Invalid payment format.")                                                                       \
+    X(COLLECT_FINE, collect_fine, ACCESS_BATCHABLE, 0, LOCK_ACCOUNTS, "Error: Invalid fine format.")          \
+    X(PAYMENTS, payments, ACCESS_BATCHABLE, LOCK_ACCOUNTS, 0, "Error: Invalid request format.")               \
+    X(BORROW_BOOK, borrow_book, ACCESS_BATCHABLE, LOCK_ACCOUNTS, LOCK_BOOKS | LOCK_BORROWINGS,                \
+      "Error: Invalid borrowing format.")                                                                     \
+    X(RETURN_BOOK, return_book, ACCESS_BATCHABLE, 0, LOCK_ACCOUNTS | LOCK_BOOKS | LOCK_BORROWINGS,            \
+      "Error: Invalid return format.")                                                                        \
+    X(LIST_BOOKS, list_books, ACCESS_BATCHABLE, LOCK_BOOKS, 0, "Error: Invalid request format.")              \
+    X(CATALOG_VALUE, catalog_value, ACCESS_BATCHABLE, LOCK_BOOKS, 0, "Error: Invalid request format.")        \
+    X(LOW_STOCK, low_stock, ACCESS_BATCHABLE, LOCK_BOOKS, 0, "Error: Invalid request format.")                \
+    X(MY_BORROWINGS, my_borrowings, ACCESS_BATCHABLE, LOCK_BORROWINGS, 0, "Error: Invalid request format.")   \
+    X(TITLE_HOLDERS, title_holders, ACCESS_BATCHABLE, LOCK_BORROWINGS, 0, "Error: Invalid request format.")   \
+    X(OVERDUE, overdue, ACCESS_BATCHABLE, LOCK_BORROWINGS, 0, "Error: Invalid request format.")               \
+    X(VIEW_USERS, view_users, ACCESS_SIGNED_IN, LOCK_ACCOUNTS, 0, "Error: Invalid request format.")           \
+    X(DELETE_USER, delete_user, ACCESS_BATCHABLE, 0, 0, "Error: Invalid request format.")                     \
+    X(UPDATE_USER_INFO, update_user_info, ACCESS_BATCHABLE, 0, LOCK_ACCOUNTS,                                 \
+      "Error: Invalid update format.")                                                                        \
+    X(BATCH, batch, ACCESS_SIGNED_IN, 0, 0, "Error: Invalid batch format.")                                   \
+    X(STATS, stats, ACCESS_SIGNED_IN, 0, 0, "Error: Invalid request format.")
+
+#endif // COMMAND_SCHEMA_H
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "commit.h"
+#include "storage.h"
+#include "metrics.h"
+
+static commit_policy_t policy = COMMIT_GROUP;
+static int window_us = DEFAULT_COMMIT_WINDOW_US;
+static int max_records = DEFAULT_COMMIT_MAX_RECORDS;
+static char description[64];
+
+// Requests waiting for the next group commit, in this process.
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t commit_ready;
+static work_item_t *waiting_head = NULL;
+static work_item_t *waiting_tail = NULL;
+static int waiting_count = 0;
+static int waiting_files = 0;
+
+int commit_configure(const char *spec)
+{
+    int window = DEFAULT_COMMIT_WINDOW_US;
+    int records = DEFAULT_COMMIT_MAX_RECORDS;
+    char extra;
+    if (strcmp(spec, "none") == 0)
+    {
+        policy = COMMIT_NONE;
+    }
+    else if (strcmp(spec, "always") == 0)
+    {
+        policy = COMMIT_ALWAYS;
+    }
+    else if (strcmp(spec, "group") == 0 ||
+             sscanf(spec, "group:%d%c", &window, &extra) == 1 ||
+             (sscanf(spec, "group:%d:%d%c", &window, &records, &extra) == 2))
+    {
+        if (window < 0 || records < 1)
+        {
+            return -1;
+        }
+        policy = COMMIT_GROUP;
+        window_us = window;
+        max_records = records;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+const char *commit_describe(void)
+{
+    switch (policy)
+    {
+    case COMMIT_NONE:
+        return "none";
+    case COMMIT_ALWAYS:
+        return "always";
+    default:
+        snprintf(description, sizeof(description), "group %dus/%d", window_us, max_records);
+        return description;
+    }
+}
+
+// Hands items on, each with the time it spent waiting for durability.
+static void finish(work_item_t *items, int rc)
+{
+    uint64_t now = metrics_now_ns();
+    while (items)
+    {
+        work_item_t *next = items->next;
+        items->next = NULL;
+        if (rc < 0)
+        {
+            reply_set(&items->reply, "Error: Change could not be saved to disk.");
+        }
+        metrics_record_write(METRIC_COMMIT_WAIT, rc < 0, now - items->commit_ns);
+        worker_pool_complete(items);
+        items = next;
+    }
+}
+
+static int sync_files(int files)
+{
+    uint64_t started = metrics_now_ns();
+    int rc = storage_sync(files);
+    metrics_record_write(METRIC_COMMIT_SYNC, rc < 0, metrics_now_ns() - started);
+    return rc;
+}
+
+static void *commit_main(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&commit_lock);
+        while (waiting_head == NULL)
+        {
+            pthread_cond_wait(&commit_ready, &commit_lock);
+        }
+        // The window opens with the first request, so a lone request waits
+        // at most window_us on top of the sync.
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += (long)window_us * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (window_us > 0 && waiting_count < max_records)
+        {
+            if (pthread_cond_timedwait(&commit_ready, &commit_lock, &deadline) == ETIMEDOUT)
+            {
+                break;
+            }
+        }
+        work_item_t *items = waiting_head;
+        int files = waiting_files;
+        waiting_head = NULL;
+        waiting_tail = NULL;
+        waiting_count = 0;
+        waiting_files = 0;
+        pthread_mutex_unlock(&commit_lock);
+
+        finish(items, sync_files(files));
+    }
+    return NULL;
+}
+
+int commit_start(void)
+{
+    if (policy != COMMIT_GROUP)
+    {
+        return 0;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&commit_ready, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, commit_main, NULL) != 0)
+    {
+        perror("Error starting commit thread");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+void commit_request(work_item_t *item, int files)
+{
+    if (files == 0 || policy == COMMIT_NONE)
+    {
+        worker_pool_complete(item);
+        return;
+    }
+    item->commit_ns = metrics_now_ns();
+    item->next = NULL;
+    if (policy == COMMIT_ALWAYS)
+    {
+        finish(item, sync_files(files));
+        return;
+    }
+    pthread_mutex_lock(&commit_lock);
+    if (waiting_tail)
+    {
+        waiting_tail->next = item;
+    }
+    else
+    {
+        waiting_head = item;
+    }
+    waiting_tail = item;
+    waiting_files |= files;
+    waiting_count++;
+    // The commit thread only needs waking to open a window or to close
+    // one early.
+    if (waiting_count == 1 || waiting_count == max_records)
+    {
+        pthread_cond_signal(&commit_ready);
+    }
+    pthread_mutex_unlock(&commit_lock);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include "worker_pool.h"
+
+// When a request that changed something gets its reply:
+//   none    as soon as the change is written (it survives the process,
+//           not the machine);
+//   always  after the worker has synced the files the request wrote;
+//   group   after a commit thread has synced them for every request that
+//           came in during one window: WINDOW_US after the first one, or
+//           once MAX_RECORDS requests are waiting. One fsync then covers
+//           the whole group. With no window the group is whatever arrived
+//           while the previous sync ran, which adds no wait when the
+//           server is idle and still batches under load.
+typedef enum
+{
+    COMMIT_NONE,
+    COMMIT_ALWAYS,
+    COMMIT_GROUP
+} commit_policy_t;
+
+#define DEFAULT_COMMIT_WINDOW_US 0
+#define DEFAULT_COMMIT_MAX_RECORDS 64
+
+// Sets the policy from "none", "always" or "group[:WINDOW_US[:MAX_RECORDS]]"
+// (group is the default). Call before forking. Returns -1 if spec is not
+// one of those.
+int commit_configure(const char *spec);
+
+// Describes the policy, e.g. "group 0us/64".
+const char *commit_describe(void);
+
+// Starts this process's commit thread if the policy needs one. Call in
+// every server process, after forking.
+int commit_start(void);
+
+// Takes a request its worker has answered, together with the STORAGE_*
+// files it wrote, and completes it (worker_pool_complete()) once those are
+// durable under the policy. If syncing fails the reply becomes an error.
+void commit_request(work_item_t *item, int files);
+
+#endif // COMMIT_H
\ No newline at end of file
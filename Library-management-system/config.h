@@ -5,4 +5,30 @@
 #define SERV_ADDR "127.0.0.1"
 #define SERV_PORT 2002
 
+// Threads executing request handlers; override with `server -t N`.
+#define DEFAULT_WORKER_THREADS 4
+
+// VIEW_USERS page size when the request gives none, and the most allowed.
+#define DEFAULT_USERS_PAGE 50
+#define MAX_USERS_PAGE 500
+
+// LIST_BOOKS page size when the request gives none, and the most allowed.
+#define DEFAULT_BOOKS_PAGE 50
+#define MAX_BOOKS_PAGE 500
+
+// LOW_STOCK page size when the request gives none, and the most allowed.
+#define DEFAULT_LOW_STOCK_PAGE 50
+#define MAX_LOW_STOCK_PAGE 500
+
+// PAYMENTS rows when the request gives no limit, and the most allowed.
+#define DEFAULT_PAYMENTS_LIMIT 20
+#define MAX_PAYMENTS_LIMIT 500
+
+// Seconds a session token stays valid after it is issued or last used.
+#define SESSION_TOKEN_SECONDS (8 * 60 * 60)
+
+// OVERDUE rows when the request gives no limit, and the most allowed.
+#define DEFAULT_OVERDUE_LIMIT 50
+#define MAX_OVERDUE_LIMIT 500
+
 #endif // CONFIG_H
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "event_loop.h"
+#include "session.h"
+#include "worker_pool.h"
+#include "protocol.h"
+#include "metrics.h"
+
+static int active_sessions = 0;
+
+// epoll tag for the worker completion eventfd; the listening socket uses NULL.
+static char completion_tag;
+
+// Sessions are freed only after the current batch of epoll events has been
+// handled, since a later event in the same batch may still point at them.
+static client_session_t *closed_sessions = NULL;
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+    {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void release_session(client_session_t *session)
+{
+    session->next_closed = closed_sessions;
+    closed_sessions = session;
+}
+
+static void free_closed_sessions(void)
+{
+    while (closed_sessions)
+    {
+        client_session_t *next = closed_sessions->next_closed;
+        session_free(closed_sessions);
+        closed_sessions = next;
+    }
+}
+
+// Drops the connection. If a worker still holds the session, freeing it is
+// left to the completion path.
+static void close_session(int epoll_fd, client_session_t *session)
+{
+    if (session->closing)
+    {
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+    close(session->fd);
+    session->closing = 1;
+    active_sessions--;
+    metrics_session_closed();
+    printf("Client disconnected. Active sessions: %d\n", active_sessions);
+    if (!session->busy)
+    {
+        release_session(session);
+    }
+}
+
+// Writes as much pending output as the socket takes. Returns -1 if the peer
+// is gone, 0 otherwise (EAGAIN leaves the rest for the next EPOLLOUT).
+static int flush_output(client_session_t *session)
+{
+    struct iovec iov[OUT_IOV_MAX];
+    int count;
+    while ((count = session_output_iov(session, iov, OUT_IOV_MAX)) > 0)
+    {
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+        ssize_t n = sendmsg(session->fd, &msg, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            session_output_sent(session, n);
+            metrics_add_bytes_out(n);
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Drains the socket (required with EPOLLET) and dispatches the first
+// complete frame. Later frames stay buffered until the one ahead of them
+// has been answered, which keeps pipelined responses in request order.
+// Once MAX_SESSION_INPUT is buffered the loop stops reading; the completion
+// path calls back in to resume. End of input only stops the reading: the
+// buffered frames are still dispatched one by one.
+static int read_requests(client_session_t *session)
+{
+    while (!session->read_closed)
+    {
+        size_t room = session_reserve_input(session, 1);
+        if (room == 0)
+        {
+            break;
+        }
+        ssize_t n = recv(session->fd, session->in_buf + session->in_len, room, 0);
+        if (n > 0)
+        {
+            session->in_len += n;
+            metrics_add_bytes_in(n);
+        }
+        else if (n == 0)
+        {
+            session->read_closed = 1;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return session_dispatch_input(session);
+}
+
+static void complete_requests(int epoll_fd)
+{
+    work_item_t *item = worker_pool_take_completed();
+    while (item)
+    {
+        work_item_t *next = item->next;
+        client_session_t *session = item->session;
+        session->busy = 0;
+        if (session->closing)
+        {
+            work_item_free(item);
+            release_session(session);
+        }
+        else
+        {
+            // The session now owns the item and frees it once it is sent.
+            session_queue_response(session, item);
+            if (flush_output(session) < 0 || read_requests(session) < 0 || session_drained(session))
+            {
+                close_session(epoll_fd, session);
+            }
+        }
+        item = next;
+    }
+}
+
+static void accept_clients(int epoll_fd, int listen_fd)
+{
+    while (1)
+    {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int client_fd = accept(listen_fd, (struct sockaddr *)&address, &addrlen);
+        if (client_fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("accept failed");
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (set_nonblocking(client_fd) < 0)
+        {
+            perror("fcntl failed");
+            close(client_fd);
+            continue;
+        }
+
+        client_session_t *session = calloc(1, sizeof(*session));
+        if (session == NULL)
+        {
+            perror("Error allocating session");
+            close(client_fd);
+            continue;
+        }
+        session->fd = client_fd;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = session;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0)
+        {
+            perror("epoll_ctl failed");
+            close(client_fd);
+            free(session);
+            continue;
+        }
+        active_sessions++;
+        metrics_session_opened();
+        printf("Connection accepted. Active sessions: %d\n", active_sessions);
+    }
+}
+
+int run_event_loop(int listen_fd, int num_workers)
+{
+    int done_fd = worker_pool_start(num_workers);
+    if (done_fd < 0)
+    {
+        return -1;
+    }
+    if (set_nonblocking(listen_fd) < 0)
+    {
+        perror("fcntl failed");
+        return -1;
+    }
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+    {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    // The listening socket is tagged with a NULL pointer so it can be told
+    // apart from client sessions.
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+    {
+        perror("epoll_ctl failed");
+        close(epoll_fd);
+        return -1;
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &completion_tag;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_fd, &ev) < 0)
+    {
+        perror("epoll_ctl failed");
+        close(epoll_fd);
+        return -1;
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    while (1)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait failed");
+            close(epoll_fd);
+            return -1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &completion_tag)
+            {
+                complete_requests(epoll_fd);
+                continue;
+            }
+            client_session_t *session = events[i].data.ptr;
+            if (session == NULL)
+            {
+                accept_clients(epoll_fd, listen_fd);
+                continue;
+            }
+            if (session->closing)
+            {
+                continue;
+            }
+
+            int failed = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                failed = read_requests(session) < 0;
+            }
+            if (!failed)
+            {
+                failed = flush_output(session) < 0 || session_drained(session);
+            }
+            if (failed)
+            {
+                close_session(epoll_fd, session);
+            }
+        }
+        worker_pool_flush();
+        free_closed_sessions();
+    }
+}
\ No newline at end of file
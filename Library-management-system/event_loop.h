@@ -0,0 +1,11 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#define MAX_EPOLL_EVENTS 256
+
+// Serves every client on listen_fd from a single edge-triggered epoll loop.
+// Requests are executed on a pool of num_workers threads. Only returns on a
+// fatal error.
+int run_event_loop(int listen_fd, int num_workers);
+
+#endif // EVENT_LOOP_H
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "protocol.h"
+
+// Checks that a client which pipelines requests and then shuts down its
+// sending side (as `printf ... | nc` does) still gets every reply, and
+// that the server closes the connection once they are sent. A trailing
+// partial frame must neither be answered nor keep the connection open.
+// Run it against a server on a copy of the data files; exits non-zero on
+// failure.
+
+static const char *host = SERV_ADDR;
+static int port = SERV_PORT;
+static const char *email = "varad@gmail.com";
+static const char *password = "2002";
+
+static int connect_server(void)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+        connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("connect failed");
+        exit(EXIT_FAILURE);
+    }
+    // A server that never closes should fail the test, not hang it.
+    struct timeval timeout = {.tv_sec = 5};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+static int send_all(int sock, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Sends count requests after a sign-in, then partial_len bytes of one
+// more frame, and half-closes. Returns 0 if exactly count + 1 replies
+// come back before the server closes.
+static int run_case(int count, size_t partial_len)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    char credentials[256];
+    snprintf(credentials, sizeof(credentials), "%s|%s", email, password);
+    if (frame_append_request(&buf, &len, &cap, "SIGN_IN", credentials) < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (frame_append_request(&buf, &len, &cap, "CHECK_COPIES", "RTOS") < 0)
+        {
+            free(buf);
+            return -1;
+        }
+    }
+    size_t whole = len;
+    if (partial_len > 0 && frame_append_request(&buf, &len, &cap, "CHECK_COPIES", "RTOS") < 0)
+    {
+        free(buf);
+        return -1;
+    }
+    len = whole + partial_len;
+
+    int sock = connect_server();
+    int rc = send_all(sock, buf, len);
+    free(buf);
+    if (rc < 0 || shutdown(sock, SHUT_WR) < 0)
+    {
+        perror("send failed");
+        close(sock);
+        return -1;
+    }
+    int replies = 0;
+    int signed_in = 0;
+    char body[4096];
+    long n;
+    while ((n = frame_recv(sock, body, sizeof(body))) > 0)
+    {
+        if (replies == 0)
+        {
+            signed_in = strncmp(body, "Success", 7) == 0;
+        }
+        replies++;
+    }
+    close(sock);
+    if (n < 0)
+    {
+        printf("FAIL: %d requests, %zu partial bytes: no close after %d replies\n", count, partial_len, replies);
+        return -1;
+    }
+    if (replies != count + 1 || !signed_in)
+    {
+        printf("FAIL: %d requests, %zu partial bytes: %d replies%s\n", count, partial_len, replies,
+               signed_in ? "" : ", sign-in refused");
+        return -1;
+    }
+    printf("ok: %d requests, %zu partial bytes: %d replies, then closed\n", count, partial_len, replies);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:e:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'e':
+            email = optarg;
+            break;
+        case 'w':
+            password = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h host] [-p port] [-e email] [-w password]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    int failed = 0;
+    failed |= run_case(0, 0);
+    failed |= run_case(1, 0);
+    failed |= run_case(100, 0);
+    failed |= run_case(2000, 0);
+    failed |= run_case(100, 2);
+    failed |= run_case(100, 10);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
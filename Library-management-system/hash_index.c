@@ -0,0 +1,238 @@
+#include <string.h>
+
+#include "hash_index.h"
+#include "shared_mem.h"
+
+#define EMPTY_ROW -1
+#define REMOVED_ROW -2 // only in an array being moved out of
+#define MIN_SLOTS 64
+// Old slots moved per insert or remove while growing. Growth starts at
+// 3/4 full and the new array is twice the size, so the move is done well
+// before the new one reaches its own limit.
+#define MIGRATE_STEP 16
+
+typedef struct
+{
+    uint32_t hash;
+    int32_t row;
+} hash_slot_t;
+
+struct hash_index
+{
+    hash_key_fn key_of;
+    hash_slot_t *slots;
+    uint32_t mask; // slot count - 1
+    int count;
+    // While growing: the previous array and how much of it has moved.
+    hash_slot_t *old_slots;
+    uint32_t old_mask;
+    uint32_t migrated;
+};
+
+uint32_t hash_string(const char *key)
+{
+    // FNV-1a, then a final mix so that keys differing only at the end
+    // still spread over the low bits used for the slot.
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+    {
+        h = (h ^ *p) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+static hash_slot_t *alloc_slots(uint32_t count)
+{
+    hash_slot_t *slots = shared_alloc(count * sizeof(hash_slot_t));
+    if (slots)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            slots[i].row = EMPTY_ROW;
+        }
+    }
+    return slots;
+}
+
+hash_index_t *hash_index_create(int capacity, hash_key_fn key_of)
+{
+    hash_index_t *index = shared_alloc(sizeof(*index));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+    uint32_t size = MIN_SLOTS;
+    while (size / 4 * 3 < (uint32_t)capacity)
+    {
+        size *= 2;
+    }
+    index->key_of = key_of;
+    index->slots = alloc_slots(size);
+    index->mask = size - 1;
+    return index->slots ? index : NULL;
+}
+
+static int probe(const hash_index_t *index, const hash_slot_t *slots, uint32_t mask, uint32_t hash,
+                 const char *key)
+{
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i].row == EMPTY_ROW)
+        {
+            return -1;
+        }
+        if (slots[i].hash == hash && slots[i].row >= 0 && strcmp(index->key_of(slots[i].row), key) == 0)
+        {
+            return slots[i].row;
+        }
+    }
+}
+
+int hash_index_find(const hash_index_t *index, const char *key)
+{
+    uint32_t hash = hash_string(key);
+    int row = probe(index, index->slots, index->mask, hash, key);
+    if (row == -1 && index->old_slots)
+    {
+        row = probe(index, index->old_slots, index->old_mask, hash, key);
+    }
+    return row;
+}
+
+static void place(hash_slot_t *slots, uint32_t mask, uint32_t hash, int row)
+{
+    uint32_t i = hash & mask;
+    while (slots[i].row != EMPTY_ROW)
+    {
+        i = (i + 1) & mask;
+    }
+    slots[i].hash = hash;
+    slots[i].row = row;
+}
+
+// Moves a few more old slots across, and drops the old array once all
+// have moved. Moved slots stay behind in the old array: clearing them
+// would cut the probe runs of keys not yet moved.
+static void migrate(hash_index_t *index)
+{
+    if (index->old_slots == NULL)
+    {
+        return;
+    }
+    for (int n = 0; n < MIGRATE_STEP && index->migrated <= index->old_mask; n++, index->migrated++)
+    {
+        hash_slot_t *slot = &index->old_slots[index->migrated];
+        if (slot->row >= 0)
+        {
+            place(index->slots, index->mask, slot->hash, slot->row);
+        }
+    }
+    if (index->migrated > index->old_mask)
+    {
+        index->old_slots = NULL;
+    }
+}
+
+static int grow(hash_index_t *index)
+{
+    // Finish any earlier move first; with MIGRATE_STEP this is rare.
+    while (index->old_slots)
+    {
+        migrate(index);
+    }
+    uint32_t size = (index->mask + 1) * 2;
+    hash_slot_t *slots = alloc_slots(size);
+    if (slots == NULL)
+    {
+        return -1;
+    }
+    index->old_slots = index->slots;
+    index->old_mask = index->mask;
+    index->migrated = 0;
+    index->slots = slots;
+    index->mask = size - 1;
+    return 0;
+}
+
+int hash_index_insert(hash_index_t *index, int row)
+{
+    if ((uint32_t)(index->count + 1) > (index->mask + 1) / 4 * 3 && grow(index) < 0)
+    {
+        return -1;
+    }
+    place(index->slots, index->mask, hash_string(index->key_of(row)), row);
+    index->count++;
+    migrate(index);
+    return 0;
+}
+
+// Backward-shift deletion: pull later entries of the probe run into the
+// hole so that no tombstones build up.
+static void remove_at(hash_slot_t *slots, uint32_t mask, uint32_t hole)
+{
+    for (uint32_t i = (hole + 1) & mask; slots[i].row != EMPTY_ROW; i = (i + 1) & mask)
+    {
+        uint32_t home = slots[i].hash & mask;
+        // Move it if its home is not within (hole, i].
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole].row = EMPTY_ROW;
+}
+
+static int find_row(const hash_slot_t *slots, uint32_t mask, uint32_t hash, int row)
+{
+    for (uint32_t i = hash & mask; slots[i].row != EMPTY_ROW; i = (i + 1) & mask)
+    {
+        if (slots[i].row == row)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int hash_index_remove(hash_index_t *index, const char *key, int row)
+{
+    uint32_t hash = hash_string(key);
+    int found = 0;
+    int i = find_row(index->slots, index->mask, hash, row);
+    if (i >= 0)
+    {
+        remove_at(index->slots, index->mask, i);
+        found = 1;
+    }
+    if (index->old_slots)
+    {
+        // Not shifted: that could move a slot not yet migrated below the
+        // migration point.
+        i = find_row(index->old_slots, index->old_mask, hash, row);
+        if (i >= 0)
+        {
+            index->old_slots[i].row = REMOVED_ROW;
+            found = 1;
+        }
+    }
+    if (found)
+    {
+        index->count--;
+    }
+    migrate(index);
+    return found;
+}
+
+void hash_index_clear(hash_index_t *index)
+{
+    for (uint32_t i = 0; i <= index->mask; i++)
+    {
+        index->slots[i].row = EMPTY_ROW;
+    }
+    index->old_slots = NULL;
+    index->count = 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stdint.h>
+
+// Maps string keys to row numbers of a table that keeps the keys itself.
+// Open addressing with linear probing over 8-byte slots that hold the
+// key's hash next to the row, so a probe walks one cache line and only
+// compares strings when the hashes match.
+//
+// The index lives in the shared arena. Growing it never stops the world:
+// a bigger slot array is allocated and every insert or remove moves a few
+// slots of the old one across, while lookups check both until the move is
+// done. The old array is not returned to the arena, which never frees.
+// Each array is twice the one before, so those left behind add up to less
+// than the current one, and a grown index is always at least 3/8 full.
+// An index thus takes under twice its slot array, 43 bytes of arena per
+// key at worst: 4M accounts use a 64 MB array and leave under 64 MB
+// behind. An index created with its final capacity never grows.
+//
+// Lookups need the table's read lock; everything else its write lock.
+typedef const char *(*hash_key_fn)(int row);
+
+typedef struct hash_index hash_index_t;
+
+// Creates an index sized for about capacity rows. key_of returns the
+// current key of a row.
+hash_index_t *hash_index_create(int capacity, hash_key_fn key_of);
+
+// Row with this key, or -1.
+int hash_index_find(const hash_index_t *index, const char *key);
+
+// Adds a row under its current key, which must not be in the index yet.
+// Returns -1 if the arena is out of memory.
+int hash_index_insert(hash_index_t *index, int row);
+
+// Removes row, which was filed under key. The row's key may already have
+// changed, so the entry is matched by row. Returns 0 if it was not there.
+int hash_index_remove(hash_index_t *index, const char *key, int row);
+
+// Empties the index.
+void hash_index_clear(hash_index_t *index);
+
+uint32_t hash_string(const char *key);
+
+#endif // HASH_INDEX_H
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hash_index.h"
+#include "shared_mem.h"
+
+// Checks the hash index (hash_index.h) against a plain record of which
+// rows are filed under which keys. Each run starts from the smallest index
+// and grows it about ten times, with removes and renames mixed into every
+// stretch of inserts. A rename changes the key before removing the row
+// under its old one, as an email change does. Every operation is followed
+// by lookups of rows in the index, rows removed from it and keys never
+// filed, and every row is looked up now and then.
+//
+// The test follows the index's growth from outside, from the rules in
+// hash_index.c. While a migration is under way it removes and renames
+// rows whose slots in the old array lie around the point the move has
+// reached, where an entry shifted the wrong way would be skipped and lost.
+// Exits non-zero on failure.
+
+#define ROWS 40000
+#define KEY_LEN 24
+#define STEPS 300000
+#define FULL_CHECK_EVERY 5000
+
+// As in hash_index.c: the smallest index has 64 slots, it doubles when an
+// insert would take it past 3/4 full, and each insert or remove after that
+// moves 16 slots of the old array across.
+#define MODEL_MIN_SLOTS 64
+#define MODEL_MIGRATE_STEP 16
+#define NEAR_MIGRATION 12 // old slots either side of the migration point to aim removes at
+
+static char keys[ROWS][KEY_LEN];
+static char filed[ROWS]; // whether the row is in the index
+static int key_serial;
+static unsigned seed;
+static long failures;
+
+static uint32_t model_slots;
+static uint32_t old_slots; // 0 when no migration is under way
+static uint32_t migrated;
+// Rows filed when the index last grew, by their slot in the old array.
+static int by_old_home[ROWS];
+static int by_old_home_count;
+
+static const char *key_of(int row)
+{
+    return keys[row];
+}
+
+static void fail(const char *what, int row)
+{
+    if (failures++ < 10)
+    {
+        printf("FAIL: %s: row %d key %s\n", what, row, row >= 0 ? keys[row] : "-");
+    }
+}
+
+static uint32_t old_home(int row)
+{
+    return hash_string(keys[row]) & (old_slots - 1);
+}
+
+static int compare_old_home(const void *a, const void *b)
+{
+    uint32_t x = old_home(*(const int *)a);
+    uint32_t y = old_home(*(const int *)b);
+    return x < y ? -1 : x > y;
+}
+
+// Follows one insert or remove call, and the growth an insert causes.
+static void model_call(int inserting, int live)
+{
+    if (inserting && (uint32_t)(live + 1) > model_slots / 4 * 3)
+    {
+        old_slots = model_slots;
+        model_slots *= 2;
+        migrated = 0;
+        by_old_home_count = 0;
+        for (int row = 0; row < ROWS; row++)
+        {
+            if (filed[row])
+            {
+                by_old_home[by_old_home_count++] = row;
+            }
+        }
+        qsort(by_old_home, by_old_home_count, sizeof(int), compare_old_home);
+    }
+    if (old_slots != 0)
+    {
+        migrated += MODEL_MIGRATE_STEP;
+        if (migrated >= old_slots)
+        {
+            old_slots = 0;
+        }
+    }
+}
+
+// A filed row whose key has its home in the old array near the migration
+// point, or -1.
+static int row_near_migration(void)
+{
+    if (old_slots == 0 || by_old_home_count == 0)
+    {
+        return -1;
+    }
+    uint32_t low = migrated > NEAR_MIGRATION ? migrated - NEAR_MIGRATION : 0;
+    int first = 0;
+    int last = by_old_home_count;
+    while (first < last)
+    {
+        int mid = first + (last - first) / 2;
+        if (old_home(by_old_home[mid]) < low)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    // Rows since renamed have moved away from their entry here.
+    for (int i = first; i < by_old_home_count && old_home(by_old_home[i]) < migrated + NEAR_MIGRATION; i++)
+    {
+        int row = by_old_home[i];
+        if (filed[row] && rand_r(&seed) % 2 == 0)
+        {
+            return row;
+        }
+    }
+    return -1;
+}
+
+// A key no row has had before, so a removed key never comes back.
+static void new_key(int row)
+{
+    snprintf(keys[row], KEY_LEN, "user%d@lib.org", key_serial++);
+}
+
+static void check_row(hash_index_t *index, int row)
+{
+    int found = hash_index_find(index, keys[row]);
+    if (found != (filed[row] ? row : -1))
+    {
+        fail(filed[row] ? "filed row not found" : "removed row still found", row);
+    }
+}
+
+static void check_all(hash_index_t *index)
+{
+    for (int row = 0; row < ROWS; row++)
+    {
+        check_row(index, row);
+    }
+    char missing[KEY_LEN];
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(missing, sizeof(missing), "nobody%d@lib.org", rand_r(&seed));
+        if (hash_index_find(index, missing) != -1)
+        {
+            fail("key never filed found", -1);
+        }
+    }
+}
+
+static int run_seed(unsigned run)
+{
+    seed = run;
+    failures = 0;
+    memset(filed, 0, sizeof(filed));
+    for (int row = 0; row < ROWS; row++)
+    {
+        new_key(row);
+    }
+    model_slots = MODEL_MIN_SLOTS;
+    old_slots = 0;
+    hash_index_t *index = hash_index_create(1, key_of);
+    if (index == NULL)
+    {
+        fprintf(stderr, "Out of arena memory.\n");
+        return -1;
+    }
+    // Rows are drawn from a range that widens over the run, so the index
+    // keeps growing while a third or so of the operations remove.
+    int live = 0;
+    for (int step = 1; step <= STEPS; step++)
+    {
+        int range = 64 + (int)((long)(ROWS - 64) * step / STEPS);
+        int row = rand_r(&seed) % range;
+        int op = rand_r(&seed) % 10;
+        int near = row_near_migration();
+        if (near != -1)
+        {
+            row = near;
+            op = op < 5 ? 6 : 8; // remove or rename
+        }
+        if (!filed[row] && op < 6)
+        {
+            model_call(1, live);
+            if (hash_index_insert(index, row) < 0)
+            {
+                fprintf(stderr, "Out of arena memory.\n");
+                return -1;
+            }
+            filed[row] = 1;
+            live++;
+        }
+        else if (filed[row] && op < 8)
+        {
+            model_call(0, live);
+            if (hash_index_remove(index, keys[row], row) != 1)
+            {
+                fail("remove did not find the row", row);
+            }
+            filed[row] = 0;
+            live--;
+            new_key(row);
+        }
+        else if (filed[row])
+        {
+            char old_key[KEY_LEN];
+            strcpy(old_key, keys[row]);
+            new_key(row);
+            model_call(0, live);
+            model_call(1, live - 1);
+            if (hash_index_remove(index, old_key, row) != 1 || hash_index_insert(index, row) < 0)
+            {
+                fail("rename lost the row", row);
+            }
+        }
+        else
+        {
+            model_call(0, live);
+            if (hash_index_remove(index, keys[row], row) != 0)
+            {
+                fail("removed a row that was not filed", row);
+            }
+        }
+        check_row(index, row);
+        for (int i = 0; i < 4; i++)
+        {
+            check_row(index, rand_r(&seed) % range);
+        }
+        if (step % FULL_CHECK_EVERY == 0)
+        {
+            check_all(index);
+        }
+        // Once, empty the index in the middle of the run and refill it.
+        if (step == STEPS / 2)
+        {
+            hash_index_clear(index);
+            memset(filed, 0, sizeof(filed));
+            live = 0;
+            old_slots = 0;
+            check_all(index);
+        }
+    }
+    check_all(index);
+    if (failures > 0)
+    {
+        printf("FAIL: seed %u: %ld failures\n", run, failures);
+        return -1;
+    }
+    printf("ok: seed %u: %d rows filed at the end\n", run, live);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int seeds = argc > 1 ? atoi(argv[1]) : 4;
+    if (seeds < 1)
+    {
+        fprintf(stderr, "Usage: %s [seeds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (shared_arena_init(SHARED_ARENA_SIZE) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    int failed = 0;
+    for (int i = 1; i <= seeds; i++)
+    {
+        failed |= run_seed(i);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "book_store.h"
+#include "book_columns.h"
+#include "posting_list.h"
+#include "shared_mem.h"
+
+// Checks the secondary indexes behind LIST_BOOKS against plain scans.
+//
+// First the posting lists (posting_list.h) on their own: many lists share
+// one pool while rows come and go at random, so emptied lists give their
+// arrays back and growing ones take them. After each round every list
+// must hold exactly its rows in order, seek must agree with a linear
+// search from any position, and no two lists may share an array.
+//
+// Then the catalog: books are added, removed and moved between authors,
+// subjects and copy counts in a scratch book store, with authors retired
+// over time so that their lists empty and new ones grow from the pool.
+// Every filter LIST_BOOKS takes is paged through book_columns_list() from
+// cursors anywhere in the store, with small pages, and must give the same
+// slots as a walk over the store. Exits non-zero on failure.
+
+#define LISTS 300
+#define LIST_ROWS 2000
+#define LIST_STEPS 1000000
+#define CHECK_EVERY 50000
+
+#define BOOK_STEPS 60000
+#define SUBJECTS 6
+#define LIVE_AUTHORS 25 // authors in use at a time; older ones are retired
+#define RETIRE_EVERY 3000
+
+static unsigned seed;
+static long failures;
+
+static void fail(const char *what)
+{
+    if (failures++ < 10)
+    {
+        printf("FAIL: %s\n", what);
+    }
+}
+
+static int compare_lists(const void *a, const void *b)
+{
+    const posting_list_t *x = *(const posting_list_t *const *)a;
+    const posting_list_t *y = *(const posting_list_t *const *)b;
+    return x->rows < y->rows ? -1 : x->rows > y->rows;
+}
+
+static void check_lists(posting_list_t *lists, unsigned char (*in)[LIST_ROWS])
+{
+    posting_list_t *by_array[LISTS];
+    int with_array = 0;
+    for (int l = 0; l < LISTS; l++)
+    {
+        const posting_list_t *list = &lists[l];
+        int at = 0;
+        for (int row = 0; row < LIST_ROWS; row++)
+        {
+            if (in[l][row] && (at >= list->count || list->rows[at++] != row))
+            {
+                fail("posting list does not hold its rows in order");
+                return;
+            }
+        }
+        if (at != list->count)
+        {
+            fail("posting list holds rows it should not");
+            return;
+        }
+        for (int probe = 0; probe < 20; probe++)
+        {
+            int from = list->count ? rand_r(&seed) % (list->count + 1) : 0;
+            int row = rand_r(&seed) % (LIST_ROWS + 1);
+            int expected = from;
+            while (expected < list->count && list->rows[expected] < row)
+            {
+                expected++;
+            }
+            if (posting_list_seek(list, from, row) != expected)
+            {
+                fail("posting_list_seek disagrees with a linear search");
+                return;
+            }
+        }
+        if ((list->count == 0) != (list->rows == NULL))
+        {
+            fail("an empty list kept its array, or a list lost it");
+            return;
+        }
+        if (list->rows != NULL)
+        {
+            by_array[with_array++] = &lists[l];
+        }
+    }
+    qsort(by_array, with_array, sizeof(by_array[0]), compare_lists);
+    for (int i = 1; i < with_array; i++)
+    {
+        if (by_array[i - 1]->rows + by_array[i - 1]->cap > by_array[i]->rows)
+        {
+            fail("two posting lists share an array");
+            return;
+        }
+    }
+}
+
+static int test_posting_lists(void)
+{
+    static posting_list_t lists[LISTS];
+    static unsigned char in[LISTS][LIST_ROWS];
+    posting_pool_t *pool = shared_alloc(sizeof(*pool));
+    if (pool == NULL)
+    {
+        fprintf(stderr, "Out of arena memory.\n");
+        return -1;
+    }
+    for (int step = 1; step <= LIST_STEPS; step++)
+    {
+        // A few lists get long; the rest stay short and often empty out.
+        int l = rand_r(&seed) % LISTS;
+        if (rand_r(&seed) % 4 == 0)
+        {
+            l %= 5;
+        }
+        int row = rand_r(&seed) % LIST_ROWS;
+        if (rand_r(&seed) % 2 == 0)
+        {
+            if (!in[l][row])
+            {
+                if (posting_list_add(pool, &lists[l], row) < 0)
+                {
+                    fprintf(stderr, "Out of arena memory.\n");
+                    return -1;
+                }
+                in[l][row] = 1;
+            }
+        }
+        else
+        {
+            posting_list_remove(pool, &lists[l], row);
+            in[l][row] = 0;
+        }
+        if (step % CHECK_EVERY == 0)
+        {
+            check_lists(lists, in);
+        }
+    }
+    return 0;
+}
+
+static int author_epoch = 0;
+
+static void random_book(book_t *book, int number)
+{
+    memset(book, 0, sizeof(*book));
+    snprintf(book->title, sizeof(book->title), "Title %d", number);
+    snprintf(book->author, sizeof(book->author), "Author %d", author_epoch + rand_r(&seed) % LIVE_AUTHORS);
+    snprintf(book->subject, sizeof(book->subject), "Subject %d", rand_r(&seed) % SUBJECTS);
+    book->price = 1 + rand_r(&seed) % 100;
+    book->copies = rand_r(&seed) % 3;
+}
+
+static int matches(const book_t *book, const book_filter_t *filter)
+{
+    return (filter->subject == NULL || strcmp(book->subject, filter->subject) == 0) &&
+           (filter->author == NULL || strcmp(book->author, filter->author) == 0) &&
+           (!filter->available || book->copies > 0);
+}
+
+// Pages through the filter from start and compares with a walk over the
+// store.
+static void check_listing(const book_filter_t *filter, int start, int page_size)
+{
+    int slots[16];
+    int cursor = start;
+    int last = -1;
+    int expected = book_store_next(start);
+    while (expected != -1 && !matches(book_store_get(expected), filter))
+    {
+        expected = book_store_next(expected + 1);
+    }
+    while (1)
+    {
+        int next;
+        int found = book_columns_list(filter, cursor, slots, page_size, &next);
+        for (int i = 0; i < found; i++)
+        {
+            if (slots[i] != expected)
+            {
+                fail("LIST_BOOKS page differs from a scan of the store");
+                return;
+            }
+            last = slots[i];
+            expected = book_store_next(expected + 1);
+            while (expected != -1 && !matches(book_store_get(expected), filter))
+            {
+                expected = book_store_next(expected + 1);
+            }
+        }
+        if (next == -1)
+        {
+            break;
+        }
+        if (found != page_size || next <= last)
+        {
+            fail("LIST_BOOKS cursor does not move past the page");
+            return;
+        }
+        cursor = next;
+    }
+    if (expected != -1)
+    {
+        fail("LIST_BOOKS ended before the last match");
+    }
+}
+
+static const char *pick(const char *names[], int count)
+{
+    return names[rand_r(&seed) % count];
+}
+
+static void check_catalog(int titles)
+{
+    char subject[MAX_SUBJECT_LEN];
+    char author[MAX_AUTHOR_LEN];
+    char old_author[MAX_AUTHOR_LEN];
+    snprintf(subject, sizeof(subject), "Subject %d", rand_r(&seed) % SUBJECTS);
+    snprintf(author, sizeof(author), "Author %d", author_epoch + rand_r(&seed) % LIVE_AUTHORS);
+    snprintf(old_author, sizeof(old_author), "Author %d", rand_r(&seed) % (author_epoch + 1));
+    const char *subjects[] = {NULL, subject, "Early", "No such subject"};
+    const char *authors[] = {NULL, author, old_author, "Spread", "No such author"};
+    int end = titles + 2;
+    for (int i = 0; i < 40; i++)
+    {
+        book_filter_t filter = {.subject = pick(subjects, 4), .author = pick(authors, 5),
+                                .available = rand_r(&seed) % 2};
+        int start = rand_r(&seed) % 3 == 0 ? 0 : rand_r(&seed) % end;
+        check_listing(&filter, start, 1 + rand_r(&seed) % 7);
+    }
+}
+
+// Fixed books for the intersection: "Early" covers only the first slots,
+// while the shorter "Spread" list runs on well past its end, so the
+// search in the longer list runs out while the lead list still has rows.
+static int add_fixed_books(int *titles)
+{
+    for (int i = 0; i < 40; i++)
+    {
+        book_t book;
+        random_book(&book, (*titles)++);
+        if (i < 20)
+        {
+            strcpy(book.subject, "Early");
+        }
+        if (i % 4 == 1)
+        {
+            strcpy(book.author, "Spread");
+        }
+        if (book_store_add(&book) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int random_slot(int titles)
+{
+    int slot = book_store_next(rand_r(&seed) % (titles + 1));
+    return slot != -1 ? slot : book_store_next(0);
+}
+
+static int test_catalog(void)
+{
+    char dir[] = "/tmp/list_books_testXXXXXX";
+    char path[64];
+    int created;
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp failed");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, BOOK_STORE_FILE);
+    // A small store, so that it grows during the run as well.
+    int rc = book_store_open(path, 16, &created);
+    int titles = 0;
+    if (rc == 0)
+    {
+        rc = add_fixed_books(&titles);
+    }
+    for (int step = 1; rc == 0 && step <= BOOK_STEPS; step++)
+    {
+        if (step % RETIRE_EVERY == 0)
+        {
+            author_epoch += LIVE_AUTHORS / 2;
+        }
+        int op = rand_r(&seed) % 10;
+        int slot = random_slot(titles);
+        if (op < 4 || slot == -1)
+        {
+            book_t book;
+            random_book(&book, titles++);
+            rc = book_store_add(&book) < 0 ? -1 : 0;
+        }
+        else if (op < 6)
+        {
+            book_store_remove(slot);
+        }
+        else
+        {
+            // As UPDATE_BOOK, BORROW_BOOK and RETURN_BOOK change a book.
+            book_t changed;
+            random_book(&changed, 0);
+            book_t *book = book_store_get(slot);
+            if (op == 6)
+            {
+                strcpy(book->author, changed.author);
+            }
+            else if (op == 7)
+            {
+                strcpy(book->subject, changed.subject);
+            }
+            else
+            {
+                book->copies = changed.copies;
+            }
+            book_store_mark(slot);
+        }
+        if (step % 1000 == 0)
+        {
+            check_catalog(titles);
+        }
+    }
+    if (rc < 0)
+    {
+        fprintf(stderr, "Could not grow the book store in %s.\n", dir);
+    }
+    unlink(path);
+    rmdir(dir);
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    seed = argc > 1 ? (unsigned)atoi(argv[1]) : 1;
+    unsigned first_seed = seed;
+    if (shared_arena_init(SHARED_ARENA_SIZE) < 0 || test_posting_lists() < 0 || test_catalog() < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (failures > 0)
+    {
+        printf("FAIL: seed %u: %ld failures\n", first_seed, failures);
+        return EXIT_FAILURE;
+    }
+    printf("ok: seed %u: posting lists and LIST_BOOKS pages match a scan\n", first_seed);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,750 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+
+#include "config.h"
+#include "protocol.h"
+
+// Headless load generator. Opens many connections, signs each one in, then
+// drives a weighted mix of requests and reports throughput and latency
+// percentiles per command.
+//
+// Closed loop (default): every connection keeps one request outstanding.
+// Open loop (-r RATE): requests are issued at a fixed total rate whether or
+// not earlier ones have been answered, and latency is measured from the
+// scheduled send time, so a stalled server shows up in the percentiles
+// instead of silently lowering the offered load.
+//
+// Note that BORROW_BOOK and RETURN_BOOK change the data files; run it
+// against a copy.
+
+enum
+{
+    OP_SIGN_IN,
+    OP_CHECK_COPIES,
+    OP_BORROW_BOOK,
+    OP_RETURN_BOOK,
+    OP_VIEW_USERS,
+    NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = {"SIGN_IN", "CHECK_COPIES", "BORROW_BOOK", "RETURN_BOOK",
+                                         "VIEW_USERS"};
+
+// Log-linear latency histogram in nanoseconds, HDR style: every power of two
+// is split into HIST_SUB buckets, so any recorded value is off by less than
+// 1 / HIST_SUB (under 1%).
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (40 * HIST_SUB)
+
+typedef struct
+{
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t errors;
+    uint64_t max;
+} histogram_t;
+
+// Seconds a connection may wait for its sign-in before it counts as not
+// served.
+#define SIGN_IN_TIMEOUT 2
+
+// Requests sent on one connection and not yet answered, oldest first.
+#define MAX_IN_FLIGHT 4096
+
+typedef struct
+{
+    int fd;
+    char in_buf[64 * 1024]; // fits a full VIEW_USERS page
+    size_t in_len;
+    char *out_buf;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    uint64_t sent_at[MAX_IN_FLIGHT];
+    unsigned char ops[MAX_IN_FLIGHT];
+    int head;
+    int in_flight;
+} conn_t;
+
+static const char *host = SERV_ADDR;
+static int port = SERV_PORT;
+static const char *email = "varad@gmail.com";
+static const char *password = "2002";
+static const char *borrower = NULL;
+static char *titles[64];
+static int num_titles = 0;
+static int weights[NUM_OPS] = {5, 75, 10, 10};
+static int total_weight = 100;
+static uint64_t rng_state = 88172645463325252ull;
+
+static histogram_t histograms[NUM_OPS];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int hist_index(uint64_t value)
+{
+    if (value < HIST_SUB)
+    {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    int index = (shift + 1) * HIST_SUB + (int)((value >> shift) - HIST_SUB);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+// Midpoint of a bucket's value range.
+static uint64_t hist_value(int index)
+{
+    if (index < HIST_SUB)
+    {
+        return index;
+    }
+    int shift = index / HIST_SUB - 1;
+    uint64_t low = (uint64_t)(HIST_SUB + index % HIST_SUB) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+static void hist_record(histogram_t *hist, uint64_t value)
+{
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    if (value > hist->max)
+    {
+        hist->max = value;
+    }
+}
+
+static void hist_merge(histogram_t *into, const histogram_t *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    into->errors += from->errors;
+    if (from->max > into->max)
+    {
+        into->max = from->max;
+    }
+}
+
+static uint64_t hist_percentile(const histogram_t *hist, double percentile)
+{
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = hist_value(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+static void print_histogram(const char *name, const histogram_t *hist)
+{
+    static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    printf("%-13s %9llu %7llu", name, (unsigned long long)hist->total, (unsigned long long)hist->errors);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    {
+        printf(" %9.1f", hist->total ? hist_percentile(hist, percentiles[i]) / 1000.0 : 0.0);
+    }
+    printf(" %9.1f\n", hist->max / 1000.0);
+}
+
+// Parses "CHECK_COPIES=80,BORROW_BOOK=10,..." into weights. Commands left
+// out get weight 0.
+static int parse_mix(char *spec)
+{
+    memset(weights, 0, sizeof(weights));
+    total_weight = 0;
+    for (char *item = strtok(spec, ","); item; item = strtok(NULL, ","))
+    {
+        char *eq = strchr(item, '=');
+        if (eq == NULL)
+        {
+            return -1;
+        }
+        *eq = '\0';
+        int op;
+        for (op = 0; op < NUM_OPS; op++)
+        {
+            if (strcmp(item, op_names[op]) == 0)
+            {
+                break;
+            }
+        }
+        int weight = atoi(eq + 1);
+        if (op == NUM_OPS || weight < 0)
+        {
+            return -1;
+        }
+        weights[op] = weight;
+        total_weight += weight;
+    }
+    return total_weight > 0 ? 0 : -1;
+}
+
+static int pick_op(void)
+{
+    int roll = (int)(next_random() % total_weight);
+    for (int op = 0; op < NUM_OPS; op++)
+    {
+        if (roll < weights[op])
+        {
+            return op;
+        }
+        roll -= weights[op];
+    }
+    return OP_CHECK_COPIES;
+}
+
+// Queues one framed request on the connection, remembering when it was due.
+static int queue_request(conn_t *conn, int op, uint64_t due)
+{
+    if (conn->in_flight == MAX_IN_FLIGHT)
+    {
+        return -1;
+    }
+    char payload[256];
+    const char *title = titles[next_random() % num_titles];
+    switch (op)
+    {
+    case OP_SIGN_IN:
+        snprintf(payload, sizeof(payload), "%s|%s", email, password);
+        break;
+    case OP_CHECK_COPIES:
+        snprintf(payload, sizeof(payload), "%s", title);
+        break;
+    case OP_VIEW_USERS:
+        payload[0] = '\0';
+        break;
+    default:
+        snprintf(payload, sizeof(payload), "%s|%s", borrower, title);
+        break;
+    }
+    if (frame_append_request(&conn->out_buf, &conn->out_len, &conn->out_cap, op_names[op], payload) < 0)
+    {
+        return -1;
+    }
+    int slot = (conn->head + conn->in_flight) % MAX_IN_FLIGHT;
+    conn->sent_at[slot] = due;
+    conn->ops[slot] = (unsigned char)op;
+    conn->in_flight++;
+    return 0;
+}
+
+static int flush_conn(conn_t *conn)
+{
+    while (conn->out_sent < conn->out_len)
+    {
+        ssize_t n = send(conn->fd, conn->out_buf + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        conn->out_sent += n;
+    }
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    return 0;
+}
+
+// Reads whatever has arrived and records one sample per complete response.
+// Returns the number of responses, or -1 if the connection failed.
+static int read_responses(conn_t *conn)
+{
+    int answered = 0;
+    while (1)
+    {
+        ssize_t n = recv(conn->fd, conn->in_buf + conn->in_len, sizeof(conn->in_buf) - conn->in_len, 0);
+        if (n == 0)
+        {
+            return -1;
+        }
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return answered;
+            }
+            return -1;
+        }
+        conn->in_len += n;
+        uint64_t now = now_ns();
+        size_t off = 0;
+        while (conn->in_len - off >= FRAME_HEADER_LEN)
+        {
+            uint32_t body_len = frame_get_header((const unsigned char *)conn->in_buf + off);
+            if (FRAME_HEADER_LEN + body_len > sizeof(conn->in_buf) || conn->in_flight == 0)
+            {
+                fprintf(stderr, "Unexpected response from server.\n");
+                return -1;
+            }
+            if (conn->in_len - off < FRAME_HEADER_LEN + body_len)
+            {
+                break;
+            }
+            const char *body = conn->in_buf + off + FRAME_HEADER_LEN;
+            histogram_t *hist = &histograms[conn->ops[conn->head]];
+            hist_record(hist, now - conn->sent_at[conn->head]);
+            if (body_len >= 5 && memcmp(body, "Error", 5) == 0)
+            {
+                hist->errors++;
+            }
+            conn->head = (conn->head + 1) % MAX_IN_FLIGHT;
+            conn->in_flight--;
+            answered++;
+            off += FRAME_HEADER_LEN + body_len;
+        }
+        memmove(conn->in_buf, conn->in_buf + off, conn->in_len - off);
+        conn->in_len -= off;
+    }
+}
+
+// Sends one request on a blocking socket and waits for its response.
+static int blocking_request(int fd, const char *command, const char *payload, char *response, size_t size)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    int rc = -1;
+    if (frame_append_request(&buf, &len, &cap, command, payload) == 0 &&
+        send(fd, buf, len, MSG_NOSIGNAL) == (ssize_t)len && frame_recv(fd, response, size) > 0)
+    {
+        rc = 0;
+    }
+    free(buf);
+    return rc;
+}
+
+static int connect_blocking(struct sockaddr_in *address)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)address, sizeof(*address)) < 0)
+    {
+        perror("Connection failed");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval timeout = {.tv_sec = SIGN_IN_TIMEOUT};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// Connects and signs in with blocking calls, then switches the socket to
+// non-blocking for the measured run. A server that leaves the sign-in
+// unanswered for SIGN_IN_TIMEOUT seconds is not serving this connection:
+// it is dropped and the run goes on with the others.
+static int open_conn(conn_t *conn, struct sockaddr_in *address)
+{
+    conn->fd = connect_blocking(address);
+    if (conn->fd < 0)
+    {
+        return -1;
+    }
+    char payload[256];
+    char response[1024];
+    snprintf(payload, sizeof(payload), "%s|%s", email, password);
+    if (blocking_request(conn->fd, "SIGN_IN", payload, response, sizeof(response)) < 0)
+    {
+        fprintf(stderr, "Sign-in failed or timed out.\n");
+        return -1;
+    }
+    if (strncmp(response, "Success", 7) != 0)
+    {
+        fprintf(stderr, "Sign-in rejected: %s\n", response);
+        return -1;
+    }
+    return fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Reconnect mode: for the length of the run, one client after another
+// connects, signs in with SIGN_IN or with RESUME and a token taken from
+// one earlier sign-in, makes one CHECK_COPIES request and closes. Each
+// reconnect is timed as a whole, handshake included.
+static int run_reconnects(struct sockaddr_in *address, int resume, double duration)
+{
+    char payload[256];
+    char response[1024];
+    char token[128] = "";
+    snprintf(payload, sizeof(payload), "%s|%s", email, password);
+    if (resume)
+    {
+        int fd = connect_blocking(address);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        int rc = blocking_request(fd, "SIGN_IN", payload, response, sizeof(response));
+        close(fd);
+        const char *found = rc == 0 ? strstr(response, "Token: ") : NULL;
+        if (found == NULL)
+        {
+            fprintf(stderr, "Sign-in returned no token.\n");
+            return -1;
+        }
+        snprintf(token, sizeof(token), "%.*s", (int)strcspn(found + 7, "\n"), found + 7);
+    }
+    printf("Reconnecting with %s for %.1f s\n", resume ? "RESUME" : "SIGN_IN", duration);
+
+    histogram_t hist;
+    memset(&hist, 0, sizeof(hist));
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(duration * 1e9);
+    uint64_t now = start;
+    while (now < end)
+    {
+        int fd = connect_blocking(address);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (blocking_request(fd, resume ? "RESUME" : "SIGN_IN", resume ? token : payload, response,
+                             sizeof(response)) < 0 ||
+            strncmp(response, "Success", 7) != 0 ||
+            blocking_request(fd, "CHECK_COPIES", titles[next_random() % num_titles], response,
+                             sizeof(response)) < 0 ||
+            strncmp(response, "Success", 7) != 0)
+        {
+            hist.errors++;
+        }
+        close(fd);
+        uint64_t done = now_ns();
+        hist_record(&hist, done - now);
+        now = done;
+    }
+    double elapsed = (now - start) / 1e9;
+    printf("Completed %llu reconnects in %.2f s: %.0f reconnects/s, %llu errors\n",
+           (unsigned long long)hist.total, elapsed, hist.total / elapsed, (unsigned long long)hist.errors);
+    printf("\n%-13s %9s %7s %9s %9s %9s %9s %9s %9s\n", "Latency (us)", "count", "errors",
+           "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    print_histogram(resume ? "RESUME" : "SIGN_IN", &hist);
+    return 0;
+}
+
+// Connects every millisecond until the server accepts, and reports how
+// long that took from the start of loadgen. Started right after the
+// server, this measures its restart time.
+static int wait_for_server(struct sockaddr_in *address)
+{
+    uint64_t start = now_ns();
+    while (1)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            perror("socket failed");
+            return -1;
+        }
+        int rc = connect(fd, (struct sockaddr *)address, sizeof(*address));
+        close(fd);
+        if (rc == 0)
+        {
+            break;
+        }
+        if (now_ns() - start > 600 * 1000000000ull)
+        {
+            fprintf(stderr, "Server did not accept within 600 s.\n");
+            return -1;
+        }
+        usleep(1000);
+    }
+    printf("Server accepted after %.1f ms.\n", (now_ns() - start) / 1e6);
+    return 0;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-c connections] [-d seconds] [-r requests_per_sec] [-m mix]\n"
+            "          [-h host] [-p port] [-e email] [-w password] [-B borrower_email] [-b title,...]\n"
+            "          [-R sign_in|resume] [-W]\n"
+            "  -r  open loop at this total rate; omit for closed loop\n"
+            "  -m  weights, default SIGN_IN=5,CHECK_COPIES=75,BORROW_BOOK=10,RETURN_BOOK=10\n"
+            "  -R  reconnect for every request instead, signing in or resuming a token\n"
+            "  -W  only wait for the server to accept a connection and print how long it took\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_conns = 100;
+    double duration = 10.0;
+    double rate = 0.0;
+    char default_titles[] = "RTOS,C";
+    char *title_list = default_titles;
+    int wait_only = 0;
+    int reconnect = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:r:m:h:p:e:w:B:b:R:W")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            num_conns = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'm':
+            if (parse_mix(optarg) < 0)
+            {
+                fprintf(stderr, "Invalid mix: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'e':
+            email = optarg;
+            break;
+        case 'w':
+            password = optarg;
+            break;
+        case 'B':
+            borrower = optarg;
+            break;
+        case 'b':
+            title_list = optarg;
+            break;
+        case 'R':
+            reconnect = strcmp(optarg, "resume") == 0 ? 1 : strcmp(optarg, "sign_in") == 0 ? 0 : -2;
+            break;
+        case 'W':
+            wait_only = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_conns < 1 || duration <= 0 || rate < 0 || reconnect == -2)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (borrower == NULL)
+    {
+        borrower = email;
+    }
+    for (char *title = strtok(title_list, ","); title && num_titles < 64; title = strtok(NULL, ","))
+    {
+        titles[num_titles++] = title;
+    }
+    if (num_titles == 0)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    rng_state ^= now_ns();
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) <= 0)
+    {
+        fprintf(stderr, "Invalid address: %s\n", host);
+        return EXIT_FAILURE;
+    }
+    if (wait_only)
+    {
+        return wait_for_server(&address) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (reconnect >= 0)
+    {
+        return run_reconnects(&address, reconnect, duration) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    conn_t *conns = calloc(num_conns, sizeof(conn_t));
+    int epoll_fd = epoll_create1(0);
+    if (conns == NULL || epoll_fd < 0)
+    {
+        perror("Setup failed");
+        return EXIT_FAILURE;
+    }
+    // All connections are opened before any is driven, so a server that
+    // serves one client at a time signs in only the first.
+    int requested_conns = num_conns;
+    num_conns = 0;
+    for (int i = 0; i < requested_conns; i++)
+    {
+        conn_t *conn = &conns[num_conns];
+        if (open_conn(conn, &address) < 0)
+        {
+            if (conn->fd >= 0)
+            {
+                close(conn->fd);
+            }
+            free(conn->out_buf);
+            memset(conn, 0, sizeof(*conn));
+            continue;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+        num_conns++;
+    }
+    printf("Signed in %d of %d connections.\n", num_conns, requested_conns);
+    if (num_conns == 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("%s loop, %d connections, %.1f s", rate > 0 ? "Open" : "Closed", num_conns, duration);
+    if (rate > 0)
+    {
+        printf(", %.0f requests/s offered", rate);
+    }
+    printf("\n");
+
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(duration * 1e9);
+    uint64_t interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+    uint64_t next_due = start;
+    uint64_t skipped = 0;
+    int next_conn = 0;
+    int outstanding = 0;
+
+    if (rate == 0)
+    {
+        for (int i = 0; i < num_conns; i++)
+        {
+            queue_request(&conns[i], pick_op(), start);
+            flush_conn(&conns[i]);
+            outstanding++;
+        }
+    }
+
+    struct epoll_event events[256];
+    uint64_t now = start;
+    // After the run, allow one extra second for the last answers.
+    while (now < end || (outstanding > 0 && now < end + 1000000000ull))
+    {
+        // Nanosecond timeout: at high rates the next send is due well
+        // within a millisecond.
+        uint64_t wait_ns = 100000000;
+        if (rate > 0 && now < end)
+        {
+            wait_ns = next_due > now ? next_due - now : 0;
+        }
+        struct timespec timeout = {(time_t)(wait_ns / 1000000000), (long)(wait_ns % 1000000000)};
+        int n = epoll_pwait2(epoll_fd, events, 256, &timeout, NULL);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait failed");
+            return EXIT_FAILURE;
+        }
+        now = now_ns();
+        for (int i = 0; i < n; i++)
+        {
+            conn_t *conn = events[i].data.ptr;
+            int answered = read_responses(conn);
+            if (answered < 0 || flush_conn(conn) < 0)
+            {
+                fprintf(stderr, "Connection lost.\n");
+                return EXIT_FAILURE;
+            }
+            outstanding -= answered;
+            if (rate == 0 && now < end)
+            {
+                for (int j = 0; j < answered; j++)
+                {
+                    queue_request(conn, pick_op(), now);
+                    outstanding++;
+                }
+                flush_conn(conn);
+            }
+        }
+        // Open loop: send everything that has come due, even if that means
+        // catching up after a slow pass.
+        while (rate > 0 && next_due <= now && next_due < end)
+        {
+            conn_t *conn = &conns[next_conn];
+            next_conn = (next_conn + 1) % num_conns;
+            if (queue_request(conn, pick_op(), next_due) < 0)
+            {
+                skipped++;
+            }
+            else
+            {
+                outstanding++;
+                flush_conn(conn);
+            }
+            next_due += interval;
+        }
+    }
+    double elapsed = (now < end ? now - start : end - start) / 1e9;
+
+    histogram_t all;
+    memset(&all, 0, sizeof(all));
+    for (int op = 0; op < NUM_OPS; op++)
+    {
+        hist_merge(&all, &histograms[op]);
+    }
+    printf("Completed %llu requests in %.2f s: %.0f requests/s, %llu errors",
+           (unsigned long long)all.total, elapsed, all.total / elapsed, (unsigned long long)all.errors);
+    if (outstanding > 0 || skipped > 0)
+    {
+        printf(", %d unanswered, %llu not sent", outstanding, (unsigned long long)skipped);
+    }
+    printf("\n\n%-13s %9s %7s %9s %9s %9s %9s %9s %9s\n", "Latency (us)", "count", "errors",
+           "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    for (int op = 0; op < NUM_OPS; op++)
+    {
+        if (histograms[op].total > 0)
+        {
+            print_histogram(op_names[op], &histograms[op]);
+        }
+    }
+    print_histogram("all", &all);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <pthread.h>
+
+#include "locks.h"
+#include "shared_mem.h"
+
+#define NUM_TABLES 4
+
+// In shared memory, so processes forked after tables_lock_init() exclude
+// each other as well as their own threads.
+static pthread_rwlock_t *table_locks = NULL;
+
+int tables_lock_init(void)
+{
+    table_locks = shared_alloc(NUM_TABLES * sizeof(pthread_rwlock_t));
+    if (table_locks == NULL)
+    {
+        return -1;
+    }
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    for (int i = 0; i < NUM_TABLES; i++)
+    {
+        if (pthread_rwlock_init(&table_locks[i], &attr) != 0)
+        {
+            perror("Error initialising table lock");
+            pthread_rwlockattr_destroy(&attr);
+            return -1;
+        }
+    }
+    pthread_rwlockattr_destroy(&attr);
+    return 0;
+}
+
+void tables_lock(int read_mask, int write_mask)
+{
+    for (int i = 0; i < NUM_TABLES; i++)
+    {
+        if (write_mask & (1 << i))
+        {
+            pthread_rwlock_wrlock(&table_locks[i]);
+        }
+        else if (read_mask & (1 << i))
+        {
+            pthread_rwlock_rdlock(&table_locks[i]);
+        }
+    }
+}
+
+void tables_unlock(int mask)
+{
+    for (int i = NUM_TABLES - 1; i >= 0; i--)
+    {
+        if (mask & (1 << i))
+        {
+            pthread_rwlock_unlock(&table_locks[i]);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+// Each bit names one shared table together with the files backing it.
+#define LOCK_ACCOUNTS (1 << 0)   // accounts[] and their log records, payments.txt, fines.txt
+#define LOCK_BOOKS (1 << 1)      // the book store, books.db
+#define LOCK_BORROWINGS (1 << 2) // borrowings, their per-user and per-title lists, their log records
+#define LOCK_SESSIONS (1 << 3)   // session tokens (session_tokens.h)
+
+// Creates the locks in shared memory. Call once before forking.
+int tables_lock_init(void);
+
+// Takes a reader-writer lock per table: shared for read_mask, exclusive for
+// write_mask. Locks are always acquired in bit order, so callers cannot
+// deadlock each other.
+void tables_lock(int read_mask, int write_mask);
+
+// Releases every table in mask.
+void tables_unlock(int mask);
+
+#endif // LOCKS_H
\ No newline at end of file
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "shared_mem.h"
+#include "storage.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "commit.h"
+#include "payment.h"
+
+// Log-linear latency histogram in nanoseconds: every power of two is split
+// into HIST_SUB buckets, so a recorded value is off by less than 1/8. The
+// last bucket also takes anything slower than about a minute.
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS 280
+
+typedef struct
+{
+    uint32_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max_ns;
+} histogram_t;
+
+// Written only by the thread that claimed it.
+typedef struct
+{
+    histogram_t commands[METRICS_MAX_COMMANDS];
+    uint64_t errors[METRICS_MAX_COMMANDS];
+    histogram_t writes[NUM_METRIC_FILES];
+    uint64_t write_errors[NUM_METRIC_FILES];
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t sessions_opened;
+    uint64_t sessions_closed;
+} metrics_slot_t;
+
+typedef struct
+{
+    time_t started;
+    int slots_used;
+    metrics_slot_t slots[METRICS_MAX_THREADS];
+} metrics_registry_t;
+
+static metrics_registry_t *registry = NULL;
+static __thread metrics_slot_t *local_slot = NULL;
+static __thread int no_slot = 0;
+
+static const char *const file_names[NUM_METRIC_FILES] = {WAL_FILE, PAYMENT_LEDGER_FILE, SNAPSHOT_FILE,
+                                                         BOOK_STORE_FILE, "commit_sync", "commit_wait"};
+
+// Relaxed load and store rather than an atomic add: the owner is the only
+// writer, and readers merely must not see torn values.
+#define BUMP(counter, n) \
+    __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+#define READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+int metrics_init(void)
+{
+    registry = shared_alloc(sizeof(*registry));
+    if (registry == NULL)
+    {
+        return -1;
+    }
+    registry->started = time(NULL);
+    return 0;
+}
+
+uint64_t metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static metrics_slot_t *my_slot(void)
+{
+    if (local_slot == NULL && !no_slot)
+    {
+        int index = __atomic_fetch_add(&registry->slots_used, 1, __ATOMIC_RELAXED);
+        if (index < METRICS_MAX_THREADS)
+        {
+            local_slot = &registry->slots[index];
+        }
+        else
+        {
+            no_slot = 1;
+            fprintf(stderr, "Too many threads for the metrics registry; not recording on this one.\n");
+        }
+    }
+    return local_slot;
+}
+
+static int hist_bucket(uint64_t ns)
+{
+    if (ns < HIST_SUB)
+    {
+        return (int)ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int bucket = ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) | (int)((ns >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+// Smallest value that falls into bucket.
+static uint64_t hist_floor(int bucket)
+{
+    if (bucket < HIST_SUB)
+    {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    return (uint64_t)(HIST_SUB + (bucket & (HIST_SUB - 1))) << shift;
+}
+
+static void hist_record(histogram_t *hist, uint64_t ns)
+{
+    BUMP(hist->counts[hist_bucket(ns)], 1);
+    BUMP(hist->total, 1);
+    if (ns > READ(hist->max_ns))
+    {
+        __atomic_store_n(&hist->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+static void hist_merge(histogram_t *into, histogram_t *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        into->counts[i] += READ(from->counts[i]);
+    }
+    into->total += READ(from->total);
+    uint64_t max_ns = READ(from->max_ns);
+    if (max_ns > into->max_ns)
+    {
+        into->max_ns = max_ns;
+    }
+}
+
+// Upper edge of the bucket holding the given quantile, in microseconds.
+static double hist_quantile_us(const histogram_t *hist, double quantile)
+{
+    uint64_t rank = (uint64_t)(quantile * hist->total);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen > rank)
+        {
+            uint64_t edge = i + 1 < HIST_BUCKETS ? hist_floor(i + 1) : hist->max_ns;
+            return (edge < hist->max_ns ? edge : hist->max_ns) / 1000.0;
+        }
+    }
+    return hist->max_ns / 1000.0;
+}
+
+void metrics_record_request(int command, int error, uint64_t ns)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot == NULL)
+    {
+        return;
+    }
+    if (command < 0 || command >= METRICS_MAX_COMMANDS - 1)
+    {
+        command = METRICS_MAX_COMMANDS - 1;
+    }
+    hist_record(&slot->commands[command], ns);
+    if (error)
+    {
+        BUMP(slot->errors[command], 1);
+    }
+}
+
+void metrics_record_write(int file, int error, uint64_t ns)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot == NULL)
+    {
+        return;
+    }
+    hist_record(&slot->writes[file], ns);
+    if (error)
+    {
+        BUMP(slot->write_errors[file], 1);
+    }
+}
+
+void metrics_add_bytes_in(size_t bytes)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot)
+    {
+        BUMP(slot->bytes_in, bytes);
+    }
+}
+
+void metrics_add_bytes_out(size_t bytes)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot)
+    {
+        BUMP(slot->bytes_out, bytes);
+    }
+}
+
+void metrics_session_opened(void)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot)
+    {
+        BUMP(slot->sessions_opened, 1);
+    }
+}
+
+void metrics_session_closed(void)
+{
+    metrics_slot_t *slot = my_slot();
+    if (slot)
+    {
+        BUMP(slot->sessions_closed, 1);
+    }
+}
+
+static void report_histogram(reply_t *reply, const char *name, const histogram_t *hist, uint64_t errors)
+{
+    reply_append(reply, "%-18s %9llu %7llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+                 (unsigned long long)hist->total, (unsigned long long)errors,
+                 hist_quantile_us(hist, 0.5), hist_quantile_us(hist, 0.9), hist_quantile_us(hist, 0.99),
+                 hist_quantile_us(hist, 0.999), hist->max_ns / 1000.0);
+}
+
+void metrics_report(reply_t *reply)
+{
+    histogram_t *merged = calloc(1, sizeof(*merged));
+    if (merged == NULL)
+    {
+        reply_append(reply, "Error: Out of memory.\n");
+        return;
+    }
+    int used = READ(registry->slots_used);
+    if (used > METRICS_MAX_THREADS)
+    {
+        used = METRICS_MAX_THREADS;
+    }
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t opened = 0;
+    uint64_t closed = 0;
+    for (int i = 0; i < used; i++)
+    {
+        metrics_slot_t *slot = &registry->slots[i];
+        bytes_in += READ(slot->bytes_in);
+        bytes_out += READ(slot->bytes_out);
+        opened += READ(slot->sessions_opened);
+        closed += READ(slot->sessions_closed);
+    }
+    reply_append(reply, "uptime_seconds %lld\n", (long long)(time(NULL) - registry->started));
+    reply_append(reply, "active_sessions %lld\n", (long long)(opened - closed));
+    reply_append(reply, "sessions_opened %llu\n", (unsigned long long)opened);
+    reply_append(reply, "bytes_in %llu\n", (unsigned long long)bytes_in);
+    reply_append(reply, "bytes_out %llu\n", (unsigned long long)bytes_out);
+    reply_append(reply, "commit_policy %s\n", commit_describe());
+
+    reply_append(reply, "%-18s %9s %7s %9s %9s %9s %9s %9s\n", "command", "count", "errors",
+                 "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us");
+    for (int c = 0; c < METRICS_MAX_COMMANDS; c++)
+    {
+        memset(merged, 0, sizeof(*merged));
+        uint64_t errors = 0;
+        for (int i = 0; i < used; i++)
+        {
+            hist_merge(merged, &registry->slots[i].commands[c]);
+            errors += READ(registry->slots[i].errors[c]);
+        }
+        if (merged->total > 0)
+        {
+            const char *name = c < command_count() ? command_name(c) : "UNKNOWN";
+            report_histogram(reply, name, merged, errors);
+        }
+    }
+
+    reply_append(reply, "%-18s %9s %7s %9s %9s %9s %9s %9s\n", "write", "count", "errors",
+                 "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us");
+    for (int f = 0; f < NUM_METRIC_FILES; f++)
+    {
+        memset(merged, 0, sizeof(*merged));
+        uint64_t errors = 0;
+        for (int i = 0; i < used; i++)
+        {
+            hist_merge(merged, &registry->slots[i].writes[f]);
+            errors += READ(registry->slots[i].write_errors[f]);
+        }
+        report_histogram(reply, file_names[f], merged, errors);
+    }
+    free(merged);
+}
+
+static void *dump_main(void *arg)
+{
+    int interval = *(int *)arg;
+    free(arg);
+    while (1)
+    {
+        sleep(interval);
+        char buf[RESPONSE_BUF_LEN];
+        reply_t report = {buf, 0, sizeof(buf), 0};
+        reply_set(&report, "");
+        metrics_report(&report);
+        FILE *file = fopen("stats.tmp", "w");
+        if (file == NULL)
+        {
+            perror("Error creating stats file");
+            reply_free(&report);
+            continue;
+        }
+        size_t written = fwrite(report.buf, 1, report.len, file);
+        if (fclose(file) != 0 || written != report.len || rename("stats.tmp", STATS_FILE) != 0)
+        {
+            perror("Error writing stats file");
+        }
+        reply_free(&report);
+    }
+    return NULL;
+}
+
+int metrics_start_dump(int interval)
+{
+    int *arg = malloc(sizeof(*arg));
+    if (arg == NULL)
+    {
+        perror("Error starting stats dump");
+        return -1;
+    }
+    *arg = interval;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, dump_main, arg) != 0)
+    {
+        perror("Error starting stats dump");
+        free(arg);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "command.h"
+
+// Server-wide counters and latency histograms. Every thread that records
+// gets its own slot in shared memory and is the only writer of that slot,
+// so recording takes no lock and no atomic read-modify-write; readers
+// (STATS and the dump file) add all slots up. Because the slots live in
+// the shared arena, the totals cover every process of `server -p`.
+#define METRICS_MAX_THREADS 128
+#define METRICS_MAX_COMMANDS 32 // one more than the schema has, for unknown commands
+#define STATS_FILE "stats.txt"
+
+// Files whose writes are timed, and the two sides of a commit (commit.h):
+// one sync, and the wait of each request from being answered until its
+// changes are on disk.
+enum
+{
+    METRIC_FILE_WAL,
+    METRIC_FILE_LEDGER,
+    METRIC_FILE_SNAPSHOT,
+    METRIC_FILE_BOOKS,
+    METRIC_COMMIT_SYNC,
+    METRIC_COMMIT_WAIT,
+    NUM_METRIC_FILES
+};
+
+// Allocates the registry from the shared arena. Call once before forking.
+int metrics_init(void);
+
+uint64_t metrics_now_ns(void);
+
+// command is the schema index from command_index(), or -1 if unknown.
+void metrics_record_request(int command, int error, uint64_t ns);
+void metrics_record_write(int file, int error, uint64_t ns);
+void metrics_add_bytes_in(size_t bytes);
+void metrics_add_bytes_out(size_t bytes);
+void metrics_session_opened(void);
+void metrics_session_closed(void);
+
+// Appends the merged statistics as text lines.
+void metrics_report(reply_t *reply);
+
+// Starts a thread that rewrites STATS_FILE every interval seconds.
+int metrics_start_dump(int interval);
+
+#endif // METRICS_H
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "overdue.h"
+#include "storage.h"
+#include "locks.h"
+#include "shared_mem.h"
+
+typedef struct
+{
+    timer_wheel_t *wheel;
+    int first; // overdue list, by due date
+    int last;
+    int count;
+} overdue_state_t;
+
+static overdue_state_t *state = NULL;
+
+// Borrowings that came due during one pass of the thread, put on the
+// overdue list together at the end of it. Only the thread uses it.
+typedef struct
+{
+    time_t now;
+    int *rows;
+    int count;
+    int cap;
+} due_batch_t;
+
+static timer_link_t *borrowing_timer(int row)
+{
+    return &borrowing_row(row)->timer;
+}
+
+int overdue_init(void)
+{
+    state = shared_alloc(sizeof(*state));
+    if (state == NULL)
+    {
+        return -1;
+    }
+    state->first = -1;
+    state->last = -1;
+    state->wheel = timer_wheel_create(time(NULL), borrowing_timer);
+    return state->wheel ? 0 : -1;
+}
+
+int overdue_days(const borrowing_t *borrowing, time_t now)
+{
+    return now > borrowing->due_date_timestamp ? (now - borrowing->due_date_timestamp) / FINE_DAY_SECONDS : 0;
+}
+
+// When the fine of a borrowing next changes: once it is past due, and
+// then as each further day of fine becomes due.
+static int64_t next_change(const borrowing_row_t *entry)
+{
+    int64_t due = entry->borrowing.due_date_timestamp;
+    return entry->overdue ? due + (int64_t)(entry->accrued_days + 1) * FINE_DAY_SECONDS : due + 1;
+}
+
+void overdue_track(int row)
+{
+    borrowing_row_t *entry = borrowing_row(row);
+    timer_wheel_init_link(&entry->timer);
+    entry->overdue = 0;
+    timer_wheel_add(state->wheel, row, next_change(entry));
+}
+
+void overdue_untrack(int row)
+{
+    borrowing_row_t *entry = borrowing_row(row);
+    timer_wheel_cancel(state->wheel, row);
+    if (!entry->overdue)
+    {
+        return;
+    }
+    if (entry->overdue_prev != -1)
+    {
+        borrowing_row(entry->overdue_prev)->overdue_next = entry->overdue_next;
+    }
+    else
+    {
+        state->first = entry->overdue_next;
+    }
+    if (entry->overdue_next != -1)
+    {
+        borrowing_row(entry->overdue_next)->overdue_prev = entry->overdue_prev;
+    }
+    else
+    {
+        state->last = entry->overdue_prev;
+    }
+    entry->overdue = 0;
+    state->count--;
+}
+
+int overdue_accrue(int row, int days)
+{
+    borrowing_row_t *entry = borrowing_row(row);
+    int fine = (days - entry->accrued_days) * FINE_PER_DAY;
+    entry->accrued_days = days;
+    int account_type;
+    int index = find_account_by_email(entry->borrowing.user_email, &account_type);
+    if (index != -1 && account_type == 1)
+    {
+        account_at(index)->data.user.fines_due += fine;
+    }
+    timer_wheel_add(state->wheel, row, next_change(entry));
+    return fine;
+}
+
+int first_overdue(void)
+{
+    return state->first;
+}
+
+int next_overdue(int row)
+{
+    return borrowing_row(row)->overdue_next;
+}
+
+int overdue_count(void)
+{
+    return state->count;
+}
+
+// Inserts a row after the last one due no later than it. Rows come due in
+// date order, so this almost never walks.
+static void list_insert(int row)
+{
+    borrowing_row_t *entry = borrowing_row(row);
+    int after = state->last;
+    while (after != -1 && borrowing_at(after)->due_date_timestamp > entry->borrowing.due_date_timestamp)
+    {
+        after = borrowing_row(after)->overdue_prev;
+    }
+    entry->overdue_prev = after;
+    entry->overdue_next = after == -1 ? state->first : borrowing_row(after)->overdue_next;
+    if (entry->overdue_next != -1)
+    {
+        borrowing_row(entry->overdue_next)->overdue_prev = row;
+    }
+    else
+    {
+        state->last = row;
+    }
+    if (after != -1)
+    {
+        borrowing_row(after)->overdue_next = row;
+    }
+    else
+    {
+        state->first = row;
+    }
+    state->count++;
+}
+
+static void fire(int row, void *arg)
+{
+    due_batch_t *batch = arg;
+    borrowing_row_t *entry = borrowing_row(row);
+    if (!entry->overdue)
+    {
+        if (batch->count == batch->cap)
+        {
+            int new_cap = batch->cap ? batch->cap * 2 : 256;
+            int *rows = realloc(batch->rows, new_cap * sizeof(int));
+            if (rows == NULL)
+            {
+                // Try again next second.
+                perror("Error tracking overdue borrowings");
+                timer_wheel_add(state->wheel, row, batch->now + 1);
+                return;
+            }
+            batch->rows = rows;
+            batch->cap = new_cap;
+        }
+        batch->rows[batch->count++] = row;
+        entry->overdue = 1;
+    }
+    int days = overdue_days(&entry->borrowing, batch->now);
+    if (days > entry->accrued_days)
+    {
+        overdue_accrue(row, days);
+        log_borrowing_accrue(&entry->borrowing, days);
+    }
+    else
+    {
+        timer_wheel_add(state->wheel, row, next_change(entry));
+    }
+}
+
+static int compare_due(const void *a, const void *b)
+{
+    time_t due_a = borrowing_at(*(const int *)a)->due_date_timestamp;
+    time_t due_b = borrowing_at(*(const int *)b)->due_date_timestamp;
+    if (due_a != due_b)
+    {
+        return due_a < due_b ? -1 : 1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+static void *overdue_main(void *arg)
+{
+    due_batch_t batch = {0};
+    while (1)
+    {
+        sleep(1);
+        tables_lock(0, LOCK_ACCOUNTS | LOCK_BORROWINGS);
+        batch.now = time(NULL);
+        batch.count = 0;
+        timer_wheel_advance(state->wheel, batch.now, fire, &batch);
+        // After a restart everything already late comes due at once, in
+        // no particular order.
+        if (batch.count > 1)
+        {
+            qsort(batch.rows, batch.count, sizeof(int), compare_due);
+        }
+        for (int i = 0; i < batch.count; i++)
+        {
+            list_insert(batch.rows[i]);
+        }
+        // Not synced: a lost accrual is charged again when its timer
+        // fires after the restart, since the fine follows from the clock.
+        storage_flush(LOCK_ACCOUNTS | LOCK_BORROWINGS);
+        tables_unlock(LOCK_ACCOUNTS | LOCK_BORROWINGS);
+    }
+    return NULL;
+}
+
+int overdue_start(void)
+{
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, overdue_main, NULL) != 0)
+    {
+        perror("Error starting overdue tracking");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef OVERDUE_H
+#define OVERDUE_H
+
+#include <time.h>
+
+#include "types.h"
+
+#define LOAN_SECONDS (7 * 24 * 60 * 60)
+#define FINE_DAY_SECONDS (24 * 60 * 60)
+#define FINE_PER_DAY 5
+
+// Every borrowing has a timer on a timer wheel (timer_wheel.h) for the
+// next moment its fine changes: just after its due date, then each full
+// day after that. A background thread moves the wheel on once a second.
+// A borrowing that comes due goes on the overdue list, which is kept in
+// due-date order, and each day late adds FINE_PER_DAY to the user's
+// fines_due at once, in one log record, instead of all of it on return.
+// Only the timers that come due are touched, never the whole table.
+//
+// Everything here needs the borrowings write lock, and the accounts write
+// lock where fines change; the lists need the borrowings read lock.
+
+// Sets up the wheel in the shared arena. Call before loading the tables.
+int overdue_init(void);
+
+// Called by storage.c as borrowings are added and removed.
+void overdue_track(int row);
+void overdue_untrack(int row);
+
+// Whole days a borrowing is late at now; 0 before it is due.
+int overdue_days(const borrowing_t *borrowing, time_t now);
+
+// Brings the fine charged for a borrowing up to days, adding the
+// difference to the user's fines_due, and re-arms its timer. Returns the
+// amount added.
+int overdue_accrue(int row, int days);
+
+// Walk the overdue list, earliest due date first; -1 at the end.
+int first_overdue(void);
+int next_overdue(int row);
+int overdue_count(void);
+
+// Starts the thread that moves the wheel on. Start it in one process only.
+int overdue_start(void);
+
+#endif // OVERDUE_H
\ No newline at end of file
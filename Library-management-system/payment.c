@@ -1,47 +1,438 @@
-#include "payment.h"
-#include "fileutil.h"
-#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
-#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "payment.h"
+#include "storage.h"
+#include "table.h"
+#include "text_scan.h"
+
+#define LEDGER_MAGIC "LMSPAY01"
+#define LOAD_BATCH 4096 // records read at a time
+
+typedef struct
+{
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+} ledger_header_t;
+
+typedef struct
+{
+    Payment payment;
+    int32_t prev; // the member's previous record, or -1
+    int32_t reserved;
+} payment_row_t;
+
+static table_t *payment_rows;
+// Open for appending from load on. It is opened before the server forks,
+// so with -p every process shares the one O_APPEND file.
+static int ledger_fd = -1;
+
+int payment_ledger_init(void)
+{
+    payment_rows = table_create(sizeof(payment_row_t));
+    return payment_rows ? 0 : -1;
+}
+
+static payment_row_t *payment_row(int row)
+{
+    return table_row(payment_rows, row);
+}
+
+static int newest_of_member(const account_ledger_t *totals)
+{
+    return totals->last[PAYMENT_FEE] > totals->last[PAYMENT_FINE] ? totals->last[PAYMENT_FEE]
+                                                                  : totals->last[PAYMENT_FINE];
+}
+
+// Appends a record to the table and, if it names a member and a type we
+// know, to the member's chain and totals. Records that do not stay in the
+// table unlinked, so that row numbers keep matching places in the file.
+static int link_payment(const Payment *payment)
+{
+    int row = table_append(payment_rows);
+    if (row < 0)
+    {
+        return -1;
+    }
+    payment_row_t *entry = payment_row(row);
+    entry->payment = *payment;
+    entry->payment.id = row;
+    entry->prev = -1;
+    if (payment->memberid < 0 || payment->memberid >= tables->ledgers->count ||
+        (payment->type != PAYMENT_FEE && payment->type != PAYMENT_FINE))
+    {
+        return row;
+    }
+    account_ledger_t *totals = account_ledger(payment->memberid);
+    entry->prev = newest_of_member(totals);
+    if (payment->type == PAYMENT_FEE)
+    {
+        totals->paid += payment->amount;
+    }
+    else
+    {
+        totals->fined += payment->amount;
+    }
+    totals->last[payment->type] = row;
+    return row;
+}
+
+int payment_add(int memberid, int amount, int type, Payment *payment)
+{
+    payment->id = payment_rows->count;
+    payment->memberid = memberid;
+    payment->amount = amount;
+    payment->type = type;
+    payment->txtime = time(NULL);
+    return link_payment(payment) < 0 ? -1 : 0;
+}
+
+int payment_find_by_member(int memberid, int type, Payment *payments, int max_payments)
+{
+    int count = 0;
+    if (memberid < 0 || memberid >= tables->ledgers->count)
+    {
+        return 0;
+    }
+    int row = type == PAYMENT_ANY ? newest_of_member(account_ledger(memberid)) : account_ledger(memberid)->last[type];
+    while (row != -1 && count < max_payments)
+    {
+        const payment_row_t *entry = payment_row(row);
+        if (type == PAYMENT_ANY || entry->payment.type == type)
+        {
+            payments[count++] = entry->payment;
+        }
+        row = entry->prev;
+    }
+    return count;
+}
+
+const Payment *payment_find_last_paid(int memberid, int type)
+{
+    if (memberid < 0 || memberid >= tables->ledgers->count)
+    {
+        return NULL;
+    }
+    const account_ledger_t *totals = account_ledger(memberid);
+    int row = type == PAYMENT_ANY ? newest_of_member(totals) : totals->last[type];
+    return row == -1 ? NULL : &payment_row(row)->payment;
+}
+
+// Reads the records after the header. A record cut short by a crash
+// during an append is dropped from the file, so the next append follows
+// the last whole one.
+static int read_ledger(FILE *file)
+{
+    ledger_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, LEDGER_MAGIC, sizeof(header.magic)) != 0 ||
+        header.record_size != sizeof(Payment))
+    {
+        fprintf(stderr, "Error: %s is not a payments ledger.\n", PAYMENT_LEDGER_FILE);
+        return -1;
+    }
+    static Payment batch[LOAD_BATCH];
+    size_t read;
+    long long total = 0;
+    while ((read = fread(batch, sizeof(Payment), LOAD_BATCH, file)) > 0)
+    {
+        for (size_t i = 0; i < read; i++)
+        {
+            if (link_payment(&batch[i]) < 0)
+            {
+                fprintf(stderr, "Error: out of memory loading %s.\n", PAYMENT_LEDGER_FILE);
+                return -1;
+            }
+            total += batch[i].amount;
+        }
+    }
+    if (ferror(file))
+    {
+        perror("Error reading payments ledger");
+        return -1;
+    }
+    off_t whole = sizeof(header) + (off_t)payment_rows->count * sizeof(Payment);
+    if (ftello(file) > whole)
+    {
+        fprintf(stderr, "Dropping a partial record at the end of %s.\n", PAYMENT_LEDGER_FILE);
+        if (ftruncate(fileno(file), whole) < 0)
+        {
+            perror("Error truncating payments ledger");
+            return -1;
+        }
+    }
+    printf("Loaded %d payments totalling %lld from %s.\n", payment_rows->count, total, PAYMENT_LEDGER_FILE);
+    return 0;
+}
+
+// Before the ledger, payments went to payments.txt and fines to fines.txt
+// as email|amount|date lines; the oldest payments are written as
+// `Email: ... | Amount: ... | Date: ...`. Both files are imported once,
+// in date order, into a new ledger, and left as they are.
+typedef struct
+{
+    const char *email; // into the mapped file
+    int email_len;
+    int amount;
+    int type;
+    int line; // place in its file, to keep the order within a day
+    time_t txtime;
+} legacy_entry_t;
+
+typedef struct
+{
+    legacy_entry_t *entries;
+    int count;
+    int cap;
+} legacy_list_t;
+
+// A YYYY-MM-DD date as local midnight; 0 if there is none. Lines come in
+// runs of the same date and mktime() is slow, so the last date is kept.
+static time_t parse_legacy_date(text_field_t field)
+{
+    static char last_date[16];
+    static time_t last_time;
+    char date[16];
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    text_field_unlabel(&field, "Date");
+    if (text_field_copy(date, sizeof(date), field) < 0)
+    {
+        return 0;
+    }
+    if (strcmp(date, last_date) == 0)
+    {
+        return last_time;
+    }
+    if (sscanf(date, "%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3)
+    {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    strcpy(last_date, date);
+    last_time = t == (time_t)-1 ? 0 : t;
+    return last_time;
+}
+
+static int parse_legacy_line(const text_field_t *fields, int count, legacy_entry_t *entry)
+{
+    if (count < 2)
+    {
+        return -1;
+    }
+    text_field_t email = fields[0];
+    text_field_t amount = fields[1];
+    if (text_field_unlabel(&email, "Email") == 0 && text_field_unlabel(&amount, "Amount") < 0)
+    {
+        return -1;
+    }
+    if (email.len == 0 || email.len >= MAX_EMAIL_LEN || text_field_int(amount, &entry->amount) != 0)
+    {
+        return -1;
+    }
+    entry->email = email.ptr;
+    entry->email_len = email.len;
+    entry->txtime = count >= 3 ? parse_legacy_date(fields[2]) : 0;
+    return 0;
+}
+
+static int read_legacy_file(text_file_t *file, const char *path, int type, legacy_list_t *list)
+{
+    if (text_file_open(file, path) < 0)
+    {
+        return 0;
+    }
+    text_field_t fields[3];
+    int count;
+    int line = 0;
+    legacy_entry_t entry;
+    while ((count = text_file_next_line(file, fields, 3)) >= 0)
+    {
+        if (parse_legacy_line(fields, count, &entry) < 0)
+        {
+            continue;
+        }
+        if (list->count == list->cap)
+        {
+            int new_cap = list->cap ? list->cap * 2 : 1024;
+            legacy_entry_t *grown = realloc(list->entries, new_cap * sizeof(*grown));
+            if (grown == NULL)
+            {
+                perror("Error importing payments");
+                return -1;
+            }
+            list->entries = grown;
+            list->cap = new_cap;
+        }
+        entry.type = type;
+        entry.line = line++;
+        list->entries[list->count++] = entry;
+    }
+    return 0;
+}
+
+// By date, then fees before fines, then by place in the file.
+static int compare_legacy(const void *a, const void *b)
+{
+    const legacy_entry_t *x = a;
+    const legacy_entry_t *y = b;
+    if (x->txtime != y->txtime)
+    {
+        return x->txtime < y->txtime ? -1 : 1;
+    }
+    if (x->type != y->type)
+    {
+        return x->type - y->type;
+    }
+    return x->line - y->line;
+}
 
-Payment payment_new(int id, int memberid, double amount, const char *type, time_t txtime, int fineid)
+// Writes the ledger under a temporary name and renames it into place, so
+// an import cut short is simply done again at the next start.
+static int write_new_ledger(const legacy_list_t *list)
 {
-    Payment payment = {0};
-    payment.id = id;
-    payment.memberid = memberid;
-    payment.amount = amount;
-    strncpy(payment.type, type ? type : "", MAX_TYPE_LEN - 1);
-    payment.txtime = txtime;
-    payment.fineid = fineid;
-    return payment;
+    const char *temp_path = PAYMENT_LEDGER_FILE ".tmp";
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL)
+    {
+        perror("Error creating payments ledger");
+        return -1;
+    }
+    ledger_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LEDGER_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(Payment);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    int unmatched = 0;
+    for (int i = 0; ok && i < list->count; i++)
+    {
+        const legacy_entry_t *entry = &list->entries[i];
+        char email[MAX_EMAIL_LEN];
+        memcpy(email, entry->email, entry->email_len);
+        email[entry->email_len] = '\0';
+        int account_type;
+        Payment payment;
+        payment.memberid = find_account_by_email(email, &account_type);
+        if (payment.memberid < 0)
+        {
+            unmatched++;
+            continue;
+        }
+        payment.id = payment_rows->count;
+        payment.amount = entry->amount;
+        payment.type = entry->type;
+        payment.txtime = entry->txtime;
+        if (link_payment(&payment) < 0)
+        {
+            fprintf(stderr, "Error: out of memory importing payments.\n");
+            ok = 0;
+            break;
+        }
+        ok = fwrite(&payment, sizeof(payment), 1, file) == 1;
+    }
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !ok)
+    {
+        perror("Error writing payments ledger");
+        unlink(temp_path);
+        return -1;
+    }
+    if (rename(temp_path, PAYMENT_LEDGER_FILE) < 0)
+    {
+        perror("Error replacing payments ledger");
+        unlink(temp_path);
+        return -1;
+    }
+    printf("Imported %d payments into %s", payment_rows->count, PAYMENT_LEDGER_FILE);
+    if (unmatched > 0)
+    {
+        printf(" (%d lines for unknown accounts left out)", unmatched);
+    }
+    printf(".\n");
+    return 0;
 }
 
-int payment_add_new(const Payment *payment)
+static int import_legacy(void)
 {
-    Payment new_payment = *payment;
-    new_payment.id = get_next_id(PAYMENTS_FILE, sizeof(Payment));
-    return write_record(PAYMENTS_FILE, &new_payment, sizeof(Payment));
+    text_file_t files[2];
+    memset(files, 0, sizeof(files));
+    legacy_list_t list = {0};
+    int rc = -1;
+    if (read_legacy_file(&files[0], PAYMENTS_FILE, PAYMENT_FEE, &list) == 0 &&
+        read_legacy_file(&files[1], FINES_FILE, PAYMENT_FINE, &list) == 0)
+    {
+        qsort(list.entries, list.count, sizeof(*list.entries), compare_legacy);
+        rc = write_new_ledger(&list);
+    }
+    free(list.entries);
+    text_file_close(&files[0]);
+    text_file_close(&files[1]);
+    return rc;
 }
 
-static int match_by_member(const void *record, const void *criteria)
+int payment_ledger_load(void)
 {
-    const Payment *payment = (const Payment *)record;
-    const int *memberid = (const int *)criteria;
-    return payment->memberid == *memberid;
+    FILE *file = fopen(PAYMENT_LEDGER_FILE, "r+b");
+    int rc;
+    if (file == NULL)
+    {
+        rc = import_legacy();
+    }
+    else
+    {
+        rc = read_ledger(file);
+        fclose(file);
+    }
+    if (rc < 0)
+    {
+        return -1;
+    }
+    ledger_fd = open(PAYMENT_LEDGER_FILE, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (ledger_fd < 0)
+    {
+        perror("Error opening payments ledger for appending");
+        return -1;
+    }
+    return 0;
 }
 
-int payment_find_by_member(int memberid, const char *type, Payment *payments, int max_payments)
+int payment_ledger_append(const void *records, size_t len)
 {
-    // This function assumes `type` is ignored for now and finds all payments for the member.
-    // To filter by type, you would need a more complex matching function.
-    return find_records(PAYMENTS_FILE, payments, max_payments, sizeof(Payment),
-                        match_by_member, &memberid);
+    // O_APPEND writes to a regular file are not interleaved with others,
+    // but may in theory come up short; finish the rest in order.
+    const char *next = records;
+    while (len > 0)
+    {
+        ssize_t n = write(ledger_fd, next, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error appending to payments ledger");
+            return -1;
+        }
+        next += n;
+        len -= n;
+    }
+    return 0;
 }
 
-Payment *payment_find_last_paid(int member_id, const char *type)
+int payment_ledger_sync(void)
 {
-    // Placeholder function. The implementation would need to iterate through
-    // payments for the member and find the most recent one of the specified type.
-    return NULL;
+    int rc = fdatasync(ledger_fd);
+    if (rc < 0)
+    {
+        perror("Error syncing payments ledger");
+    }
+    return rc;
 }
\ No newline at end of file
@@ -1,19 +1,58 @@
 #ifndef PAYMENT_H
 #define PAYMENT_H
 
-#include <time.h>
-#include "types.h"
+#include <stdint.h>
+#include <stddef.h>
 
-// Creates a new Payment structure.
-Payment payment_new(int id, int memberid, double amount, const char *type, time_t txtime, int fineid);
+// Every fee and fine collected, in one ledger file of fixed-size records
+// that are only ever appended. The records are also kept in a table in the
+// shared arena, each linked to the member's previous one, and the member's
+// account_ledger_t row (storage.h) holds the totals and the newest record
+// of each type. A balance is then one row read, and a member's history
+// walks only that member's records.
+#define PAYMENT_LEDGER_FILE "payments.db"
 
-// Adds a new payment record to the file.
-int payment_add_new(const Payment *payment);
+// Payment types. PAYMENT_ANY only selects, for the lookups below.
+#define PAYMENT_FEE 0
+#define PAYMENT_FINE 1
+#define PAYMENT_ANY -1
 
-// Finds all payment records for a specific member.
-int payment_find_by_member(int memberid, const char *type, Payment *payments, int max_payments);
+// As stored in the file, in host byte order.
+typedef struct
+{
+    int32_t id;       // place in the ledger, from 0
+    int32_t memberid; // the member's account row
+    int32_t amount;
+    int32_t type; // PAYMENT_FEE or PAYMENT_FINE
+    int64_t txtime;
+} Payment;
 
-// Finds the last payment made by a member of a specific type.
-Payment *payment_find_last_paid(int member_id, const char *type);
+// Allocates the ledger table from the shared arena. Call before loading.
+int payment_ledger_init(void);
 
-#endif
\ No newline at end of file
+// Reads the ledger file into the table and the account totals; call once
+// the accounts are loaded. Without a ledger file, payments.txt and
+// fines.txt are imported into a new one. Returns -1 if the ledger cannot
+// be read or written.
+int payment_ledger_load(void);
+
+// Appends whole records to the ledger file with one write. The caller
+// holds the accounts write lock. Returns -1 on a write error.
+int payment_ledger_append(const void *records, size_t len);
+
+// Makes the appended records durable. Returns -1 on error.
+int payment_ledger_sync(void);
+
+// Records a payment made now and fills in *payment for the caller to
+// append to the file. The caller holds the accounts write lock. Returns
+// -1 if the arena is out of memory.
+int payment_add(int memberid, int amount, int type, Payment *payment);
+
+// Copies up to max_payments of a member's records of the given type,
+// newest first, and returns how many.
+int payment_find_by_member(int memberid, int type, Payment *payments, int max_payments);
+
+// The member's newest record of the given type, or NULL.
+const Payment *payment_find_last_paid(int memberid, int type);
+
+#endif // PAYMENT_H
\ No newline at end of file
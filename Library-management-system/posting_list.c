@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "posting_list.h"
+#include "shared_mem.h"
+
+#define MIN_POSTINGS 4
+
+// Binary search for row in rows[low, high).
+static int lower_bound(const int *rows, int low, int high, int row)
+{
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (rows[mid] < row)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int posting_list_seek(const posting_list_t *list, int from, int row)
+{
+    int step = 1;
+    int high = from;
+    while (high < list->count && list->rows[high] < row)
+    {
+        from = high + 1;
+        high += step;
+        step *= 2;
+    }
+    return lower_bound(list->rows, from, high < list->count ? high : list->count, row);
+}
+
+static int **free_head(posting_pool_t *pool, int cap)
+{
+    return &pool->free[__builtin_ctz(cap / MIN_POSTINGS)];
+}
+
+// An array of cap rows from the pool, or a new one from the arena.
+static int *take_array(posting_pool_t *pool, int cap)
+{
+    int **head = free_head(pool, cap);
+    int *rows = *head;
+    if (rows == NULL)
+    {
+        return shared_alloc(cap * sizeof(int));
+    }
+    memcpy(head, rows, sizeof(*head));
+    return rows;
+}
+
+static void give_back(posting_pool_t *pool, int *rows, int cap)
+{
+    int **head = free_head(pool, cap);
+    memcpy(rows, head, sizeof(*head));
+    *head = rows;
+}
+
+int posting_list_add(posting_pool_t *pool, posting_list_t *list, int row)
+{
+    if (list->count == list->cap)
+    {
+        int cap = list->cap ? list->cap * 2 : MIN_POSTINGS;
+        int *rows = take_array(pool, cap);
+        if (rows == NULL)
+        {
+            return -1;
+        }
+        if (list->rows != NULL)
+        {
+            memcpy(rows, list->rows, list->count * sizeof(int));
+            give_back(pool, list->rows, list->cap);
+        }
+        list->rows = rows;
+        list->cap = cap;
+    }
+    int at = list->count;
+    if (at > 0 && list->rows[at - 1] > row)
+    {
+        at = lower_bound(list->rows, 0, list->count, row);
+        memmove(&list->rows[at + 1], &list->rows[at], (list->count - at) * sizeof(int));
+    }
+    list->rows[at] = row;
+    list->count++;
+    return 0;
+}
+
+void posting_list_remove(posting_pool_t *pool, posting_list_t *list, int row)
+{
+    int at = lower_bound(list->rows, 0, list->count, row);
+    if (at < list->count && list->rows[at] == row)
+    {
+        memmove(&list->rows[at], &list->rows[at + 1], (list->count - at - 1) * sizeof(int));
+        list->count--;
+        if (list->count == 0)
+        {
+            give_back(pool, list->rows, list->cap);
+            list->rows = NULL;
+            list->cap = 0;
+        }
+    }
+}
\ No newline at end of file
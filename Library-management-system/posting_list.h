@@ -0,0 +1,37 @@
+#ifndef POSTING_LIST_H
+#define POSTING_LIST_H
+
+// A sorted array of row numbers, for a secondary index that maps one key
+// to many rows. The array lives in the shared arena and doubles when
+// full. The arena never frees, so the old one goes to a pool, where the
+// next list to grow to that size takes it; so does the array of a list
+// left empty. Adding a row past the last is an append, anything else
+// moves the rows after it.
+typedef struct
+{
+    int *rows;
+    int count;
+    int cap;
+} posting_list_t;
+
+#define POSTING_SIZE_CLASSES 30 // capacities 4 to 2^31
+
+// Arrays given up by growing lists, by capacity. A zeroed pool is empty.
+// Lists that share a pool share a lock.
+typedef struct
+{
+    int *free[POSTING_SIZE_CLASSES]; // each array links to the next through its first bytes
+} posting_pool_t;
+
+// Returns -1 if the arena is out of memory.
+int posting_list_add(posting_pool_t *pool, posting_list_t *list, int row);
+
+void posting_list_remove(posting_pool_t *pool, posting_list_t *list, int row);
+
+// Index of the first row not below row, looking from index from on. It
+// gallops, so stepping through a long list in order costs time in the
+// steps taken rather than in the length of the list. Returns count if
+// there is none.
+int posting_list_seek(const posting_list_t *list, int from, int row);
+
+#endif // POSTING_LIST_H
\ No newline at end of file
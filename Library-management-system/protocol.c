@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+void frame_put_header(unsigned char *header, uint32_t body_len)
+{
+    header[0] = (body_len >> 24) & 0xff;
+    header[1] = (body_len >> 16) & 0xff;
+    header[2] = (body_len >> 8) & 0xff;
+    header[3] = body_len & 0xff;
+}
+
+uint32_t frame_get_header(const unsigned char *header)
+{
+    return ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) |
+           ((uint32_t)header[2] << 8) | (uint32_t)header[3];
+}
+
+int frame_append_request(char **buf, size_t *len, size_t *cap,
+                         const char *command, const char *payload)
+{
+    size_t command_len = strlen(command);
+    size_t payload_len = strlen(payload);
+    size_t body_len = command_len + 1 + payload_len;
+    size_t needed = *len + FRAME_HEADER_LEN + body_len;
+
+    if (needed > *cap)
+    {
+        size_t new_cap = *cap ? *cap : 1024;
+        while (new_cap < needed)
+        {
+            new_cap *= 2;
+        }
+        char *new_buf = realloc(*buf, new_cap);
+        if (new_buf == NULL)
+        {
+            return -1;
+        }
+        *buf = new_buf;
+        *cap = new_cap;
+    }
+
+    char *p = *buf + *len;
+    frame_put_header((unsigned char *)p, body_len);
+    p += FRAME_HEADER_LEN;
+    memcpy(p, command, command_len);
+    p[command_len] = '|';
+    memcpy(p + command_len + 1, payload, payload_len);
+    *len = needed;
+    return 0;
+}
+
+// Returns 1 when len bytes were read, 0 on orderly close, -1 on error.
+static int recv_all(int sock, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = recv(sock, data, len, 0);
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+long frame_recv(int sock, char *body, size_t size)
+{
+    unsigned char header[FRAME_HEADER_LEN];
+    int rc = recv_all(sock, (char *)header, sizeof(header));
+    if (rc <= 0)
+    {
+        return rc;
+    }
+    uint32_t body_len = frame_get_header(header);
+    size_t keep = body_len < size - 1 ? body_len : size - 1;
+    rc = recv_all(sock, body, keep);
+    if (rc <= 0)
+    {
+        return rc < 0 ? -1 : 0;
+    }
+    body[keep] = '\0';
+
+    char discard[512];
+    size_t rest = body_len - keep;
+    while (rest > 0)
+    {
+        size_t chunk = rest < sizeof(discard) ? rest : sizeof(discard);
+        rc = recv_all(sock, discard, chunk);
+        if (rc <= 0)
+        {
+            return rc < 0 ? -1 : 0;
+        }
+        rest -= chunk;
+    }
+    return body_len;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every request and response on the wire is one frame: a 4-byte big-endian
+// body length followed by the body. A request body is "COMMAND|payload",
+// a response body is the "Success: ..." / "Error: ..." text. Frames may be
+// pipelined; the server answers them strictly in order.
+#define FRAME_HEADER_LEN 4
+#define MAX_FRAME_LEN (1024 * 1024)
+
+void frame_put_header(unsigned char *header, uint32_t body_len);
+uint32_t frame_get_header(const unsigned char *header);
+
+// Appends one framed request to buf (grown with realloc as needed).
+// Returns 0 on success, -1 on allocation failure.
+int frame_append_request(char **buf, size_t *len, size_t *cap,
+                         const char *command, const char *payload);
+
+// Blocking read of one frame for clients. The body is NUL-terminated in
+// body; bodies longer than size - 1 are truncated and the rest discarded.
+// Returns the full body length, 0 on orderly close or -1 on error.
+long frame_recv(int sock, char *body, size_t size);
+
+#endif // PROTOCOL_H
\ No newline at end of file
@@ -0,0 +1,892 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "protocol.h"
+#include "wal.h"
+
+// Kills the server with SIGKILL at the points where a restart has to skip
+// or repair something, restarts it, and compares what it serves with what
+// it served before. Each case runs the server in a scratch copy of the
+// data files:
+//
+// - acknowledged writes: with -f always, sign-ups and borrows are
+//   pipelined and the server is killed partway through the replies. Every
+//   write answered must be back after the restart, the writes that are
+//   back must be the first ones sent, and the book's copies and holders
+//   must still add up to the copies it started with.
+// - torn record: the log is cut in the middle of its last record. The
+//   restart must come back without that write, cut the segment back to
+//   the last whole record, and append after it.
+// - snapshot window: the segments a snapshot has just replaced are put
+//   back, as if the crash came between the snapshot's rename and their
+//   deletion. The restart must not replay them over the snapshot.
+//
+// The tables are compared through VIEW_USERS, PAYMENTS, LIST_BOOKS and
+// TITLE_HOLDERS. A kill leaves the page cache alone, so this checks what
+// the server had written when it answered, not what reached the disk.
+// Exits non-zero on failure.
+
+#define BURST 500          // sign-ups, each followed by a borrow, per kill
+#define HELD_COPIES 1000   // copies of the book the burst borrows
+#define BOOKS 8            // books the random writes borrow and return
+#define BOOK_COPIES 20
+#define MAX_READERS 2000
+#define MAX_LOANS 4096
+#define READY_TRIES 200    // 50 ms apart
+
+static const char *server = "./server";
+static const char *data_dir = ".";
+static const char *email = "varad@gmail.com";
+static const char *password = "2002";
+static char **server_args; // after --, given to every run
+static int server_arg_count;
+static int port = SERV_PORT;
+
+static char scratch[32];
+static char body[MAX_FRAME_LEN];
+static unsigned seed = 1;
+static int failures;
+
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+} text_t;
+
+static void fail(const char *what)
+{
+    failures++;
+    printf("FAIL: %s\n", what);
+}
+
+static void text_append(text_t *text, const char *data, size_t len)
+{
+    if (text->len + len + 1 > text->cap)
+    {
+        size_t cap = text->cap ? text->cap : 4096;
+        while (text->len + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+        text->buf = realloc(text->buf, cap);
+        if (text->buf == NULL)
+        {
+            perror("Out of memory");
+            exit(EXIT_FAILURE);
+        }
+        text->cap = cap;
+    }
+    memcpy(text->buf + text->len, data, len);
+    text->len += len;
+    text->buf[text->len] = '\0';
+}
+
+static int connect_server(void)
+{
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || inet_pton(AF_INET, SERV_ADDR, &address.sin_addr) != 1 ||
+        connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        if (sock >= 0)
+        {
+            close(sock);
+        }
+        return -1;
+    }
+    struct timeval timeout = {.tv_sec = 30};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+static int send_all(int sock, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Sends one request and reads its reply into body. Exits if the server
+// has gone away, since nothing after that can be checked.
+static const char *request(int sock, const char *command, const char *payload)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    if (frame_append_request(&buf, &len, &cap, command, payload) < 0 || send_all(sock, buf, len) < 0 ||
+        frame_recv(sock, body, sizeof(body)) <= 0)
+    {
+        printf("FAIL: no reply to %s; see %s/server.log\n", command, scratch);
+        exit(EXIT_FAILURE);
+    }
+    free(buf);
+    return body;
+}
+
+static int succeeded(const char *reply)
+{
+    return strncmp(reply, "Success", 7) == 0;
+}
+
+static void path_in_scratch(char *path, size_t size, const char *name)
+{
+    snprintf(path, size, "%s/%s", scratch, name);
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    int out = in < 0 ? -1 : open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    char buf[65536];
+    ssize_t n = -1;
+    while (out >= 0 && (n = read(in, buf, sizeof(buf))) > 0)
+    {
+        if (write(out, buf, n) != n)
+        {
+            n = -1;
+            break;
+        }
+    }
+    if (in >= 0)
+    {
+        close(in);
+    }
+    if (out >= 0)
+    {
+        close(out);
+    }
+    if (n < 0)
+    {
+        fprintf(stderr, "Could not copy %s to %s: %s\n", from, to, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// A new scratch directory holding the text data files and nothing else.
+static int make_scratch(void)
+{
+    strcpy(scratch, "/tmp/restart_testXXXXXX");
+    DIR *dir = opendir(data_dir);
+    if (mkdtemp(scratch) == NULL || dir == NULL)
+    {
+        perror("Could not set up a scratch directory");
+        if (dir)
+        {
+            closedir(dir);
+        }
+        return -1;
+    }
+    struct dirent *entry;
+    int rc = 0;
+    while (rc == 0 && (entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".txt") == 0)
+        {
+            char from[PATH_MAX];
+            char to[PATH_MAX];
+            snprintf(from, sizeof(from), "%s/%s", data_dir, entry->d_name);
+            path_in_scratch(to, sizeof(to), entry->d_name);
+            rc = copy_file(from, to);
+        }
+    }
+    closedir(dir);
+    return rc;
+}
+
+static void remove_scratch(void)
+{
+    DIR *dir = opendir(scratch);
+    if (dir == NULL)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            char path[PATH_MAX];
+            path_in_scratch(path, sizeof(path), entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(scratch);
+}
+
+// Waits for the port to be free of an earlier run, including the
+// processes a -p run forked.
+static int wait_port_free(void)
+{
+    for (int i = 0; i < READY_TRIES; i++)
+    {
+        int sock = connect_server();
+        if (sock < 0)
+        {
+            return 0;
+        }
+        close(sock);
+        usleep(50000);
+    }
+    fprintf(stderr, "Something is still serving port %d.\n", port);
+    return -1;
+}
+
+// Starts the server in the scratch directory, in a process group of its
+// own so that a kill takes any processes it forks too. Returns its pid
+// and a signed-in connection in *sock, or -1.
+static pid_t start_server(const char *const options[], int *sock)
+{
+    char path[PATH_MAX];
+    if (wait_port_free() < 0 || realpath(server, path) == NULL)
+    {
+        fprintf(stderr, "Cannot run %s.\n", server);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        char log_path[PATH_MAX];
+        path_in_scratch(log_path, sizeof(log_path), "server.log");
+        int log = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        const char *argv[64];
+        int argc = 0;
+        argv[argc++] = path;
+        for (int i = 0; i < server_arg_count && argc < 50; i++)
+        {
+            argv[argc++] = server_args[i];
+        }
+        for (int i = 0; options[i] && argc < 63; i++)
+        {
+            argv[argc++] = options[i];
+        }
+        argv[argc] = NULL;
+        setpgid(0, 0);
+        if (log < 0 || chdir(scratch) < 0 || dup2(log, STDOUT_FILENO) < 0 || dup2(log, STDERR_FILENO) < 0)
+        {
+            _exit(127);
+        }
+        execv(path, (char **)argv);
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        perror("fork failed");
+        return -1;
+    }
+    for (int i = 0; i < READY_TRIES; i++)
+    {
+        *sock = connect_server();
+        if (*sock >= 0)
+        {
+            char credentials[256];
+            snprintf(credentials, sizeof(credentials), "%s|%s", email, password);
+            if (!succeeded(request(*sock, "SIGN_IN", credentials)))
+            {
+                fprintf(stderr, "Sign-in as %s refused.\n", email);
+                close(*sock);
+                break;
+            }
+            return pid;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            printf("FAIL: the server did not start; see %s/server.log\n", scratch);
+            return -1;
+        }
+        usleep(50000);
+    }
+    kill(-pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void kill_server(pid_t pid, int sock)
+{
+    kill(-pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(sock);
+}
+
+// The highest-numbered log segment, or 0 if there is none.
+static unsigned last_segment(void)
+{
+    DIR *dir = opendir(scratch);
+    unsigned last = 0;
+    struct dirent *entry;
+    size_t prefix = strlen(WAL_FILE ".");
+    while (dir && (entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        if (strncmp(entry->d_name, WAL_FILE ".", prefix) == 0)
+        {
+            unsigned long seq = strtoul(entry->d_name + prefix, &end, 10);
+            if (*end == '\0' && seq > last)
+            {
+                last = seq;
+            }
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    return last;
+}
+
+static void segment_in_scratch(char *path, size_t size, unsigned seq)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s.%u", WAL_FILE, seq);
+    path_in_scratch(path, size, name);
+}
+
+static int segment_exists(unsigned seq)
+{
+    char path[PATH_MAX];
+    segment_in_scratch(path, sizeof(path), seq);
+    return access(path, F_OK) == 0;
+}
+
+static off_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Appends every page of a paged listing (VIEW_USERS, LIST_BOOKS), with
+// the cursor lines left out. format has a %d for the cursor.
+static void dump_pages(int sock, const char *command, const char *format, text_t *out)
+{
+    int cursor = 0;
+    while (1)
+    {
+        char payload[64];
+        snprintf(payload, sizeof(payload), format, cursor);
+        const char *reply = request(sock, command, payload);
+        const char *next = strstr(reply, "Next cursor: ");
+        text_append(out, reply, next ? (size_t)(next - reply) : strlen(reply));
+        if (next == NULL)
+        {
+            return;
+        }
+        cursor = atoi(next + strlen("Next cursor: "));
+    }
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Appends what is after the first line of a reply, one line per entry,
+// in sorted order: a title's holders come in list order, and a borrowing
+// replayed into a reused row can stand elsewhere in the list.
+static void append_sorted(text_t *out, char *reply)
+{
+    char *lines[MAX_LOANS];
+    int count = 0;
+    char *line = strchr(reply, '\n');
+    while (line && line[1] && count < MAX_LOANS)
+    {
+        lines[count++] = ++line;
+        line = strchr(line, '\n');
+        if (line)
+        {
+            *line = '\0';
+        }
+    }
+    qsort(lines, count, sizeof(*lines), compare_lines);
+    for (int i = 0; i < count; i++)
+    {
+        text_append(out, lines[i], strlen(lines[i]));
+        text_append(out, "\n", 1);
+    }
+}
+
+// Everything the tables hold, as the server lists it.
+static void dump_tables(int sock, text_t *out)
+{
+    out->len = 0;
+    text_t users = {0};
+    text_t books = {0};
+    dump_pages(sock, "VIEW_USERS", "500|%d", &users);
+    text_append(out, users.buf, users.len);
+    // Each account's payment totals and newest records.
+    for (char *line = strtok(users.buf, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        char *account = strchr(line, '|');
+        char *end = account ? strchr(account + 1, '|') : NULL;
+        if (end)
+        {
+            char payload[128];
+            snprintf(payload, sizeof(payload), "%.*s|5", (int)(end - account - 1), account + 1);
+            text_append(out, payload, strlen(payload));
+            text_append(out, ": ", 2);
+            const char *reply = request(sock, "PAYMENTS", payload);
+            text_append(out, reply, strlen(reply));
+        }
+    }
+    dump_pages(sock, "LIST_BOOKS", "|||500|%d", &books);
+    text_append(out, books.buf, books.len);
+    for (char *line = strtok(books.buf, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        char *end = strchr(line, '|');
+        if (end)
+        {
+            *end = '\0';
+            char *reply = (char *)request(sock, "TITLE_HOLDERS", line);
+            text_append(out, reply, strcspn(reply, "\n") + 1);
+            append_sorted(out, reply);
+        }
+    }
+    free(users.buf);
+    free(books.buf);
+}
+
+static void compare_tables(const char *what, const text_t *before, const text_t *after)
+{
+    if (before->len == after->len && memcmp(before->buf, after->buf, before->len) == 0)
+    {
+        printf("ok: %s: the tables match\n", what);
+        return;
+    }
+    size_t at = 0;
+    while (at < before->len && at < after->len && before->buf[at] == after->buf[at])
+    {
+        at++;
+    }
+    while (at > 0 && before->buf[at - 1] != '\n')
+    {
+        at--;
+    }
+    printf("FAIL: %s: the tables differ after the restart\n  before: %.*s\n  after:  %.*s\n", what,
+           (int)strcspn(before->buf + at, "\n"), before->buf + at, (int)strcspn(after->buf + at, "\n"),
+           after->buf + at);
+    failures++;
+}
+
+// Readers the random writes below have signed up, and their loans.
+static char readers[MAX_READERS][64];
+static int reader_count;
+static int reader_serial;
+static struct
+{
+    int reader;
+    int book;
+} loans[MAX_LOANS];
+static int loan_count;
+
+static void new_reader_email(char *dest, size_t size)
+{
+    snprintf(dest, size, "reader%d@restart.test", reader_serial++);
+}
+
+static int add_books(int sock)
+{
+    for (int i = 0; i < BOOKS; i++)
+    {
+        char payload[128];
+        snprintf(payload, sizeof(payload), "Restart book %d|Author %d|Subject|10|%d", i, i % 3, BOOK_COPIES);
+        if (!succeeded(request(sock, "ADD_BOOK", payload)))
+        {
+            fail("ADD_BOOK refused");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Sign-ups, with and without a fee, email changes, borrows, returns and
+// payments, one at a time.
+static void random_writes(int sock, int count)
+{
+    char payload[512];
+    for (int i = 0; i < count; i++)
+    {
+        int op = rand_r(&seed) % 10;
+        int reader = reader_count ? rand_r(&seed) % reader_count : -1;
+        int book = rand_r(&seed) % BOOKS;
+        if (reader == -1 || (op < 3 && reader_count < MAX_READERS))
+        {
+            new_reader_email(readers[reader_count], sizeof(readers[0]));
+            snprintf(payload, sizeof(payload), "Reader|%s|555|pw|%d", readers[reader_count],
+                     rand_r(&seed) % 2 ? 100 : 0);
+            if (succeeded(request(sock, "SIGN_UP", payload)))
+            {
+                reader_count++;
+            }
+        }
+        else if (op < 4)
+        {
+            char renamed[64];
+            new_reader_email(renamed, sizeof(renamed));
+            snprintf(payload, sizeof(payload), "%s|Reader|%s|556|pw2", readers[reader], renamed);
+            if (succeeded(request(sock, "UPDATE_USER_INFO", payload)))
+            {
+                strcpy(readers[reader], renamed);
+            }
+        }
+        else if (op < 7 && loan_count < MAX_LOANS)
+        {
+            snprintf(payload, sizeof(payload), "%s|Restart book %d", readers[reader], book);
+            if (succeeded(request(sock, "BORROW_BOOK", payload)))
+            {
+                loans[loan_count].reader = reader;
+                loans[loan_count].book = book;
+                loan_count++;
+            }
+        }
+        else if (op < 9 && loan_count > 0)
+        {
+            int loan = rand_r(&seed) % loan_count;
+            snprintf(payload, sizeof(payload), "%s|Restart book %d", readers[loans[loan].reader], loans[loan].book);
+            request(sock, "RETURN_BOOK", payload);
+            loans[loan] = loans[--loan_count];
+        }
+        else
+        {
+            snprintf(payload, sizeof(payload), "%s|%d", readers[reader], 1 + rand_r(&seed) % 50);
+            request(sock, "COLLECT_PAYMENT", payload);
+        }
+    }
+}
+
+static void reset_readers(void)
+{
+    reader_count = 0;
+    loan_count = 0;
+}
+
+// Pipelines sign-ups and borrows and kills the server after a share of
+// the replies, three times over.
+static int case_acknowledged(void)
+{
+    static const char *const options[] = {"-f", "always", "-k", "0", NULL};
+    static char sent[BURST][64]; // the reader each sign-up and borrow is for
+    static int acked[2 * BURST];
+    int sock;
+    pid_t pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    char payload[256];
+    snprintf(payload, sizeof(payload), "Held book|Author|Subject|10|%d", HELD_COPIES);
+    if (!succeeded(request(sock, "ADD_BOOK", payload)))
+    {
+        fail("ADD_BOOK refused");
+    }
+    for (int round = 1; round <= 3; round++)
+    {
+        char *frames = NULL;
+        size_t len = 0;
+        size_t cap = 0;
+        for (int i = 0; i < BURST; i++)
+        {
+            char reader[64];
+            new_reader_email(reader, sizeof(reader));
+            strcpy(sent[i], reader);
+            snprintf(payload, sizeof(payload), "Reader|%s|555|pw|0", reader);
+            frame_append_request(&frames, &len, &cap, "SIGN_UP", payload);
+            snprintf(payload, sizeof(payload), "%s|Held book", reader);
+            frame_append_request(&frames, &len, &cap, "BORROW_BOOK", payload);
+        }
+        if (frames == NULL || send_all(sock, frames, len) < 0)
+        {
+            fail("could not send the burst");
+            free(frames);
+            kill_server(pid, sock);
+            return -1;
+        }
+        free(frames);
+        int stop = 2 * BURST * round / 4;
+        memset(acked, 0, sizeof(acked));
+        for (int i = 0; i < stop; i++)
+        {
+            if (frame_recv(sock, body, sizeof(body)) <= 0)
+            {
+                fail("the burst was not answered");
+                break;
+            }
+            acked[i] = succeeded(body);
+        }
+        kill_server(pid, sock);
+        pid = start_server(options, &sock);
+        if (pid < 0)
+        {
+            return -1;
+        }
+        text_t users = {0};
+        dump_pages(sock, "VIEW_USERS", "500|%d", &users);
+        char *holders = strdup(request(sock, "TITLE_HOLDERS", "Held book"));
+        int copies = -1;
+        sscanf(request(sock, "CHECK_COPIES", "Held book"), "Success: 'Held book' has %d copies", &copies);
+        int held = 0;
+        for (char *line = strchr(holders, '\n'); line && line[1]; line = strchr(line + 1, '\n'))
+        {
+            held++;
+        }
+        int back = 0;
+        int lost = 0;
+        int gap = 0;
+        for (int i = 0; i < 2 * BURST; i++)
+        {
+            char needle[80];
+            snprintf(needle, sizeof(needle), i % 2 ? "\n%s|" : "|%s|", sent[i / 2]);
+            int present = strstr(i % 2 ? holders : users.buf, needle) != NULL;
+            lost += acked[i] && !present;
+            gap |= present && back < i;
+            back += present;
+        }
+        if (lost > 0)
+        {
+            printf("FAIL: round %d: %d acknowledged writes lost\n", round, lost);
+            failures++;
+        }
+        if (gap)
+        {
+            printf("FAIL: round %d: writes came back with earlier ones missing\n", round);
+            failures++;
+        }
+        if (copies + held != HELD_COPIES)
+        {
+            printf("FAIL: round %d: %d copies and %d holders of %d\n", round, copies, held, HELD_COPIES);
+            failures++;
+        }
+        if (lost == 0 && !gap && copies + held == HELD_COPIES)
+        {
+            printf("ok: acknowledged writes: killed after %d of %d replies, %d writes back\n", stop, 2 * BURST,
+                   back);
+        }
+        free(users.buf);
+        free(holders);
+    }
+    kill_server(pid, sock);
+    return 0;
+}
+
+// Cuts the last log record in half while the server is down.
+static int case_torn_record(void)
+{
+    static const char *const options[] = {"-k", "0", NULL};
+    text_t before = {0};
+    text_t after = {0};
+    int sock;
+    pid_t pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    if (add_books(sock) < 0)
+    {
+        kill_server(pid, sock);
+        return -1;
+    }
+    random_writes(sock, 400);
+    dump_tables(sock, &before);
+    char segment[PATH_MAX];
+    segment_in_scratch(segment, sizeof(segment), last_segment());
+    off_t whole = file_size(segment);
+    char payload[256];
+    char torn_email[64];
+    new_reader_email(torn_email, sizeof(torn_email));
+    snprintf(payload, sizeof(payload), "Reader|%s|555|pw|0", torn_email);
+    request(sock, "SIGN_UP", payload);
+    off_t grown = file_size(segment);
+    kill_server(pid, sock);
+    if (whole < 0 || grown <= whole || truncate(segment, whole + (grown - whole) / 2) < 0)
+    {
+        fail("torn record: the sign-up did not go to the last segment");
+        return -1;
+    }
+    pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    dump_tables(sock, &after);
+    compare_tables("torn record", &before, &after);
+    if (file_size(segment) != whole)
+    {
+        printf("FAIL: torn record: the segment is %lld bytes, not cut back to %lld\n",
+               (long long)file_size(segment), (long long)whole);
+        failures++;
+    }
+    random_writes(sock, 100);
+    dump_tables(sock, &before);
+    kill_server(pid, sock);
+    pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    dump_tables(sock, &after);
+    compare_tables("writes after the cut", &before, &after);
+    kill_server(pid, sock);
+    free(before.buf);
+    free(after.buf);
+    return 0;
+}
+
+// Keeps copies of the segments, waits for a snapshot to delete them, and
+// puts them back after the kill.
+static int case_snapshot_window(void)
+{
+    static const char *const options[] = {"-k", "1", NULL};
+    text_t before = {0};
+    text_t after = {0};
+    int sock;
+    pid_t pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    if (add_books(sock) < 0)
+    {
+        kill_server(pid, sock);
+        return -1;
+    }
+    random_writes(sock, 400);
+    unsigned last = last_segment();
+    unsigned first = last;
+    char segment[PATH_MAX];
+    char saved[PATH_MAX + 8];
+    if (last == 0)
+    {
+        fail("snapshot window: nothing was logged");
+        kill_server(pid, sock);
+        return -1;
+    }
+    while (first > 1 && segment_exists(first - 1))
+    {
+        first--;
+    }
+    for (unsigned seq = first; seq <= last; seq++)
+    {
+        segment_in_scratch(segment, sizeof(segment), seq);
+        snprintf(saved, sizeof(saved), "%s.saved", segment);
+        if (copy_file(segment, saved) < 0)
+        {
+            kill_server(pid, sock);
+            return -1;
+        }
+    }
+    for (int i = 0; i < READY_TRIES && segment_exists(first); i++)
+    {
+        usleep(50000);
+    }
+    if (segment_exists(first))
+    {
+        fail("snapshot window: no snapshot deleted the log segments");
+        kill_server(pid, sock);
+        return -1;
+    }
+    random_writes(sock, 200);
+    dump_tables(sock, &before);
+    kill_server(pid, sock);
+    int restored = 0;
+    for (unsigned seq = first; seq <= last; seq++)
+    {
+        segment_in_scratch(segment, sizeof(segment), seq);
+        snprintf(saved, sizeof(saved), "%s.saved", segment);
+        if (!segment_exists(seq) && rename(saved, segment) == 0)
+        {
+            restored++;
+        }
+    }
+    pid = start_server(options, &sock);
+    if (pid < 0)
+    {
+        return -1;
+    }
+    dump_tables(sock, &after);
+    char what[64];
+    snprintf(what, sizeof(what), "snapshot window with %d segments put back", restored);
+    compare_tables(what, &before, &after);
+    kill_server(pid, sock);
+    free(before.buf);
+    free(after.buf);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:e:w:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            server = optarg;
+            break;
+        case 'd':
+            data_dir = optarg;
+            break;
+        case 'e':
+            email = optarg;
+            break;
+        case 'w':
+            password = optarg;
+            break;
+        case 'r':
+            seed = (unsigned)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s server] [-d data dir] [-e email] [-w password] [-r seed] "
+                            "[-- server options]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    server_args = argv + optind;
+    server_arg_count = argc - optind;
+    int (*cases[])(void) = {case_acknowledged, case_torn_record, case_snapshot_window};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        reset_readers();
+        if (make_scratch() < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        int before = failures;
+        if (cases[i]() < 0 && failures == before)
+        {
+            failures++;
+        }
+        if (failures == before)
+        {
+            remove_scratch();
+        }
+        else
+        {
+            printf("Left the files of the failed case in %s.\n", scratch);
+        }
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
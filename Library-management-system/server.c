@@ -4,1270 +4,931 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <stdbool.h>
 #include <time.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include "types.h"
 #include "config.h"
 #include "book.h"
-
-#define MEMBER_FILE "members.txt"
-#define USERS_FILE "users.txt"
-#define PAYMENTS_FILE "payments.txt"
-#define FINES_FILE "fines.txt"
-#define BORROWINGS_FILE "borrowings.txt"
-#define MAX_ACCOUNTS 200
-#define MAX_BOOKS 100
-
-account_t accounts[MAX_ACCOUNTS];
-int account_count = 0;
-book_t books[MAX_BOOKS];
-int book_count = 0;
-
-void load_accounts_from_file();
-void save_user_to_file(const user_t *new_user);
-void save_member_to_file(const member_t *new_member);
-void save_payment_to_file(const char *email, int amount);
-void save_fine_to_file(const char *email, int amount);
-void load_books_from_file();
-
-void handle_client_session(int client_sock);
-void handle_sign_in(const char *payload, char *response, int *logged_in_type, char *logged_in_email);
-void handle_sign_up(const char *payload, char *response);
-void handle_add_book(const char *payload, char *response);
-void handle_remove_book(const char *payload, char *response);
-void handle_update_my_info(const char *payload, char *response, const char *logged_in_email);
-void handle_update_book(const char *payload, char *response);
-void handle_check_copies(const char *payload, char *response);
-void handle_collect_payment(const char *payload, char *response);
-void handle_collect_fine(const char *payload, char *response);
-void handle_view_users(char *response);
-void handle_delete_user(const char *payload, char *response);
-void handle_update_user_info(const char *payload, char *response);
-void handle_borrow_book(const char *payload, char *response, const char *logged_in_email);
-void handle_return_book(const char *payload, char *response);
-
-int find_account_by_email(const char *email, int *account_type)
+#include "session.h"
+#include "command.h"
+#include "event_loop.h"
+#include "uring_loop.h"
+#include "storage.h"
+#include "shared_mem.h"
+#include "locks.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "commit.h"
+#include "overdue.h"
+#include "book_columns.h"
+#include "session_tokens.h"
+#include "payment.h"
+
+void handle_sign_up(client_session_t *session, const sign_up_args_t *args, reply_t *reply)
 {
-    for (int i = 0; i < account_count; i++)
+    int existing_account_type;
+    if (find_account_by_email(args->email, &existing_account_type) != -1)
     {
-        if (accounts[i].type == 0)
-        {
-            if (strcmp(accounts[i].data.member.email, email) == 0)
-            {
-                *account_type = 0;
-                return i;
-            }
-        }
-        else
-        {
-            if (strcmp(accounts[i].data.user.email, email) == 0)
-            {
-                *account_type = 1;
-                return i;
-            }
-        }
+        reply_set(reply, "Error: Email already exists.");
+        return;
     }
-    *account_type = -1;
-    return -1;
-}
-
-int find_book_by_title(const char *title)
-{
-    for (int i = 0; i < book_count; i++)
+    user_t new_user = {0};
+    strcpy(new_user.name, args->name);
+    strcpy(new_user.email, args->email);
+    strcpy(new_user.phone, args->phone);
+    strcpy(new_user.password, args->password);
+    new_user.payment_due = (args->payment > 0) ? 0 : 1;
+    new_user.fines_due = 0;
+    account_t account = {.type = 1, .data.user = new_user};
+    if (add_account(&account) < 0)
     {
-        if (strcmp(books[i].title, title) == 0)
-        {
-            return i;
-        }
+        reply_set(reply, "Error: Maximum accounts reached.");
+        return;
     }
-    return -1;
+    log_user_put(NULL, &new_user);
+    if (args->payment > 0)
+    {
+        save_payment_to_file(new_user.email, args->payment);
+    }
+    printf("New user signed up: %s, %s\n", args->name, args->email);
+    reply_set(reply, "Success: Sign-up successful.");
 }
 
-void load_accounts_from_file()
+// Drops the token the session holds, if any.
+static void end_token(client_session_t *session)
 {
-    FILE *member_file = fopen(MEMBER_FILE, "r");
-    if (member_file != NULL)
+    if (session->token[0] != '\0')
     {
-        char line[512];
-        while (fgets(line, sizeof(line), member_file) && account_count < MAX_ACCOUNTS)
-        {
-            accounts[account_count].type = 0;
-            sscanf(line, "%[^|]|%[^|]|%[^|]|%s",
-                   accounts[account_count].data.member.name,
-                   accounts[account_count].data.member.email,
-                   accounts[account_count].data.member.phone,
-                   accounts[account_count].data.member.password);
-            account_count++;
-        }
-        fclose(member_file);
+        session_token_revoke(session->token);
+        session->token[0] = '\0';
     }
+}
 
-    FILE *user_file = fopen(USERS_FILE, "r");
-    if (user_file != NULL)
+// A successful sign-in also issues a session token, sent back on a
+// second line; RESUME takes it on a later connection.
+void handle_sign_in(client_session_t *session, const sign_in_args_t *args, reply_t *reply)
+{
+    int account_type;
+    int account_index = find_account_by_email(args->email, &account_type);
+    if (account_index != -1)
     {
-        char line[512];
-        while (fgets(line, sizeof(line), user_file) && account_count < MAX_ACCOUNTS)
+        const account_t *account = account_at(account_index);
+        const char *password = account_type == 0 ? account->data.member.password : account->data.user.password;
+        if (strcmp(password, args->password) == 0)
         {
-            accounts[account_count].type = 1;
-            sscanf(line, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d",
-                   accounts[account_count].data.user.name,
-                   accounts[account_count].data.user.email,
-                   accounts[account_count].data.user.phone,
-                   accounts[account_count].data.user.password,
-                   &accounts[account_count].data.user.payment_due,
-                   &accounts[account_count].data.user.fines_due);
-            account_count++;
+            printf("%s signed in: %s\n", account_type == 0 ? "Member" : "User", args->email);
+            strcpy(session->logged_in_email, args->email);
+            session->logged_in_type = account_type;
+            session->signed_in = 1;
+            reply_set(reply, "Success: Sign-in successful.");
+            end_token(session);
+            if (session_token_issue(account_index, session->token) == 0)
+            {
+                reply_append(reply, "\nToken: %s", session->token);
+            }
+            return;
         }
-        fclose(user_file);
     }
-    printf("Loaded %d accounts from file.\n", account_count);
+    printf("Failed sign-in attempt for email: %s\n", args->email);
+    reply_set(reply, "Error: Invalid credentials.");
 }
 
-void load_books_from_file()
+// Signs the connection in as the account a session token belongs to.
+void handle_resume(client_session_t *session, const resume_args_t *args, reply_t *reply)
 {
-    FILE *file = fopen(BOOK_FILE, "r");
-    if (file == NULL)
+    int account_index = session_token_resume(args->token);
+    if (account_index == -1)
     {
-        printf("Book file not found. Starting with an empty book list.\n");
+        printf("Failed resume attempt\n");
+        reply_set(reply, "Error: Invalid or expired token.");
         return;
     }
-    char line[512];
-    while (fgets(line, sizeof(line), file) && book_count < MAX_BOOKS)
+    const account_t *account = account_at(account_index);
+    const char *email = account->type == 0 ? account->data.member.email : account->data.user.email;
+    printf("%s resumed: %s\n", account->type == 0 ? "Member" : "User", email);
+    if (strcmp(session->token, args->token) != 0)
     {
-        sscanf(line, "%[^|]|%[^|]|%[^|]|%d|%d",
-               books[book_count].title,
-               books[book_count].author,
-               books[book_count].subject,
-               &books[book_count].price,
-               &books[book_count].copies);
-        book_count++;
+        end_token(session);
+        strcpy(session->token, args->token);
     }
-    fclose(file);
-    printf("Loaded %d books from file.\n", book_count);
+    strcpy(session->logged_in_email, email);
+    session->logged_in_type = account->type;
+    session->signed_in = 1;
+    reply_set(reply, "Success: Session resumed.");
 }
 
-void save_user_to_file(const user_t *new_user)
+void handle_logout(client_session_t *session, const logout_args_t *args, reply_t *reply)
 {
-    FILE *file = fopen(USERS_FILE, "a");
-    if (file == NULL)
+    if (session->signed_in)
     {
-        perror("Error opening user file for writing");
-        return;
+        printf("User logged out: %s\n", session->logged_in_email);
+        session->signed_in = 0;
+        strcpy(session->logged_in_email, "");
+        end_token(session);
+        reply_set(reply, "Success: Logged out.");
     }
-    fprintf(file, "%s|%s|%s|%s|%d|%d\n",
-            new_user->name,
-            new_user->email,
-            new_user->phone,
-            new_user->password,
-            new_user->payment_due,
-            new_user->fines_due);
-    fclose(file);
-}
-
-void save_book_to_file(const book_t *new_book)
-{
-    FILE *file = fopen(BOOK_FILE, "a");
-    if (file == NULL)
+    else
     {
-        perror("Error opening book file for writing");
-        return;
+        reply_set(reply, "Error: Not signed in.");
     }
-    fprintf(file, "%s|%s|%s|%d|%d\n",
-            new_book->title,
-            new_book->author,
-            new_book->subject,
-            new_book->price,
-            new_book->copies);
-    fclose(file);
 }
 
-void save_borrowing_record(const borrowing_t *record)
+// Load checks the loan count of the slot a title finds against the
+// title's borrowings (book_store.h); after a change to which slot that
+// is, the count starts from the borrowings.
+static void count_loans(const char *title)
 {
-    FILE *file = fopen(BORROWINGS_FILE, "a");
-    if (file == NULL)
+    int book_index = book_store_find(title);
+    if (book_index != -1)
     {
-        perror("Error opening borrowings file for writing");
-        return;
+        book_store_set_on_loan(book_index, count_borrowings(BORROWINGS_BY_TITLE, title));
     }
-    fprintf(file, "%s|%s|%lld\n", record->user_email, record->book_title, (long long)record->due_date_timestamp);
-    fclose(file);
 }
 
-void save_payment_to_file(const char *email, int amount)
+void handle_add_book(client_session_t *session, const add_book_args_t *args, reply_t *reply)
 {
-    FILE *file = fopen(PAYMENTS_FILE, "a");
-    if (file == NULL)
+    int book_index = book_store_find(args->title);
+    if (book_index != -1)
     {
-        perror("Error opening payments file for writing");
+        book_t *book = book_store_get(book_index);
+        book->copies += args->copies;
+        book_store_mark(book_index);
+        printf("Updated copies for book '%s'. New count: %d\n", args->title, book->copies);
+        reply_set(reply, "Success: Book copies updated successfully.");
         return;
     }
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    char date_str[11];
-    strftime(date_str, sizeof(date_str), "%Y-%m-%d", tm);
-    fprintf(file, "%s|%d|%s\n", email, amount, date_str);
-    fclose(file);
-    printf("Payment recorded for user: %s\n", email);
-}
-
-void save_fine_to_file(const char *email, int amount)
-{
-    FILE *file = fopen(FINES_FILE, "a");
-    if (file == NULL)
+    book_t book = {0};
+    strcpy(book.title, args->title);
+    strcpy(book.author, args->author);
+    strcpy(book.subject, args->subject);
+    book.price = args->price;
+    book.copies = args->copies;
+    if (book_store_add(&book) < 0)
     {
-        perror("Error opening fines file for writing");
+        reply_set(reply, "Error: Maximum books reached.");
         return;
     }
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    char date_str[11];
-    strftime(date_str, sizeof(date_str), "%Y-%m-%d", tm);
-    fprintf(file, "%s|%d|%s\n", email, amount, date_str);
-    fclose(file);
-    printf("Fine recorded for user: %s\n", email);
+    count_loans(args->title);
+    printf("New book added: '%s' by %s\n", args->title, args->author);
+    reply_set(reply, "Success: Book added successfully.");
 }
 
-void handle_sign_up(const char *payload, char *response)
+void handle_remove_book(client_session_t *session, const remove_book_args_t *args, reply_t *reply)
 {
-    if (account_count >= MAX_ACCOUNTS)
-    {
-        strcpy(response, "Error: Maximum accounts reached.");
-        return;
-    }
-    char name[MAX_NAME_LEN];
-    char email[MAX_EMAIL_LEN];
-    char phone[MAX_PHONE_LEN];
-    char password[MAX_PASSWD_LEN];
-    int payment;
-    if (sscanf(payload, "%[^|]|%[^|]|%[^|]|%[^|]|%d", name, email, phone, password, &payment) != 5)
+    int book_index = book_store_find(args->title);
+    if (book_index == -1)
     {
-        strcpy(response, "Error: Invalid sign-up format.");
+        reply_set(reply, "Error: Book not found.");
         return;
     }
-    int existing_account_type;
-    if (find_account_by_email(email, &existing_account_type) != -1)
+    book_t *book = book_store_get(book_index);
+    if (book->copies > 1)
     {
-        strcpy(response, "Error: Email already exists.");
-        return;
+        book->copies--;
+        book_store_mark(book_index);
+        printf("Decreased copies for book '%s'. New count: %d\n", args->title, book->copies);
+        reply_set(reply, "Success: Book copy removed successfully.");
     }
-    user_t new_user;
-    strcpy(new_user.name, name);
-    strcpy(new_user.email, email);
-    strcpy(new_user.phone, phone);
-    strcpy(new_user.password, password);
-    new_user.payment_due = (payment > 0) ? 0 : 1;
-    new_user.fines_due = 0;
-    accounts[account_count].type = 1;
-    accounts[account_count].data.user = new_user;
-    account_count++;
-    save_user_to_file(&new_user);
-    if (payment > 0)
+    else
     {
-        save_payment_to_file(new_user.email, payment);
+        printf("Removed last copy of book: '%s'\n", args->title);
+        book_store_remove(book_index);
+        count_loans(args->title);
+        reply_set(reply, "Success: Book removed successfully.");
     }
-    printf("New user signed up: %s, %s\n", name, email);
-    strcpy(response, "Success: Sign-up successful.");
 }
 
-void handle_sign_in(const char *payload, char *response, int *logged_in_type, char *logged_in_email)
+void handle_update_my_info(client_session_t *session, const update_my_info_args_t *args, reply_t *reply)
 {
-    char email[MAX_EMAIL_LEN];
-    char password[MAX_PASSWD_LEN];
-    if (sscanf(payload, "%[^|]|%s", email, password) != 2)
+    int account_type;
+    int user_index = find_account_by_email(session->logged_in_email, &account_type);
+    if (user_index == -1 || account_type != 1)
     {
-        strcpy(response, "Error: Invalid sign-in format.");
+        reply_set(reply, "Error: Could not update information.");
         return;
     }
-    int account_type;
-    int account_index = find_account_by_email(email, &account_type);
-    if (account_index != -1)
+    int other_type;
+    int other_index = find_account_by_email(args->email, &other_type);
+    if (other_index != -1 && other_index != user_index)
     {
-        if (account_type == 0) // Member
-        {
-            if (strcmp(accounts[account_index].data.member.password, password) == 0)
-            {
-                printf("Member signed in: %s\n", email);
-                strcpy(logged_in_email, email);
-                *logged_in_type = 0;
-                strcpy(response, "Success: Sign-in successful.");
-                return;
-            }
-        }
-        else // User
-        {
-            if (strcmp(accounts[account_index].data.user.password, password) == 0)
-            {
-                printf("User signed in: %s\n", email);
-                strcpy(logged_in_email, email);
-                *logged_in_type = 1;
-                strcpy(response, "Success: Sign-in successful.");
-                return;
-            }
-        }
+        reply_set(reply, "Error: Email already exists.");
+        return;
     }
-    printf("Failed sign-in attempt for email: %s\n", email);
-    strcpy(response, "Error: Invalid credentials.");
+    user_t *user = &account_at(user_index)->data.user;
+    strcpy(user->name, args->name);
+    strcpy(user->email, args->email);
+    strcpy(user->phone, args->phone);
+    account_set_password(user_index, args->password);
+    account_email_changed(session->logged_in_email, user_index);
+    log_user_put(session->logged_in_email, user);
+    printf("Updated user info for: %s\n", session->logged_in_email);
+    strcpy(session->logged_in_email, args->email);
+    reply_set(reply, "Success: Information updated successfully.");
 }
 
-void handle_add_book(const char *payload, char *response)
+void handle_update_book(client_session_t *session, const update_book_args_t *args, reply_t *reply)
 {
-    char title[MAX_TITLE_LEN];
-    char author[MAX_AUTHOR_LEN];
-    char subject[MAX_SUBJECT_LEN];
-    int price;
-    int copies_to_add;
-
-    if (sscanf(payload, "%[^|]|%[^|]|%[^|]|%d|%d", title, author, subject, &price, &copies_to_add) != 5)
+    int book_index = book_store_find(args->old_title);
+    if (book_index == -1)
     {
-        strcpy(response, "Error: Invalid book format.");
+        reply_set(reply, "Error: Book not found.");
         return;
     }
-
-    FILE *original_file = fopen(BOOK_FILE, "r");
-    if (original_file != NULL)
+    int other_index = book_store_find(args->title);
+    if (other_index != -1 && other_index != book_index)
     {
-        FILE *temp_file = fopen("temp.txt", "w");
-        if (temp_file == NULL)
-        {
-            perror("Error creating temporary file");
-            fclose(original_file);
-            strcpy(response, "Error: Server failed to process request.");
-            return;
-        }
-
-        char line[MAX_TITLE_LEN + MAX_AUTHOR_LEN + MAX_SUBJECT_LEN + 25];
-        bool book_found = false;
-
-        while (fgets(line, sizeof(line), original_file))
-        {
-            char current_title[MAX_TITLE_LEN];
-            char current_author[MAX_AUTHOR_LEN];
-            char current_subject[MAX_SUBJECT_LEN];
-            int current_price;
-            int current_copies;
-            if (sscanf(line, "%[^|]|%[^|]|%[^|]|%d|%d", current_title, current_author, current_subject, &current_price, &current_copies) == 5)
-            {
-                if (strcmp(current_title, title) == 0)
-                {
-                    current_copies += copies_to_add;
-                    fprintf(temp_file, "%s|%s|%s|%d|%d\n", current_title, current_author, current_subject, current_price, current_copies);
-                    book_found = true;
-                    printf("Updated copies for book '%s'. New count: %d\n", current_title, current_copies);
-                }
-                else
-                {
-                    fprintf(temp_file, "%s", line);
-                }
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        fclose(original_file);
-        fclose(temp_file);
-
-        if (book_found)
-        {
-            remove(BOOK_FILE);
-            rename("temp.txt", BOOK_FILE);
-            strcpy(response, "Success: Book copies updated successfully.");
-        }
-        else
-        {
-            FILE *file = fopen(BOOK_FILE, "a");
-            if (file == NULL)
-            {
-                perror("Error opening book file for writing");
-                strcpy(response, "Error: Could not open book file.");
-                return;
-            }
-            fprintf(file, "%s|%s|%s|%d|%d\n", title, author, subject, price, copies_to_add);
-            fclose(file);
-            printf("New book added: '%s' by %s\n", title, author);
-            strcpy(response, "Success: Book added successfully.");
-            remove("temp.txt");
-        }
+        reply_set(reply, "Error: Title already exists.");
+        return;
     }
-    else
+    book_t *book = book_store_get(book_index);
+    strcpy(book->title, args->title);
+    strcpy(book->author, args->author);
+    strcpy(book->subject, args->subject);
+    book->price = args->price;
+    book->copies = args->copies;
+    book_store_retitle(book_index, args->old_title);
+    book_store_mark(book_index);
+    if (strcmp(args->old_title, args->title) != 0)
     {
-        FILE *file = fopen(BOOK_FILE, "a");
-        if (file == NULL)
-        {
-            perror("Error opening book file for writing");
-            strcpy(response, "Error: Could not open book file.");
-            return;
-        }
-        fprintf(file, "%s|%s|%s|%d|%d\n", title, author, subject, price, copies_to_add);
-        fclose(file);
-        printf("New book added: '%s' by %s\n", title, author);
-        strcpy(response, "Success: Book added successfully.");
+        count_loans(args->title);
+        count_loans(args->old_title);
     }
+    printf("Updated book info for: %s\n", args->old_title);
+    reply_set(reply, "Success: Book updated successfully.");
 }
 
-void handle_remove_book(const char *payload, char *response)
+void handle_check_copies(client_session_t *session, const check_copies_args_t *args, reply_t *reply)
 {
-    FILE *original_file = fopen(BOOK_FILE, "r");
-    if (original_file == NULL)
+    int book_index = book_store_find(args->title);
+    if (book_index == -1)
     {
-        strcpy(response, "Error: Book file not found.");
+        reply_set(reply, "Error: Book not found.");
         return;
     }
-    FILE *temp_file = fopen("temp.txt", "w");
-    if (temp_file == NULL)
+    const book_t *book = book_store_get(book_index);
+    reply_printf(reply, "Success: '%s' has %d copies.", book->title, book->copies);
+}
+
+// Both read only the catalog's columns (book_columns.h), so their cost
+// grows with the number of books but not with the size of a book.
+void handle_catalog_value(client_session_t *session, const catalog_value_args_t *args, reply_t *reply)
+{
+    catalog_totals_t totals;
+    if (book_columns_totals(args->subject, &totals) < 0)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
+        reply_printf(reply, "Error: No books on '%s'.", args->subject);
         return;
     }
-    char line[MAX_TITLE_LEN + MAX_AUTHOR_LEN + MAX_SUBJECT_LEN + 25];
-    bool book_found = false;
-    char book_to_remove[MAX_TITLE_LEN + 1];
-    strcpy(book_to_remove, payload);
-    char *newline_pos = strchr(book_to_remove, '\n');
-    if (newline_pos)
-        *newline_pos = '\0';
+    reply_printf(reply, "Success: %lld titles, %lld copies, worth Rs. %lld.", (long long)totals.titles,
+                 (long long)totals.copies, (long long)totals.value);
+}
 
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_title[MAX_TITLE_LEN];
-        char current_author[MAX_AUTHOR_LEN];
-        char current_subject[MAX_SUBJECT_LEN];
-        int current_price;
-        int current_copies;
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%d|%d", current_title, current_author, current_subject, &current_price, &current_copies) == 5)
-        {
-            if (strcmp(current_title, book_to_remove) == 0)
-            {
-                book_found = true;
-                if (current_copies > 1)
-                {
-                    current_copies--;
-                    fprintf(temp_file, "%s|%s|%s|%d|%d\n", current_title, current_author, current_subject, current_price, current_copies);
-                    printf("Decreased copies for book '%s'. New count: %d\n", current_title, current_copies);
-                    strcpy(response, "Success: Book copy removed successfully.");
-                }
-                else
-                {
-                    printf("Removed last copy of book: '%s'\n", current_title);
-                    strcpy(response, "Success: Book removed successfully.");
-                }
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
+// Lists books with no more than threshold copies, as title|subject|copies
+// lines, one page at a time. The cursor is the book store slot to resume
+// from, as in VIEW_USERS.
+void handle_low_stock(client_session_t *session, const low_stock_args_t *args, reply_t *reply)
+{
+    int page_size = args->page_size ? args->page_size : DEFAULT_LOW_STOCK_PAGE;
+    if (args->threshold < 0 || page_size < 0 || page_size > MAX_LOW_STOCK_PAGE || args->cursor < 0)
+    {
+        reply_set(reply, "Error: Invalid request format.");
+        return;
     }
-    fclose(original_file);
-    fclose(temp_file);
-    if (book_found)
+    int slots[MAX_LOW_STOCK_PAGE];
+    int next;
+    int found = book_columns_low_stock(args->threshold, args->cursor, slots, page_size, &next);
+    reply_printf(reply, "Success: %d books with at most %d copies\n", book_columns_count_low_stock(args->threshold),
+                 args->threshold);
+    for (int i = 0; i < found; i++)
     {
-        remove(BOOK_FILE);
-        rename("temp.txt", BOOK_FILE);
+        const book_t *book = book_store_get(slots[i]);
+        reply_append(reply, "%s|%s|%d\n", book->title, book->subject, book->copies);
     }
-    else
+    if (next != -1)
     {
-        remove("temp.txt");
-        strcpy(response, "Error: Book not found.");
+        reply_append(reply, "Next cursor: %d", next);
     }
 }
 
-void handle_update_my_info(const char *payload, char *response, const char *logged_in_email)
+// LIST_BOOKS and VIEW_USERS filters. A missing filter means the first
+// choice.
+static const char *const copies_filters[] = {"any", "available", NULL};
+static const char *const role_filters[] = {"all", "member", "user", NULL};
+static const char *const dues_filters[] = {"any", "payment", "fines", "owing", "clear", NULL};
+
+static int parse_filter(const char *value, const char *const *choices)
 {
-    FILE *original_file = fopen(USERS_FILE, "r");
-    if (original_file == NULL)
+    if (value == NULL)
     {
-        strcpy(response, "Error: User file not found.");
-        return;
+        return 0;
     }
-    FILE *temp_file = fopen("temp_users.txt", "w");
-    if (temp_file == NULL)
+    for (int i = 0; choices[i]; i++)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
-        return;
+        if (strcmp(value, choices[i]) == 0)
+        {
+            return i;
+        }
     }
-    char name[MAX_NAME_LEN];
-    char new_email[MAX_EMAIL_LEN];
-    char phone[MAX_PHONE_LEN];
-    char password[MAX_PASSWD_LEN];
-    if (sscanf(payload, "%[^|]|%[^|]|%[^|]|%s", name, new_email, phone, password) != 4)
+    return -1;
+}
+
+// Lists one page of books as title|author|subject|price|copies lines, in
+// book store slot order. Subject and author filters are served from their
+// posting lists (book_columns.h), so a page costs about as much as the
+// books it lists. The cursor works as in VIEW_USERS.
+void handle_list_books(client_session_t *session, const list_books_args_t *args, reply_t *reply)
+{
+    int page_size = args->page_size ? args->page_size : DEFAULT_BOOKS_PAGE;
+    int copies = parse_filter(args->copies, copies_filters);
+    if (page_size < 0 || page_size > MAX_BOOKS_PAGE || args->cursor < 0 || copies < 0)
     {
-        strcpy(response, "Error: Invalid update format.");
-        fclose(original_file);
-        fclose(temp_file);
-        remove("temp_users.txt");
+        reply_set(reply, "Error: Invalid request format.");
         return;
     }
-    char line[MAX_NAME_LEN + MAX_EMAIL_LEN + MAX_PHONE_LEN + MAX_PASSWD_LEN + 10];
-    bool user_updated = false;
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_name[MAX_NAME_LEN];
-        char current_email[MAX_EMAIL_LEN];
-        char current_phone[MAX_PHONE_LEN];
-        char current_password[MAX_PASSWD_LEN];
-        int payment_due;
-        int fines_due;
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d", current_name, current_email, current_phone, current_password, &payment_due, &fines_due) == 6)
-        {
-            if (strcmp(current_email, logged_in_email) == 0)
-            {
-                fprintf(temp_file, "%s|%s|%s|%s|%d|%d\n", name, new_email, phone, password, payment_due, fines_due);
-                user_updated = true;
-                printf("Updated user info for: %s\n", logged_in_email);
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
-    }
-    fclose(original_file);
-    fclose(temp_file);
-    if (user_updated)
+    book_filter_t filter = {.subject = args->subject, .author = args->author, .available = copies == 1};
+    int slots[MAX_BOOKS_PAGE];
+    int next;
+    int found = book_columns_list(&filter, args->cursor, slots, page_size, &next);
+    reply_set(reply, "Success: List of Books\n");
+    for (int i = 0; i < found; i++)
     {
-        remove(USERS_FILE);
-        rename("temp_users.txt", USERS_FILE);
-        strcpy(response, "Success: Information updated successfully.");
+        const book_t *book = book_store_get(slots[i]);
+        reply_append(reply, "%s|%s|%s|%d|%d\n", book->title, book->author, book->subject, book->price,
+                     book->copies);
     }
-    else
+    if (next != -1)
     {
-        remove("temp_users.txt");
-        strcpy(response, "Error: Could not update information.");
+        reply_append(reply, "Next cursor: %d", next);
     }
 }
 
-void handle_update_book(const char *payload, char *response)
+static int account_matches(const account_t *account, int role, int dues)
 {
-    FILE *original_file = fopen(BOOK_FILE, "r");
-    if (original_file == NULL)
+    if (role != 0 && role != account->type + 1)
     {
-        strcpy(response, "Error: Book file not found.");
-        return;
+        return 0;
     }
-    FILE *temp_file = fopen("temp_books.txt", "w");
-    if (temp_file == NULL)
+    int payment_due = account->type == 1 ? account->data.user.payment_due : 0;
+    int fines_due = account->type == 1 ? account->data.user.fines_due : 0;
+    switch (dues)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
-        return;
+    case 1:
+        return payment_due > 0;
+    case 2:
+        return fines_due > 0;
+    case 3:
+        return payment_due > 0 || fines_due > 0;
+    case 4:
+        return payment_due <= 0 && fines_due <= 0;
+    default:
+        return 1;
     }
+}
 
-    char old_title[MAX_TITLE_LEN];
-    char new_title[MAX_TITLE_LEN];
-    char new_author[MAX_AUTHOR_LEN];
-    char new_subject[MAX_SUBJECT_LEN];
-    int new_price;
-    int new_copies;
-
-    if (sscanf(payload, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d", old_title, new_title, new_author, new_subject, &new_price, &new_copies) != 6)
+// Lists one page of accounts straight from the table. The cursor is the
+// table index to resume from; when more accounts may follow, the reply
+// ends with "Next cursor: N" to pass back for the next page.
+void handle_view_users(client_session_t *session, const view_users_args_t *args, reply_t *reply)
+{
+    int page_size = args->page_size ? args->page_size : DEFAULT_USERS_PAGE;
+    int role = parse_filter(args->role, role_filters);
+    int dues = parse_filter(args->dues, dues_filters);
+    if (page_size < 0 || page_size > MAX_USERS_PAGE || args->cursor < 0 || role < 0 || dues < 0)
     {
-        strcpy(response, "Error: Invalid update format.");
-        fclose(original_file);
-        fclose(temp_file);
-        remove("temp_books.txt");
+        reply_set(reply, "Error: Invalid request format.");
         return;
     }
 
-    char line[MAX_TITLE_LEN + MAX_AUTHOR_LEN + MAX_SUBJECT_LEN + 25];
-    bool book_updated = false;
-
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_title[MAX_TITLE_LEN];
-        char current_author[MAX_AUTHOR_LEN];
-        char current_subject[MAX_SUBJECT_LEN];
-        int current_price;
-        int current_copies;
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%d|%d", current_title, current_author, current_subject, &current_price, &current_copies) == 5)
+    reply_set(reply, "Success: List of Users\n");
+    int listed = 0;
+    int i;
+    for (i = args->cursor; i < tables->accounts->count && listed < page_size; i++)
+    {
+        const account_t *account = account_at(i);
+        if (!account_matches(account, role, dues))
         {
-            if (strcmp(current_title, old_title) == 0)
-            {
-                fprintf(temp_file, "%s|%s|%s|%d|%d\n", new_title, new_author, new_subject, new_price, new_copies);
-                book_updated = true;
-                printf("Updated book info for: %s\n", old_title);
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
+            continue;
+        }
+        if (account->type == 0)
+        {
+            const member_t *member = &account->data.member;
+            reply_append(reply, "%s|%s|%s|member|0|0\n", member->name, member->email, member->phone);
         }
         else
         {
-            fprintf(temp_file, "%s", line);
+            const user_t *user = &account->data.user;
+            reply_append(reply, "%s|%s|%s|user|%d|%d\n", user->name, user->email, user->phone,
+                         user->payment_due, user->fines_due);
         }
+        listed++;
     }
-    fclose(original_file);
-    fclose(temp_file);
-    if (book_updated)
-    {
-        remove(BOOK_FILE);
-        rename("temp_books.txt", BOOK_FILE);
-        strcpy(response, "Success: Book updated successfully.");
-    }
-    else
+    if (i < tables->accounts->count)
     {
-        remove("temp_books.txt");
-        strcpy(response, "Error: Book not found.");
+        reply_append(reply, "Next cursor: %d", i);
     }
 }
 
-void handle_check_copies(const char *payload, char *response)
+void handle_delete_user(client_session_t *session, const delete_user_args_t *args, reply_t *reply)
 {
-    FILE *file = fopen(BOOK_FILE, "r");
-    if (file == NULL)
+    reply_set(reply, "Error: User accounts cannot be deleted.");
+    printf("Attempt to delete user failed: Deletion is not allowed.\n");
+}
+
+void handle_update_user_info(client_session_t *session, const update_user_info_args_t *args, reply_t *reply)
+{
+    int account_type;
+    int user_index = find_account_by_email(args->target_email, &account_type);
+    if (user_index == -1 || account_type != 1)
     {
-        strcpy(response, "Error: Book file not found.");
+        reply_set(reply, "Error: User not found.");
         return;
     }
-
-    char title_to_find[MAX_TITLE_LEN];
-    strcpy(title_to_find, payload);
-    char *newline_pos = strchr(title_to_find, '\n');
-    if (newline_pos)
-        *newline_pos = '\0';
-
-    char line[MAX_TITLE_LEN + MAX_AUTHOR_LEN + MAX_SUBJECT_LEN + 25];
-    bool book_found = false;
-
-    while (fgets(line, sizeof(line), file))
-    {
-        char current_title[MAX_TITLE_LEN];
-        char current_author[MAX_AUTHOR_LEN];
-        char current_subject[MAX_SUBJECT_LEN];
-        int current_price;
-        int current_copies;
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%d|%d", current_title, current_author, current_subject, &current_price, &current_copies) == 5)
-        {
-            if (strcmp(current_title, title_to_find) == 0)
-            {
-                snprintf(response, 1024, "Success: '%s' has %d copies.", current_title, current_copies);
-                book_found = true;
-                break;
-            }
-        }
-    }
-    fclose(file);
-
-    if (!book_found)
+    int other_type;
+    int other_index = find_account_by_email(args->email, &other_type);
+    if (other_index != -1 && other_index != user_index)
     {
-        strcpy(response, "Error: Book not found.");
+        reply_set(reply, "Error: Email already exists.");
+        return;
     }
+    user_t *user = &account_at(user_index)->data.user;
+    strcpy(user->name, args->name);
+    strcpy(user->email, args->email);
+    strcpy(user->phone, args->phone);
+    account_set_password(user_index, args->password);
+    account_email_changed(args->target_email, user_index);
+    log_user_put(args->target_email, user);
+    printf("Updated info for user: %s\n", args->target_email);
+    reply_set(reply, "Success: User updated successfully.");
 }
 
-void handle_view_users(char *response)
+void handle_collect_payment(client_session_t *session, const collect_payment_args_t *args, reply_t *reply)
 {
-    FILE *file = fopen(USERS_FILE, "r");
-    if (file == NULL)
+    int account_type;
+    int user_index = find_account_by_email(args->email, &account_type);
+    if (user_index == -1 || account_type != 1)
     {
-        strcpy(response, "Error: User file not found.");
+        reply_set(reply, "Error: User not found.");
         return;
     }
-
-    char line[512];
-    char user_list[2048] = "";
-    strcpy(user_list, "Success: List of Users\n");
-
-    while (fgets(line, sizeof(line), file))
+    user_t *user = &account_at(user_index)->data.user;
+    if (user->payment_due == 0)
     {
-        strcat(user_list, line);
+        reply_set(reply, "Error: User has no outstanding payment.");
+        return;
     }
-
-    fclose(file);
-    strcpy(response, user_list);
+    user->payment_due = 0;
+    log_user_put(user->email, user);
+    save_payment_to_file(user->email, args->amount);
+    reply_set(reply, "Success: Payment collected successfully.");
 }
 
-void handle_delete_user(const char *payload, char *response)
+void handle_collect_fine(client_session_t *session, const collect_fine_args_t *args, reply_t *reply)
 {
-    strcpy(response, "Error: User accounts cannot be deleted.");
-    printf("Attempt to delete user failed: Deletion is not allowed.\n");
-}
-
-void handle_update_user_info(const char *payload, char *response)
-{
-    FILE *original_file = fopen(USERS_FILE, "r");
-    if (original_file == NULL)
+    int account_type;
+    int user_index = find_account_by_email(args->email, &account_type);
+    if (user_index == -1 || account_type != 1)
     {
-        strcpy(response, "Error: User file not found.");
+        reply_set(reply, "Error: User not found.");
         return;
     }
-    FILE *temp_file = fopen("temp_users.txt", "w");
-    if (temp_file == NULL)
+    user_t *user = &account_at(user_index)->data.user;
+    if (user->fines_due <= 0)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
+        reply_set(reply, "Error: User has no outstanding fines.");
         return;
     }
+    user->fines_due -= args->amount;
+    if (user->fines_due < 0)
+        user->fines_due = 0;
+    log_user_put(user->email, user);
+    save_fine_to_file(user->email, args->amount);
+    reply_printf(reply, "Success: Fine of %d collected. Remaining fine: %d.", args->amount, user->fines_due);
+}
 
-    char target_email[MAX_EMAIL_LEN];
-    char new_name[MAX_NAME_LEN];
-    char new_email[MAX_EMAIL_LEN];
-    char new_phone[MAX_PHONE_LEN];
-    char new_password[MAX_PASSWD_LEN];
-
-    if (sscanf(payload, "%[^|]|%[^|]|%[^|]|%[^|]|%s", target_email, new_name, new_email, new_phone, new_password) != 5)
-    {
-        strcpy(response, "Error: Invalid update format.");
-        fclose(original_file);
-        fclose(temp_file);
-        remove("temp_users.txt");
-        return;
-    }
-
-    char line[512];
-    bool user_updated = false;
-
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_name[MAX_NAME_LEN];
-        char current_email[MAX_EMAIL_LEN];
-        char current_phone[MAX_PHONE_LEN];
-        char current_password[MAX_PASSWD_LEN];
-        int current_payment_due;
-        int current_fines_due;
-
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d", current_name, current_email, current_phone, current_password, &current_payment_due, &current_fines_due) == 6)
-        {
-            if (strcmp(current_email, target_email) == 0)
-            {
-                fprintf(temp_file, "%s|%s|%s|%s|%d|%d\n", new_name, new_email, new_phone, new_password, current_payment_due, current_fines_due);
-                user_updated = true;
-                printf("Updated info for user: %s\n", target_email);
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
-    }
+void handle_borrow_book(client_session_t *session, const borrow_book_args_t *args, reply_t *reply)
+{
+    const char *title = args->title;
+    const char *email = args->email;
 
-    fclose(original_file);
-    fclose(temp_file);
+    int book_index = book_store_find(title);
+    int user_type;
+    int user_index = find_account_by_email(email, &user_type);
 
-    if (user_updated)
+    if (user_index == -1)
     {
-        remove(USERS_FILE);
-        rename("temp_users.txt", USERS_FILE);
-        strcpy(response, "Success: User updated successfully.");
+        reply_set(reply, "Error: User not found.");
+        return;
     }
-    else
+    if (book_index == -1)
     {
-        remove("temp_users.txt");
-        strcpy(response, "Error: User not found.");
+        reply_set(reply, "Error: Book not found.");
+        return;
     }
-}
-
-void handle_collect_payment(const char *payload, char *response)
-{
-    FILE *original_file = fopen(USERS_FILE, "r");
-    if (original_file == NULL)
+    book_t *book = book_store_get(book_index);
+    if (book->copies <= 0)
     {
-        strcpy(response, "Error: User file not found.");
+        reply_set(reply, "Error: No copies of this book are available.");
         return;
     }
-    FILE *temp_file = fopen("temp_users.txt", "w");
-    if (temp_file == NULL)
+    if (user_type == 1 && account_at(user_index)->data.user.fines_due > 0)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
+        reply_set(reply, "Error: User has outstanding fines and cannot borrow a book.");
         return;
     }
-
-    char email_to_find[MAX_EMAIL_LEN];
-    int payment_amount;
-    if (sscanf(payload, "%[^|]|%d", email_to_find, &payment_amount) != 2)
-    {
-        strcpy(response, "Error: Invalid payment format.");
-        fclose(original_file);
-        fclose(temp_file);
-        remove("temp_users.txt");
+    borrowing_t new_borrowing = {0};
+    strcpy(new_borrowing.user_email, email);
+    strcpy(new_borrowing.book_title, title);
+    time_t current_time = time(NULL);
+    new_borrowing.due_date_timestamp = current_time + LOAN_SECONDS;
+    if (add_borrowing(&new_borrowing) < 0)
+    {
+        reply_set(reply, "Error: Maximum borrowings reached.");
         return;
     }
 
-    char line[512];
-    bool user_found = false;
+    book_store_lend(book_index, 1);
 
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_name[MAX_NAME_LEN];
-        char current_email[MAX_EMAIL_LEN];
-        char current_phone[MAX_PHONE_LEN];
-        char current_password[MAX_PASSWD_LEN];
-        int current_payment_due;
-        int current_fines_due;
+    log_borrowing_add(&new_borrowing);
+    char due_date_str[26];
+    printf("Book '%s' borrowed by '%s'. Due date: %s", title, email, ctime_r(&new_borrowing.due_date_timestamp, due_date_str));
 
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d", current_name, current_email, current_phone, current_password, &current_payment_due, &current_fines_due) == 6)
-        {
-            if (strcmp(current_email, email_to_find) == 0)
-            {
-                if (current_payment_due == 0)
-                {
-                    strcpy(response, "Error: User has no outstanding payment.");
-                    user_found = true;
-                    fprintf(temp_file, "%s", line);
-                }
-                else
-                {
-                    current_payment_due = 0;
-                    fprintf(temp_file, "%s|%s|%s|%s|%d|%d\n", current_name, current_email, current_phone, current_password, current_payment_due, current_fines_due);
-                    save_payment_to_file(current_email, payment_amount);
-                    strcpy(response, "Success: Payment collected successfully.");
-                    user_found = true;
-                }
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
-    }
+    reply_set(reply, "Success: Book borrowed successfully.");
+}
 
-    fclose(original_file);
-    fclose(temp_file);
+void handle_return_book(client_session_t *session, const return_book_args_t *args, reply_t *reply)
+{
+    const char *user_email = args->email;
+    const char *book_title = args->title;
 
-    if (user_found)
+    if (tables->borrowing_count == 0)
     {
-        remove(USERS_FILE);
-        rename("temp_users.txt", USERS_FILE);
+        reply_set(reply, "Error: No books are currently borrowed.");
+        return;
     }
-    else
+    int borrowing_index = find_borrowing(user_email, book_title);
+    if (borrowing_index == -1)
     {
-        remove("temp_users.txt");
-        strcpy(response, "Error: User not found.");
+        reply_set(reply, "Error: User has not borrowed this book.");
+        return;
     }
-}
 
-void handle_collect_fine(const char *payload, char *response)
-{
-    FILE *original_file = fopen(USERS_FILE, "r");
-    if (original_file == NULL)
+    time_t current_time = time(NULL);
+    const borrowing_row_t *entry = borrowing_row(borrowing_index);
+    if (current_time > entry->borrowing.due_date_timestamp)
     {
-        strcpy(response, "Error: User file not found.");
-        return;
+        int fine_in_days = overdue_days(&entry->borrowing, current_time);
+        int fine_amount = fine_in_days * FINE_PER_DAY;
+        printf("User '%s' is late returning book '%s'. Fine due: Rs. %d\n", user_email, book_title, fine_amount);
+
+        // The days the overdue tracker has charged already are in
+        // fines_due; add the rest.
+        int user_type;
+        int user_index = find_account_by_email(user_email, &user_type);
+        if (user_index != -1 && user_type == 1 && fine_in_days > entry->accrued_days)
+        {
+            user_t *user = &account_at(user_index)->data.user;
+            user->fines_due += (fine_in_days - entry->accrued_days) * FINE_PER_DAY;
+            log_user_put(user_email, user);
+        }
+        reply_printf(reply, "Success: Book returned. Fine of Rs. %d due.", fine_amount);
     }
-    FILE *temp_file = fopen("temp_users.txt", "w");
-    if (temp_file == NULL)
+    else
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
-        return;
+        reply_set(reply, "Success: Book returned on time. No fine.");
     }
 
-    char email_to_find[MAX_EMAIL_LEN];
-    int fine_amount_collected;
-    if (sscanf(payload, "%[^|]|%d", email_to_find, &fine_amount_collected) != 2)
-    {
-        strcpy(response, "Error: Invalid fine format.");
-        fclose(original_file);
-        fclose(temp_file);
-        remove("temp_users.txt");
-        return;
+    int book_index = book_store_find(book_title);
+    if (book_index != -1)
+    {
+        book_store_lend(book_index, -1);
     }
 
-    char line[512];
-    bool user_found = false;
+    remove_borrowing(borrowing_index);
+    log_borrowing_delete(user_email, book_title);
+}
 
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_name[MAX_NAME_LEN];
-        char current_email[MAX_EMAIL_LEN];
-        char current_phone[MAX_PHONE_LEN];
-        char current_password[MAX_PASSWD_LEN];
-        int current_payment_due;
-        int current_fines_due;
+static const char *format_date(time_t t, char *date_str, size_t size)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(date_str, size, "%Y-%m-%d", &tm);
+    return date_str;
+}
 
-        if (sscanf(line, "%[^|]|%[^|]|%[^|]|%[^|]|%d|%d", current_name, current_email, current_phone, current_password, &current_payment_due, &current_fines_due) == 6)
-        {
-            if (strcmp(current_email, email_to_find) == 0)
-            {
-                user_found = true;
-                if (current_fines_due <= 0)
-                {
-                    strcpy(response, "Error: User has no outstanding fines.");
-                    fprintf(temp_file, "%s", line);
-                }
-                else
-                {
-                    current_fines_due -= fine_amount_collected;
-                    if (current_fines_due < 0)
-                        current_fines_due = 0;
-                    fprintf(temp_file, "%s|%s|%s|%s|%d|%d\n", current_name, current_email, current_phone, current_password, current_payment_due, current_fines_due);
-                    save_fine_to_file(current_email, fine_amount_collected);
-                    snprintf(response, 1024, "Success: Fine of %d collected. Remaining fine: %d.", fine_amount_collected, current_fines_due);
-                }
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
-            }
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
+// What the signed-in account has out, oldest first, as title|due lines.
+void handle_my_borrowings(client_session_t *session, const my_borrowings_args_t *args, reply_t *reply)
+{
+    reply_set(reply, "Success: Your borrowings\n");
+    for (int row = first_borrowing(BORROWINGS_BY_USER, session->logged_in_email); row != -1;
+         row = next_borrowing(BORROWINGS_BY_USER, row))
+    {
+        const borrowing_t *borrowing = borrowing_at(row);
+        char date_str[11];
+        reply_append(reply, "%s|%s\n", borrowing->book_title,
+                     format_date(borrowing->due_date_timestamp, date_str, sizeof(date_str)));
     }
+}
 
-    fclose(original_file);
-    fclose(temp_file);
-
-    if (user_found)
+// The oldest overdue borrowings, as email|title|due|days late lines.
+void handle_overdue(client_session_t *session, const overdue_args_t *args, reply_t *reply)
+{
+    int limit = args->limit ? args->limit : DEFAULT_OVERDUE_LIMIT;
+    if (limit < 0 || limit > MAX_OVERDUE_LIMIT)
     {
-        remove(USERS_FILE);
-        rename("temp_users.txt", USERS_FILE);
+        reply_set(reply, "Error: Invalid request format.");
+        return;
     }
-    else
+    time_t now = time(NULL);
+    reply_printf(reply, "Success: %d overdue borrowings\n", overdue_count());
+    int listed = 0;
+    for (int row = first_overdue(); row != -1 && listed < limit; row = next_overdue(row), listed++)
     {
-        remove("temp_users.txt");
-        strcpy(response, "Error: User not found.");
+        const borrowing_t *borrowing = borrowing_at(row);
+        char date_str[11];
+        reply_append(reply, "%s|%s|%s|%d\n", borrowing->user_email, borrowing->book_title,
+                     format_date(borrowing->due_date_timestamp, date_str, sizeof(date_str)),
+                     overdue_days(borrowing, now));
     }
 }
 
-void handle_borrow_book(const char *payload, char *response, const char *logged_in_email)
+// Who has a title out, as email|due lines.
+void handle_title_holders(client_session_t *session, const title_holders_args_t *args, reply_t *reply)
 {
-    char title[MAX_TITLE_LEN];
-    char email[MAX_EMAIL_LEN];
-
-    if (sscanf(payload, "%[^|]|%s", email, title) != 2)
+    reply_printf(reply, "Success: Holders of '%s'\n", args->title);
+    for (int row = first_borrowing(BORROWINGS_BY_TITLE, args->title); row != -1;
+         row = next_borrowing(BORROWINGS_BY_TITLE, row))
     {
-        strcpy(response, "Error: Invalid borrowing format.");
-        return;
+        const borrowing_t *borrowing = borrowing_at(row);
+        char date_str[11];
+        reply_append(reply, "%s|%s\n", borrowing->user_email,
+                     format_date(borrowing->due_date_timestamp, date_str, sizeof(date_str)));
     }
+}
 
-    int book_index = find_book_by_title(title);
-    int user_type;
-    int user_index = find_account_by_email(email, &user_type);
-
-    if (user_index == -1)
+// A member's totals, then the newest payments first as date|type|amount
+// lines. Both come from the ledger rows, without reading the file.
+void handle_payments(client_session_t *session, const payments_args_t *args, reply_t *reply)
+{
+    int limit = args->limit ? args->limit : DEFAULT_PAYMENTS_LIMIT;
+    if (limit < 0 || limit > MAX_PAYMENTS_LIMIT)
     {
-        strcpy(response, "Error: User not found.");
+        reply_set(reply, "Error: Invalid request format.");
         return;
     }
-    if (book_index == -1)
+    int account_type;
+    int user_index = find_account_by_email(args->email, &account_type);
+    if (user_index == -1 || account_type != 1)
     {
-        strcpy(response, "Error: Book not found.");
+        reply_set(reply, "Error: User not found.");
         return;
     }
-    if (books[book_index].copies <= 0)
+    const account_ledger_t *totals = account_ledger(user_index);
+    char date_str[11];
+    reply_printf(reply, "Success: Paid %lld in fees and %lld in fines.", totals->paid, totals->fined);
+    const Payment *last = payment_find_last_paid(user_index, PAYMENT_FEE);
+    if (last)
     {
-        strcpy(response, "Error: No copies of this book are available.");
-        return;
+        reply_append(reply, " Last fee paid on %s.", format_date(last->txtime, date_str, sizeof(date_str)));
     }
-    if (accounts[user_index].data.user.fines_due > 0)
+    reply_append(reply, "\n");
+    Payment payments[MAX_PAYMENTS_LIMIT];
+    int count = payment_find_by_member(user_index, PAYMENT_ANY, payments, limit);
+    for (int i = 0; i < count; i++)
     {
-        strcpy(response, "Error: User has outstanding fines and cannot borrow a book.");
-        return;
+        reply_append(reply, "%s|%s|%d\n", format_date(payments[i].txtime, date_str, sizeof(date_str)),
+                     payments[i].type == PAYMENT_FEE ? "fee" : "fine", payments[i].amount);
     }
+}
 
-    books[book_index].copies--;
-    borrowing_t new_borrowing;
-    strcpy(new_borrowing.user_email, email);
-    strcpy(new_borrowing.book_title, title);
-    time_t current_time = time(NULL);
-    new_borrowing.due_date_timestamp = current_time + (7 * 24 * 60 * 60);
-
-    save_borrowing_record(&new_borrowing);
-    printf("Book '%s' borrowed by '%s'. Due date: %s", title, email, ctime(&new_borrowing.due_date_timestamp));
+void handle_stats(client_session_t *session, const stats_args_t *args, reply_t *reply)
+{
+    reply_set(reply, "Success: Server statistics\n");
+    metrics_report(reply);
+}
 
-    FILE *original_file = fopen(BOOK_FILE, "r");
-    FILE *temp_file = fopen("temp_books.txt", "w");
-    char line[512];
-    while (fgets(line, sizeof(line), original_file))
-    {
-        char current_title[MAX_TITLE_LEN];
-        sscanf(line, "%[^|]|", current_title);
-        if (strcmp(current_title, title) == 0)
-        {
-            fprintf(temp_file, "%s|%s|%s|%d|%d\n", books[book_index].title, books[book_index].author, books[book_index].subject, books[book_index].price, books[book_index].copies);
-        }
-        else
-        {
-            fprintf(temp_file, "%s", line);
-        }
-    }
-    fclose(original_file);
-    fclose(temp_file);
-    remove(BOOK_FILE);
-    rename("temp_books.txt", BOOK_FILE);
 
-    strcpy(response, "Success: Book borrowed successfully.");
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-t worker_threads] [-p processes] [-u] [-s stats_interval] [-k snapshot_interval]\n"
+                    "          [-f none|always|group[:window_us[:max_records]]]\n", prog);
+    fprintf(stderr, "  -p  fork this many server processes sharing the port (SO_REUSEPORT)\n");
+    fprintf(stderr, "  -u  use the io_uring backend instead of epoll\n");
+    fprintf(stderr, "  -s  write the STATS report to " STATS_FILE " every this many seconds\n");
+    fprintf(stderr, "  -k  seconds between snapshots (default %d); 0 never takes one\n", DEFAULT_SNAPSHOT_INTERVAL);
+    fprintf(stderr, "  -f  when changes are synced before the reply (default group:%d:%d)\n",
+            DEFAULT_COMMIT_WINDOW_US, DEFAULT_COMMIT_MAX_RECORDS);
 }
 
-void handle_return_book(const char *payload, char *response)
+// Creates a listening socket on SERV_PORT. With reuse_port set, several
+// such sockets can be bound at once and the kernel spreads incoming
+// connections across them.
+static int open_listener(int reuse_port)
 {
-    char user_email[MAX_EMAIL_LEN];
-    char book_title[MAX_TITLE_LEN];
-
-    if (sscanf(payload, "%[^|]|%s", user_email, book_title) != 2)
+    int server_fd;
+    struct sockaddr_in address;
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
-        strcpy(response, "Error: Invalid return format.");
-        return;
+        perror("socket failed");
+        return -1;
     }
-
-    FILE *original_file = fopen(BORROWINGS_FILE, "r");
-    if (original_file == NULL)
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0)
     {
-        strcpy(response, "Error: No books are currently borrowed.");
-        return;
+        perror("SO_REUSEPORT failed");
+        close(server_fd);
+        return -1;
     }
-
-    FILE *temp_file = fopen("temp_borrowings.txt", "w");
-    if (temp_file == NULL)
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(SERV_PORT);
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
     {
-        perror("Error creating temporary file");
-        fclose(original_file);
-        strcpy(response, "Error: Server failed to process request.");
-        return;
+        perror("bind failed");
+        close(server_fd);
+        return -1;
     }
+    if (listen(server_fd, SOMAXCONN) < 0)
+    {
+        perror("listen failed");
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
 
-    char line[512];
-    bool borrowing_found = false;
+static int serve(int server_fd, int num_workers, int use_uring)
+{
+    return use_uring ? run_uring_loop(server_fd, num_workers) : run_event_loop(server_fd, num_workers);
+}
 
-    while (fgets(line, sizeof(line), original_file))
+// Forks one server per listening socket. The tables and their locks are in
+// shared memory, so all of them see the same data. If any server exits the
+// rest are stopped too: one that died holding a table lock would otherwise
+// leave the others blocked forever. The snapshot, overdue and stats
+// threads run in the parent and are only started after forking, so no
+// child inherits a lock held by a thread it does not have.
+static int run_server_processes(int num_procs, int num_workers, int use_uring, int snapshot_interval,
+                                int stats_interval)
+{
+    int listen_fds[num_procs];
+    pid_t pids[num_procs];
+    for (int i = 0; i < num_procs; i++)
+    {
+        if ((listen_fds[i] = open_listener(1)) < 0)
+        {
+            return -1;
+        }
+    }
+    fflush(stdout);
+    for (int i = 0; i < num_procs; i++)
     {
-        borrowing_t current_borrowing;
-        if (sscanf(line, "%[^|]|%[^|]|%ld", current_borrowing.user_email, current_borrowing.book_title, (long int *)&current_borrowing.due_date_timestamp) == 3)
+        pids[i] = fork();
+        if (pids[i] < 0)
         {
-            if (strcmp(current_borrowing.user_email, user_email) == 0 && strcmp(current_borrowing.book_title, book_title) == 0)
+            perror("fork failed");
+            num_procs = i;
+            break;
+        }
+        if (pids[i] == 0)
+        {
+            for (int j = 0; j < num_procs; j++)
             {
-                borrowing_found = true;
-                time_t current_time = time(NULL);
-                if (current_time > current_borrowing.due_date_timestamp)
+                if (j != i)
                 {
-                    long long fine_in_seconds = current_time - current_borrowing.due_date_timestamp;
-                    int fine_in_days = fine_in_seconds / (24 * 60 * 60);
-                    int fine_amount = fine_in_days * 5;
-                    printf("User '%s' is late returning book '%s'. Fine due: Rs. %d\n", user_email, book_title, fine_amount);
-
-                    int user_type;
-                    int user_index = find_account_by_email(user_email, &user_type);
-                    if (user_index != -1 && user_type == 1)
-                    {
-                        accounts[user_index].data.user.fines_due += fine_amount;
-                    }
-                    snprintf(response, 1024, "Success: Book returned. Fine of Rs. %d due.", fine_amount);
+                    close(listen_fds[j]);
                 }
-                else
-                {
-                    strcpy(response, "Success: Book returned on time. No fine.");
-                }
-
-                int book_index = find_book_by_title(book_title);
-                if (book_index != -1)
-                {
-                    books[book_index].copies++;
-                }
-            }
-            else
-            {
-                fprintf(temp_file, "%s", line);
             }
+            exit(serve(listen_fds[i], num_workers, use_uring) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
     }
-
-    fclose(original_file);
-    fclose(temp_file);
-
-    if (borrowing_found)
+    for (int i = 0; i < num_procs; i++)
     {
-        remove(BORROWINGS_FILE);
-        rename("temp_borrowings.txt", BORROWINGS_FILE);
+        close(listen_fds[i]);
     }
-    else
+    printf("Started %d server processes.\n", num_procs);
+    snapshot_start(snapshot_interval);
+    overdue_start();
+    if (stats_interval > 0)
     {
-        remove("temp_borrowings.txt");
-        strcpy(response, "Error: User has not borrowed this book.");
+        metrics_start_dump(stats_interval);
     }
-}
-
-void handle_client_session(int client_sock)
-{
-    char buffer[1024];
-    char logged_in_email[MAX_EMAIL_LEN] = "";
-    int signed_in = 0;
 
-    while (1)
+    int status;
+    pid_t pid = wait(&status);
+    fprintf(stderr, "Server process %d exited, stopping the others.\n", (int)pid);
+    for (int i = 0; i < num_procs; i++)
     {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(client_sock, buffer, 1024, 0);
-        if (bytes_received <= 0)
+        if (pids[i] != pid)
         {
-            printf("Client disconnected.\n");
-            break;
-        }
-        buffer[bytes_received] = '\0';
-        printf("Client request: %s\n", buffer);
-
-        char command[32];
-        char payload[1024];
-        char response[2048];
-        memset(response, 0, sizeof(response));
-
-        char *pipe_pos = strchr(buffer, '|');
-        if (pipe_pos)
-        {
-            *pipe_pos = '\0';
-            strcpy(command, buffer);
-            strcpy(payload, pipe_pos + 1);
-        }
-        else
-        {
-            strcpy(command, buffer);
-            strcpy(payload, "");
+            kill(pids[i], SIGTERM);
         }
+    }
+    while (wait(NULL) > 0)
+    {
+    }
+    return -1;
+}
 
-        if (strcmp(command, "SIGN_UP") == 0)
-        {
-            handle_sign_up(payload, response);
-        }
-        else if (strcmp(command, "SIGN_IN") == 0)
-        {
-            int logged_in_type;
-            handle_sign_in(payload, response, &logged_in_type, logged_in_email);
-            if (strncmp(response, "Success", 7) == 0)
-            {
-                signed_in = 1;
-            }
-        }
-        else if (strcmp(command, "LOGOUT") == 0)
-        {
-            if (signed_in)
-            {
-                printf("User logged out: %s\n", logged_in_email);
-                signed_in = 0;
-                strcpy(logged_in_email, "");
-                strcpy(response, "Success: Logged out.");
-            }
-            else
-            {
-                strcpy(response, "Error: Not signed in.");
-            }
-        }
-        else if (signed_in)
+int main(int argc, char *argv[])
+{
+    int num_workers = DEFAULT_WORKER_THREADS;
+    int num_procs = 1;
+    int use_uring = 0;
+    int stats_interval = 0;
+    int snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:us:k:f:")) != -1)
+    {
+        switch (opt)
         {
-            if (strcmp(command, "ADD_BOOK") == 0)
-            {
-                handle_add_book(payload, response);
-            }
-            else if (strcmp(command, "REMOVE_BOOK") == 0)
-            {
-                handle_remove_book(payload, response);
-            }
-            else if (strcmp(command, "UPDATE_INFO") == 0)
-            {
-                handle_update_my_info(payload, response, logged_in_email);
-            }
-            else if (strcmp(command, "UPDATE_BOOK") == 0)
-            {
-                handle_update_book(payload, response);
-            }
-            else if (strcmp(command, "CHECK_COPIES") == 0)
+        case 't':
+            num_workers = atoi(optarg);
+            if (num_workers < 1)
             {
-                handle_check_copies(payload, response);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
-            else if (strcmp(command, "COLLECT_PAYMENT") == 0)
-            {
-                handle_collect_payment(payload, response);
-            }
-            else if (strcmp(command, "COLLECT_FINE") == 0)
-            {
-                handle_collect_fine(payload, response);
-            }
-            else if (strcmp(command, "BORROW_BOOK") == 0)
-            {
-                handle_borrow_book(payload, response, logged_in_email);
-            }
-            else if (strcmp(command, "RETURN_BOOK") == 0)
-            {
-                handle_return_book(payload, response);
-            }
-            else if (strcmp(command, "VIEW_USERS") == 0)
+            break;
+        case 'p':
+            num_procs = atoi(optarg);
+            if (num_procs < 1)
             {
-                handle_view_users(response);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
-            else if (strcmp(command, "DELETE_USER") == 0)
+            break;
+        case 'u':
+            use_uring = 1;
+            break;
+        case 's':
+            stats_interval = atoi(optarg);
+            if (stats_interval < 1)
             {
-                handle_delete_user(payload, response);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
-            else if (strcmp(command, "UPDATE_USER_INFO") == 0)
+            break;
+        case 'k':
+            snapshot_interval = atoi(optarg);
+            if (snapshot_interval < 0)
             {
-                handle_update_user_info(payload, response);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
-            else
+            break;
+        case 'f':
+            if (commit_configure(optarg) < 0)
             {
-                strcpy(response, "Error: Unknown command.");
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
         }
-        else
-        {
-            strcpy(response, "Error: Please sign in first.");
-        }
-
-        send(client_sock, response, strlen(response), 0);
-        printf("Server response: %s\n\n", response);
     }
-}
-
-int main()
-{
-    int server_fd, new_socket;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    load_accounts_from_file();
-    load_books_from_file();
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
+    if (shared_arena_init(SHARED_ARENA_SIZE) < 0 || tables_lock_init() < 0 || storage_init() < 0 ||
+        session_tokens_init() < 0 || metrics_init() < 0)
     {
-        perror("socket failed");
         exit(EXIT_FAILURE);
     }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(SERV_PORT);
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    if (storage_load() < 0)
     {
-        perror("bind failed");
         exit(EXIT_FAILURE);
     }
-    if (listen(server_fd, 3) < 0)
+    command_table_init();
+    printf("Commit policy: %s\n", commit_describe());
+
+    int rc;
+    if (num_procs > 1)
     {
-        perror("listen failed");
-        exit(EXIT_FAILURE);
+        printf("Server listening on port %d...\n", SERV_PORT);
+        rc = run_server_processes(num_procs, num_workers, use_uring, snapshot_interval, stats_interval);
     }
-    printf("Server listening on port %d...\n", SERV_PORT);
-    while (1)
+    else
     {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0)
+        int server_fd = open_listener(0);
+        if (server_fd < 0)
         {
-            perror("accept failed");
             exit(EXIT_FAILURE);
         }
-        printf("Connection accepted.\n");
-        handle_client_session(new_socket);
-        close(new_socket);
+        printf("Server listening on port %d...\n", SERV_PORT);
+        snapshot_start(snapshot_interval);
+        overdue_start();
+        if (stats_interval > 0)
+        {
+            metrics_start_dump(stats_interval);
+        }
+        rc = serve(server_fd, num_workers, use_uring);
+    }
+    if (rc < 0)
+    {
+        exit(EXIT_FAILURE);
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "session.h"
+#include "worker_pool.h"
+#include "protocol.h"
+#include "buffer_pool.h"
+
+// Input buffers of the first size, which is all most connections need.
+// Grown ones go back to malloc.
+#define MAX_FREE_INPUT_BUFS 1024
+
+static buffer_pool_t input_bufs = BUFFER_POOL_INIT(REQUEST_BUF_LEN, MAX_FREE_INPUT_BUFS);
+
+void session_free(client_session_t *session)
+{
+    while (session->out_head)
+    {
+        work_item_t *next = session->out_head->next;
+        work_item_free(session->out_head);
+        session->out_head = next;
+    }
+    if (session->in_cap == REQUEST_BUF_LEN)
+    {
+        buffer_pool_put(&input_bufs, session->in_buf);
+    }
+    else
+    {
+        free(session->in_buf);
+    }
+    arena_release(&session->arena);
+    free(session);
+}
+
+void session_queue_response(client_session_t *session, work_item_t *item)
+{
+    arena_reset(&session->arena);
+    frame_put_header(item->header, item->reply.len);
+    item->out_sent = 0;
+    item->next = NULL;
+    if (session->out_tail)
+    {
+        session->out_tail->next = item;
+    }
+    else
+    {
+        session->out_head = item;
+    }
+    session->out_tail = item;
+}
+
+int session_output_iov(client_session_t *session, struct iovec *iov, int max)
+{
+    int count = 0;
+    for (work_item_t *item = session->out_head; item && count + 2 <= max; item = item->next)
+    {
+        size_t sent = item->out_sent;
+        if (sent < FRAME_HEADER_LEN)
+        {
+            iov[count].iov_base = item->header + sent;
+            iov[count].iov_len = FRAME_HEADER_LEN - sent;
+            count++;
+            sent = FRAME_HEADER_LEN;
+        }
+        if (sent - FRAME_HEADER_LEN < item->reply.len)
+        {
+            iov[count].iov_base = item->reply.buf + (sent - FRAME_HEADER_LEN);
+            iov[count].iov_len = item->reply.len - (sent - FRAME_HEADER_LEN);
+            count++;
+        }
+    }
+    return count;
+}
+
+void session_output_sent(client_session_t *session, size_t sent)
+{
+    while (sent > 0 && session->out_head)
+    {
+        work_item_t *item = session->out_head;
+        size_t left = FRAME_HEADER_LEN + item->reply.len - item->out_sent;
+        if (sent < left)
+        {
+            item->out_sent += sent;
+            return;
+        }
+        sent -= left;
+        session->out_head = item->next;
+        if (session->out_head == NULL)
+        {
+            session->out_tail = NULL;
+        }
+        work_item_free(item);
+    }
+}
+
+int session_dispatch_input(client_session_t *session)
+{
+    if (session->busy)
+    {
+        return 0;
+    }
+    size_t avail = session->in_len - session->in_start;
+    if (avail < FRAME_HEADER_LEN)
+    {
+        return 0;
+    }
+    const unsigned char *frame = (const unsigned char *)session->in_buf + session->in_start;
+    uint32_t body_len = frame_get_header(frame);
+    if (body_len > MAX_FRAME_LEN)
+    {
+        fprintf(stderr, "Frame of %u bytes exceeds limit, dropping client.\n", body_len);
+        return -1;
+    }
+    if (avail < FRAME_HEADER_LEN + body_len)
+    {
+        return 0;
+    }
+
+    work_item_t *item = work_item_alloc();
+    char *request = arena_alloc(&session->arena, body_len + 1);
+    if (item == NULL || request == NULL)
+    {
+        perror("Error allocating work item");
+        if (item)
+        {
+            work_item_free(item);
+        }
+        return -1;
+    }
+    memcpy(request, frame + FRAME_HEADER_LEN, body_len);
+    request[body_len] = '\0';
+    item->request = request;
+    item->session = session;
+
+    session->in_start += FRAME_HEADER_LEN + body_len;
+    if (session->in_start == session->in_len)
+    {
+        session->in_start = 0;
+        session->in_len = 0;
+    }
+    session->busy = 1;
+    worker_pool_submit(item);
+    return 0;
+}
+
+int session_drained(const client_session_t *session)
+{
+    return session->read_closed && !session->busy && session->out_head == NULL;
+}
+
+size_t session_reserve_input(client_session_t *session, size_t want)
+{
+    if (session->in_start > 0 && session->in_cap - session->in_len < want)
+    {
+        memmove(session->in_buf, session->in_buf + session->in_start,
+                session->in_len - session->in_start);
+        session->in_len -= session->in_start;
+        session->in_start = 0;
+    }
+    while (session->in_cap - session->in_len < want)
+    {
+        if (session->in_cap >= MAX_SESSION_INPUT)
+        {
+            return 0;
+        }
+        size_t new_cap = session->in_cap ? session->in_cap * 2 : REQUEST_BUF_LEN;
+        char *new_buf = session->in_cap ? realloc(session->in_buf, new_cap) : buffer_pool_get(&input_bufs);
+        if (new_buf == NULL)
+        {
+            return 0;
+        }
+        session->in_buf = new_buf;
+        session->in_cap = new_cap;
+    }
+    return session->in_cap - session->in_len;
+}
\ No newline at end of file
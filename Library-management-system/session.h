@@ -0,0 +1,101 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "types.h"
+#include "arena.h"
+#include "session_tokens.h"
+
+// A connection's first input buffer, pooled (see session.c). It holds a
+// whole io_uring receive (URING_BUF_SIZE) with room to spare, so most
+// connections never grow it.
+#define REQUEST_BUF_LEN 8192
+#define RESPONSE_BUF_LEN 2048
+
+// Input buffered per connection before the loop stops reading from it.
+// Must hold at least one maximum-size frame.
+#define MAX_SESSION_INPUT (4 * 1024 * 1024)
+
+// Most buffers handed to the kernel in one vectored write.
+#define OUT_IOV_MAX 32
+
+struct work_item;
+
+// Per-connection state. This used to live in locals of handle_client_session,
+// now it is owned by the event loop so one process can serve many clients.
+typedef struct client_session
+{
+    int fd;
+    int signed_in;
+    int logged_in_type;
+    char logged_in_email[MAX_EMAIL_LEN];
+    char token[SESSION_TOKEN_LEN + 1]; // from SIGN_IN or RESUME; empty if none
+
+    // Set while a worker thread owns the session. Requests on one connection
+    // run one at a time, in order.
+    int busy;
+    int closing;
+    // The peer has shut down its side (recv returned 0). Frames already
+    // received are still answered; the connection closes once they are.
+    int read_closed;
+    struct client_session *next_closed;
+
+    // Received bytes not yet dispatched live in in_buf[in_start, in_len).
+    // Several pipelined frames may be waiting here.
+    char *in_buf;
+    size_t in_start;
+    size_t in_len;
+    size_t in_cap;
+
+    // Memory for the request being run: its body, parsed in place, and any
+    // scratch space its handler takes. Reset when the reply is queued.
+    arena_t arena;
+
+    // Answered requests waiting to be written, oldest first. Each reply is
+    // sent straight from its work item (frame header plus body, gathered
+    // with a vectored write) and the item is freed once fully sent.
+    struct work_item *out_head;
+    struct work_item *out_tail;
+
+    // io_uring loop only: a send is in flight (using out_iov and out_msg),
+    // a recv is armed, and how many submitted operations have not
+    // completed yet.
+    int sending;
+    int recv_armed;
+    int pending_ops;
+    struct iovec out_iov[OUT_IOV_MAX];
+    struct msghdr out_msg;
+} client_session_t;
+
+// Buffer handling shared by the event loops.
+
+void session_free(client_session_t *session);
+
+// Queues a finished item's reply for sending; the session now owns it.
+// The request's arena memory is freed.
+void session_queue_response(client_session_t *session, struct work_item *item);
+
+// Fills iov with the unsent output, at most max entries. Returns the
+// number used (0 when there is nothing to send).
+int session_output_iov(client_session_t *session, struct iovec *iov, int max);
+
+// Marks sent bytes of output as done, freeing replies that are complete.
+void session_output_sent(client_session_t *session, size_t sent);
+
+// Hands the next complete frame, if any, to the worker pool. Returns -1 on
+// a protocol error.
+int session_dispatch_input(client_session_t *session);
+
+// True once a read-closed session has nothing left to do: no request
+// running, none complete in the buffer and no reply unsent. Bytes of an
+// unfinished frame can never be completed, so they do not count.
+int session_drained(const client_session_t *session);
+
+// Makes room for at least want more input bytes: compacts consumed bytes,
+// then grows the buffer. Returns the free space, or 0 when that would take
+// more than MAX_SESSION_INPUT bytes.
+size_t session_reserve_input(client_session_t *session, size_t want);
+
+#endif // SESSION_H
\ No newline at end of file
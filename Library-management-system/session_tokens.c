@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+
+#include "session_tokens.h"
+#include "config.h"
+#include "storage.h"
+#include "shared_mem.h"
+
+#define SECRET_LEN 16
+#define RANDOM_BUF_LEN (64 * SECRET_LEN)
+
+typedef struct
+{
+    unsigned char secret[SECRET_LEN];
+    int account; // -1 while the row is free
+    uint32_t password_generation; // the account's when the token was issued
+    int next_free;
+    timer_link_t timer;
+} token_row_t;
+
+typedef struct
+{
+    table_t *rows;
+    int free_row; // first free row, or -1
+    timer_wheel_t *wheel;
+} token_state_t;
+
+static token_state_t *state = NULL;
+
+// Random bytes drawn ahead, so that issuing a token under the lock costs
+// a system call only once in 64. Per thread, and worker threads start
+// after the fork, so no two processes hand out the same bytes.
+static __thread unsigned char random_buf[RANDOM_BUF_LEN];
+static __thread int random_left = 0;
+
+static int take_random(unsigned char *out)
+{
+    if (random_left == 0)
+    {
+        if (getrandom(random_buf, RANDOM_BUF_LEN, 0) != RANDOM_BUF_LEN)
+        {
+            perror("Error reading random bytes for a session token");
+            return -1;
+        }
+        random_left = RANDOM_BUF_LEN;
+    }
+    random_left -= SECRET_LEN;
+    memcpy(out, random_buf + random_left, SECRET_LEN);
+    memset(random_buf + random_left, 0, SECRET_LEN);
+    return 0;
+}
+
+static token_row_t *token_row(int row)
+{
+    return table_row(state->rows, row);
+}
+
+static timer_link_t *token_timer(int row)
+{
+    return &token_row(row)->timer;
+}
+
+int session_tokens_init(void)
+{
+    state = shared_alloc(sizeof(*state));
+    if (state == NULL)
+    {
+        return -1;
+    }
+    state->rows = table_create(sizeof(token_row_t));
+    state->free_row = -1;
+    state->wheel = timer_wheel_create(time(NULL), token_timer);
+    return state->rows && state->wheel ? 0 : -1;
+}
+
+static void release_row(int row, void *arg)
+{
+    token_row_t *entry = token_row(row);
+    timer_wheel_cancel(state->wheel, row);
+    memset(entry->secret, 0, SECRET_LEN);
+    entry->account = -1;
+    entry->next_free = state->free_row;
+    state->free_row = row;
+}
+
+// Frees the rows of every token that has lapsed by now.
+static void expire(time_t now)
+{
+    timer_wheel_advance(state->wheel, now, release_row, NULL);
+}
+
+int session_token_issue(int account_row, char *token)
+{
+    time_t now = time(NULL);
+    expire(now);
+    unsigned char secret[SECRET_LEN];
+    if (take_random(secret) < 0)
+    {
+        return -1;
+    }
+    int row = state->free_row;
+    if (row != -1)
+    {
+        state->free_row = token_row(row)->next_free;
+    }
+    else
+    {
+        row = table_append(state->rows);
+        if (row < 0)
+        {
+            return -1;
+        }
+        timer_wheel_init_link(token_timer(row));
+    }
+    token_row_t *entry = token_row(row);
+    memcpy(entry->secret, secret, SECRET_LEN);
+    entry->account = account_row;
+    entry->password_generation = account_ledger(account_row)->password_generation;
+    timer_wheel_add(state->wheel, row, now + SESSION_TOKEN_SECONDS);
+
+    static const char digits[] = "0123456789abcdef";
+    unsigned char bytes[SESSION_TOKEN_LEN / 2] = {row >> 24, row >> 16, row >> 8, row};
+    memcpy(bytes + 4, secret, SECRET_LEN);
+    for (int i = 0; i < SESSION_TOKEN_LEN / 2; i++)
+    {
+        token[2 * i] = digits[bytes[i] >> 4];
+        token[2 * i + 1] = digits[bytes[i] & 15];
+    }
+    token[SESSION_TOKEN_LEN] = '\0';
+    return 0;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// The row a token names if its secret matches, or -1. The secret is
+// compared in full whatever the first difference, so the time taken does
+// not tell how much of a guess was right.
+static int find_token(const char *token)
+{
+    if (strlen(token) != SESSION_TOKEN_LEN)
+    {
+        return -1;
+    }
+    unsigned char bytes[SESSION_TOKEN_LEN / 2];
+    for (int i = 0; i < SESSION_TOKEN_LEN / 2; i++)
+    {
+        int high = hex_digit(token[2 * i]);
+        int low = hex_digit(token[2 * i + 1]);
+        if (high < 0 || low < 0)
+        {
+            return -1;
+        }
+        bytes[i] = (unsigned char)(high << 4 | low);
+    }
+    uint32_t row = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+    if (row >= (uint32_t)state->rows->count || token_row(row)->account == -1)
+    {
+        return -1;
+    }
+    const unsigned char *secret = token_row(row)->secret;
+    unsigned char diff = 0;
+    for (int i = 0; i < SECRET_LEN; i++)
+    {
+        diff |= secret[i] ^ bytes[4 + i];
+    }
+    return diff == 0 ? (int)row : -1;
+}
+
+int session_token_resume(const char *token)
+{
+    time_t now = time(NULL);
+    expire(now);
+    int row = find_token(token);
+    if (row == -1)
+    {
+        return -1;
+    }
+    token_row_t *entry = token_row(row);
+    if (entry->password_generation != account_ledger(entry->account)->password_generation)
+    {
+        release_row(row, NULL);
+        return -1;
+    }
+    timer_wheel_add(state->wheel, row, now + SESSION_TOKEN_SECONDS);
+    return entry->account;
+}
+
+void session_token_revoke(const char *token)
+{
+    int row = find_token(token);
+    if (row != -1)
+    {
+        release_row(row, NULL);
+    }
+}
\ No newline at end of file
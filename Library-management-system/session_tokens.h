@@ -0,0 +1,33 @@
+#ifndef SESSION_TOKENS_H
+#define SESSION_TOKENS_H
+
+// Tokens that let a client come back on a new connection without signing
+// in again. SIGN_IN issues one and RESUME trades it for the account it
+// was issued to. A token is the number of its row in a shared table
+// followed by a random secret, so RESUME goes straight to the row and
+// compares the secret; nothing is searched. A token lapses
+// SESSION_TOKEN_SECONDS (config.h) after it was issued or last used, is
+// revoked by LOGOUT, and stops working once the account's password
+// changes. Lapsed rows are freed by a timer wheel (timer_wheel.h) that
+// moves on with each call. Tokens are kept in memory only, so a restart
+// ends all of them.
+//
+// Every call needs the sessions write lock and the accounts read lock.
+#define SESSION_TOKEN_LEN 40 // 8 hex digits of row, then 32 of secret
+
+// Sets up the table in the shared arena. Call before forking.
+int session_tokens_init(void);
+
+// Issues a token for the account in account_row, writing it to token
+// (SESSION_TOKEN_LEN + 1 bytes). Returns -1 if no random bytes could be
+// had or the arena is out of memory.
+int session_token_issue(int account_row, char *token);
+
+// The account row a token was issued for, or -1 if it is unknown, lapsed
+// or revoked. Restarts the token's lifetime.
+int session_token_resume(const char *token);
+
+// Ends a token; a no-op if it is not valid.
+void session_token_revoke(const char *token);
+
+#endif // SESSION_TOKENS_H
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "shared_mem.h"
+
+#define SHARED_ALIGN 64
+
+// Lives at the start of the arena so every process bumps the same offset.
+typedef struct
+{
+    size_t size;
+    size_t used;
+} arena_header_t;
+
+static arena_header_t *arena = NULL;
+
+int shared_arena_init(size_t size)
+{
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        perror("Error mapping shared memory");
+        return -1;
+    }
+    arena = base;
+    arena->size = size;
+    arena->used = (sizeof(arena_header_t) + SHARED_ALIGN - 1) & ~(size_t)(SHARED_ALIGN - 1);
+    return 0;
+}
+
+void *shared_alloc(size_t size)
+{
+    size = (size + SHARED_ALIGN - 1) & ~(size_t)(SHARED_ALIGN - 1);
+    size_t offset = __atomic_fetch_add(&arena->used, size, __ATOMIC_RELAXED);
+    if (offset + size > arena->size)
+    {
+        fprintf(stderr, "Shared memory exhausted.\n");
+        return NULL;
+    }
+    // Fresh anonymous pages are already zero.
+    return (char *)arena + offset;
+}
\ No newline at end of file
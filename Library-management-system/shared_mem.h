@@ -0,0 +1,19 @@
+#ifndef SHARED_MEM_H
+#define SHARED_MEM_H
+
+#include <stddef.h>
+
+// Address space reserved for state shared by all server processes. Pages
+// are only backed once touched, so this only bounds how far the tables
+// can grow.
+#define SHARED_ARENA_SIZE ((size_t)1 << 36)
+
+// Maps the shared arena. Must run before the server forks so that every
+// process sees it at the same address and can follow pointers into it.
+int shared_arena_init(size_t size);
+
+// Returns zeroed, 64-byte aligned memory from the arena, or NULL once it is
+// exhausted. Safe to call from any process or thread; nothing is freed.
+void *shared_alloc(size_t size);
+
+#endif // SHARED_MEM_H
\ No newline at end of file
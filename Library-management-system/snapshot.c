@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "storage.h"
+#include "locks.h"
+#include "wal.h"
+#include "metrics.h"
+
+#define SNAPSHOT_MAGIC "LMSSNAP2"
+// Written before fines accrued day by day; it has no accrued_days array.
+#define SNAPSHOT_MAGIC_V1 "LMSSNAP1"
+#define ALL_TABLES (LOCK_ACCOUNTS | LOCK_BOOKS | LOCK_BORROWINGS)
+
+typedef struct
+{
+    char magic[8];
+    uint32_t wal_seq; // first segment not covered
+    int32_t account_count;
+    int32_t book_count; // always 0 now that books have their own store
+    int32_t borrowing_count;
+    uint32_t crc; // of the arrays that follow
+} snapshot_header_t;
+
+// The tables as flat arrays, the way they are written.
+typedef struct
+{
+    account_t *accounts;
+    int account_count;
+    borrowing_t *borrowings;
+    int32_t *accrued_days; // per borrowing, see overdue.h
+    int borrowing_count;
+} snapshot_copy_t;
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Copies the borrowings one user at a time, each user's oldest first, so
+// that adding them back in this order rebuilds the same user lists.
+static void copy_borrowings(borrowing_t *dest, int32_t *accrued_days)
+{
+    int n = 0;
+    for (int row = 0; row < tables->borrowings->count; row++)
+    {
+        const borrowing_row_t *entry = borrowing_row(row);
+        if (!entry->in_use || first_borrowing(BORROWINGS_BY_USER, entry->borrowing.user_email) != row)
+        {
+            continue;
+        }
+        for (int i = row; i != -1; i = next_borrowing(BORROWINGS_BY_USER, i))
+        {
+            accrued_days[n] = borrowing_row(i)->accrued_days;
+            dest[n++] = *borrowing_at(i);
+        }
+    }
+}
+
+static int write_snapshot(const snapshot_copy_t *copy, unsigned seq)
+{
+    snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.wal_seq = seq;
+    header.account_count = copy->account_count;
+    header.borrowing_count = copy->borrowing_count;
+    size_t accounts_len = (size_t)copy->account_count * sizeof(account_t);
+    size_t borrowings_len = (size_t)copy->borrowing_count * sizeof(borrowing_t);
+    size_t accrued_len = (size_t)copy->borrowing_count * sizeof(int32_t);
+    header.crc = wal_crc32(0, copy->accounts, accounts_len);
+    header.crc = wal_crc32(header.crc, copy->borrowings, borrowings_len);
+    header.crc = wal_crc32(header.crc, copy->accrued_days, accrued_len);
+
+    const char *temp_path = SNAPSHOT_FILE ".tmp";
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("Error creating snapshot");
+        return -1;
+    }
+    // The log segments are deleted once this returns, so the snapshot has
+    // to be on disk, under its final name, first.
+    if (write_all(fd, &header, sizeof(header)) < 0 || write_all(fd, copy->accounts, accounts_len) < 0 ||
+        write_all(fd, copy->borrowings, borrowings_len) < 0 ||
+        write_all(fd, copy->accrued_days, accrued_len) < 0 || fsync(fd) < 0)
+    {
+        perror("Error writing snapshot");
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(temp_path, SNAPSHOT_FILE) < 0)
+    {
+        perror("Error replacing snapshot");
+        unlink(temp_path);
+        return -1;
+    }
+    int dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+int snapshot_take(void)
+{
+    uint64_t started = metrics_now_ns();
+    snapshot_copy_t copy;
+    tables_lock(ALL_TABLES, 0);
+    copy.account_count = tables->accounts->count;
+    copy.borrowing_count = tables->borrowing_count;
+    copy.accounts = malloc((size_t)copy.account_count * sizeof(account_t) + 1);
+    copy.borrowings = malloc((size_t)copy.borrowing_count * sizeof(borrowing_t) + 1);
+    copy.accrued_days = malloc((size_t)copy.borrowing_count * sizeof(int32_t) + 1);
+    if (copy.accounts == NULL || copy.borrowings == NULL || copy.accrued_days == NULL)
+    {
+        tables_unlock(ALL_TABLES);
+        perror("Error allocating snapshot");
+        free(copy.accounts);
+        free(copy.borrowings);
+        free(copy.accrued_days);
+        return -1;
+    }
+    table_copy_out(tables->accounts, copy.accounts, copy.account_count);
+    copy_borrowings(copy.borrowings, copy.accrued_days);
+    unsigned seq = wal_rotate();
+    tables_unlock(ALL_TABLES);
+
+    // Books are not in the snapshot, but get to disk at the same point.
+    int rc = book_store_sync();
+    if (rc == 0)
+    {
+        rc = write_snapshot(&copy, seq);
+    }
+    free(copy.accounts);
+    free(copy.borrowings);
+    free(copy.accrued_days);
+    if (rc == 0)
+    {
+        wal_remove_before(seq);
+    }
+    metrics_record_write(METRIC_FILE_SNAPSHOT, rc < 0, metrics_now_ns() - started);
+    return rc;
+}
+
+long snapshot_load(int *had_books)
+{
+    *had_books = 0;
+    FILE *file = fopen(SNAPSHOT_FILE, "rb");
+    if (file == NULL)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        perror("Error opening snapshot");
+        return -1;
+    }
+    snapshot_header_t header;
+    uint32_t crc = 0;
+    account_t *accounts = NULL;
+    book_t *books = NULL;
+    borrowing_t *borrowings = NULL;
+    int32_t *accrued_days = NULL;
+    int version = 0;
+    int ok = fread(&header, sizeof(header), 1, file) == 1;
+    if (ok && memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0)
+    {
+        version = 2;
+    }
+    else if (ok && memcmp(header.magic, SNAPSHOT_MAGIC_V1, sizeof(header.magic)) == 0)
+    {
+        version = 1;
+    }
+    ok = version > 0 && header.wal_seq > 0 && header.account_count >= 0 && header.book_count >= 0 &&
+         header.borrowing_count >= 0 &&
+         (accounts = malloc((size_t)header.account_count * sizeof(account_t) + 1)) != NULL &&
+         (books = malloc((size_t)header.book_count * sizeof(book_t) + 1)) != NULL &&
+         (borrowings = malloc((size_t)header.borrowing_count * sizeof(borrowing_t) + 1)) != NULL &&
+         (accrued_days = calloc((size_t)header.borrowing_count + 1, sizeof(int32_t))) != NULL &&
+         fread(accounts, sizeof(account_t), header.account_count, file) == (size_t)header.account_count &&
+         fread(books, sizeof(book_t), header.book_count, file) == (size_t)header.book_count &&
+         fread(borrowings, sizeof(borrowing_t), header.borrowing_count, file) == (size_t)header.borrowing_count &&
+         (version == 1 ||
+          fread(accrued_days, sizeof(int32_t), header.borrowing_count, file) == (size_t)header.borrowing_count);
+    fclose(file);
+    if (ok)
+    {
+        crc = wal_crc32(0, accounts, (size_t)header.account_count * sizeof(account_t));
+        crc = wal_crc32(crc, books, (size_t)header.book_count * sizeof(book_t));
+        crc = wal_crc32(crc, borrowings, (size_t)header.borrowing_count * sizeof(borrowing_t));
+        if (version == 2)
+        {
+            crc = wal_crc32(crc, accrued_days, (size_t)header.borrowing_count * sizeof(int32_t));
+        }
+    }
+    if (!ok || crc != header.crc)
+    {
+        fprintf(stderr, "Snapshot %s is damaged; refusing to start without it.\n", SNAPSHOT_FILE);
+        free(accounts);
+        free(books);
+        free(borrowings);
+        free(accrued_days);
+        return -1;
+    }
+    ok = table_copy_in(tables->accounts, accounts, header.account_count) == 0;
+    for (int i = 0; ok && i < header.borrowing_count; i++)
+    {
+        int row = add_borrowing(&borrowings[i]);
+        if (row < 0)
+        {
+            ok = 0;
+            break;
+        }
+        borrowing_row(row)->accrued_days = accrued_days[i];
+    }
+    free(accounts);
+    free(borrowings);
+    free(accrued_days);
+    if (!ok)
+    {
+        free(books);
+        return -1;
+    }
+    if (header.book_count > 0)
+    {
+        // Written before books had their own store; this copy is newer
+        // than anything already in it.
+        book_store_clear();
+        for (int i = 0; i < header.book_count; i++)
+        {
+            book_store_add(&books[i]);
+        }
+        *had_books = 1;
+    }
+    free(books);
+    printf("Loaded snapshot: %d accounts, %d borrowings.\n", tables->accounts->count, tables->borrowing_count);
+    return header.wal_seq;
+}
+
+static void *snapshot_main(void *arg)
+{
+    int interval = *(int *)arg;
+    free(arg);
+    int elapsed = 0;
+    while (1)
+    {
+        sleep(1);
+        elapsed++;
+        uint64_t logged = wal_segment_bytes();
+        if (logged >= SNAPSHOT_LOG_BYTES || elapsed >= interval)
+        {
+            if (logged > 0)
+            {
+                snapshot_take();
+            }
+            elapsed = 0;
+        }
+    }
+    return NULL;
+}
+
+int snapshot_start(int interval)
+{
+    if (interval == 0)
+    {
+        return 0;
+    }
+    int *arg = malloc(sizeof(*arg));
+    if (arg == NULL)
+    {
+        perror("Error starting snapshots");
+        return -1;
+    }
+    *arg = interval;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, snapshot_main, arg) != 0)
+    {
+        perror("Error starting snapshots");
+        free(arg);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
\ No newline at end of file
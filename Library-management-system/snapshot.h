@@ -0,0 +1,34 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// A snapshot is a checksummed binary image of the accounts and borrowings
+// tables, with the days of fine charged so far on each borrowing, plus
+// the number of the first log segment it does not cover. Restart loads it
+// and replays only the segments from there on, so restart time depends on
+// recent traffic, not on total history.
+#define SNAPSHOT_FILE "library.snap"
+
+// Seconds between snapshots (override with `server -k N`), and the log
+// size that triggers one early.
+#define DEFAULT_SNAPSHOT_INTERVAL 60
+#define SNAPSHOT_LOG_BYTES (16 * 1024 * 1024)
+
+// Loads SNAPSHOT_FILE into the tables. Returns the first segment to
+// replay, 0 if there is no snapshot, or -1 if it is unreadable. Snapshots
+// from older versions also hold the books; those replace the contents of
+// the book store and set *had_books.
+long snapshot_load(int *had_books);
+
+// Copies the tables under read locks (writers wait only for the copy),
+// starts a new log segment, syncs the book store, writes the copy out and
+// deletes the segments it covers. Returns -1 if the snapshot could not be
+// written.
+int snapshot_take(void);
+
+// Starts a thread that takes a snapshot every interval seconds, or sooner
+// once the log reaches SNAPSHOT_LOG_BYTES, whenever anything was logged.
+// An interval of 0 takes none, so the log only grows; that is for
+// measuring restart time without snapshots.
+int snapshot_start(int interval);
+
+#endif // SNAPSHOT_H
\ No newline at end of file
@@ -0,0 +1,950 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "storage.h"
+#include "locks.h"
+#include "shared_mem.h"
+#include "metrics.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "hash_index.h"
+#include "overdue.h"
+#include "text_scan.h"
+#include "payment.h"
+
+shared_tables_t *tables = NULL;
+
+// Account rows by email. Set up before forking, so every process has the
+// same pointer into the arena.
+static hash_index_t *email_index = NULL;
+
+// First row of each user's and each title's borrowing list, by
+// BORROWINGS_BY_*.
+static hash_index_t *borrowing_heads[2];
+
+// Log record types. Each names its row by the key it had before the
+// change, so replay finds the same row the handler changed. Book records
+// are only written by older versions; replay still applies them to the
+// book store.
+enum
+{
+    WAL_USER_PUT = 1,
+    WAL_BOOK_PUT,
+    WAL_BOOK_DELETE,
+    WAL_BORROWING_ADD,
+    WAL_BORROWING_DELETE,
+    WAL_BORROWING_ACCRUE
+};
+
+typedef struct
+{
+    char old_email[MAX_EMAIL_LEN]; // empty for a new user
+    user_t user;
+} wal_user_put_t;
+
+typedef struct
+{
+    char old_title[MAX_TITLE_LEN]; // empty for a new book
+    book_t book;
+} wal_book_put_t;
+
+typedef struct
+{
+    char title[MAX_TITLE_LEN];
+} wal_book_delete_t;
+
+typedef struct
+{
+    char user_email[MAX_EMAIL_LEN];
+    char book_title[MAX_TITLE_LEN];
+} wal_borrowing_delete_t;
+
+// The fine of a borrowing was brought up to days; the user's fines_due
+// went up by the difference.
+typedef struct
+{
+    borrowing_t borrowing;
+    int32_t days;
+} wal_borrowing_accrue_t;
+
+// Bytes waiting to be appended to one file: log records or payment
+// records.
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+} pending_lines_t;
+
+// Per process: they only hold anything between a handler's change and the
+// storage_flush() that ends the same lock hold. Log records are kept per
+// table so that handlers holding different table locks never share one.
+static pending_lines_t pending_users;
+static pending_lines_t pending_borrowings;
+static pending_lines_t pending_payments;
+
+// STORAGE_* files this thread wrote to since storage_take_unsynced().
+static __thread int unsynced_files;
+
+static int pending_reserve(pending_lines_t *pending, size_t extra)
+{
+    if (pending->len + extra <= pending->cap)
+    {
+        return 0;
+    }
+    size_t new_cap = pending->cap ? pending->cap : 1024;
+    while (new_cap < pending->len + extra)
+    {
+        new_cap *= 2;
+    }
+    char *new_buf = realloc(pending->buf, new_cap);
+    if (new_buf == NULL)
+    {
+        perror("Error buffering record");
+        return -1;
+    }
+    pending->buf = new_buf;
+    pending->cap = new_cap;
+    return 0;
+}
+
+static void pending_record(pending_lines_t *pending, int type, const void *payload, size_t len)
+{
+    if (pending_reserve(pending, WAL_RECORD_SIZE(len)) == 0)
+    {
+        wal_encode(pending->buf + pending->len, type, payload, len);
+        pending->len += WAL_RECORD_SIZE(len);
+    }
+}
+
+static const char *account_email(int row)
+{
+    const account_t *account = account_at(row);
+    return account->type == 0 ? account->data.member.email : account->data.user.email;
+}
+
+static const char *borrowing_user(int row)
+{
+    return borrowing_at(row)->user_email;
+}
+
+static const char *borrowing_title(int row)
+{
+    return borrowing_at(row)->book_title;
+}
+
+int storage_init(void)
+{
+    tables = shared_alloc(sizeof(*tables));
+    if (tables == NULL)
+    {
+        return -1;
+    }
+    tables->accounts = table_create(sizeof(account_t));
+    tables->ledgers = table_create(sizeof(account_ledger_t));
+    tables->borrowings = table_create(sizeof(borrowing_row_t));
+    tables->free_borrowing = -1;
+    if (overdue_init() < 0 || payment_ledger_init() < 0)
+    {
+        return -1;
+    }
+    email_index = hash_index_create(TABLE_CHUNK_ROWS, account_email);
+    borrowing_heads[BORROWINGS_BY_USER] = hash_index_create(TABLE_CHUNK_ROWS, borrowing_user);
+    borrowing_heads[BORROWINGS_BY_TITLE] = hash_index_create(TABLE_CHUNK_ROWS, borrowing_title);
+    return tables->accounts && tables->ledgers && tables->borrowings && email_index &&
+                   borrowing_heads[BORROWINGS_BY_USER] && borrowing_heads[BORROWINGS_BY_TITLE]
+               ? 0
+               : -1;
+}
+
+int find_account_by_email(const char *email, int *account_type)
+{
+    int index = hash_index_find(email_index, email);
+    *account_type = index == -1 ? -1 : account_at(index)->type;
+    return index;
+}
+
+// Files a row under its email. If older data files hold the same email
+// twice, the first row keeps it, as the scan this replaced did.
+static int index_account(int row)
+{
+    if (hash_index_find(email_index, account_email(row)) != -1)
+    {
+        return 0;
+    }
+    return hash_index_insert(email_index, row);
+}
+
+static int append_account_ledger(void)
+{
+    int row = table_append(tables->ledgers);
+    if (row < 0)
+    {
+        return -1;
+    }
+    account_ledger_t *totals = account_ledger(row);
+    totals->last[PAYMENT_FEE] = -1;
+    totals->last[PAYMENT_FINE] = -1;
+    return row;
+}
+
+int add_account(const account_t *account)
+{
+    int row = table_append(tables->accounts);
+    if (row < 0)
+    {
+        return -1;
+    }
+    *account_at(row) = *account;
+    if (index_account(row) < 0)
+    {
+        table_remove(tables->accounts, row);
+        return -1;
+    }
+    if (append_account_ledger() < 0)
+    {
+        hash_index_remove(email_index, account_email(row), row);
+        table_remove(tables->accounts, row);
+        return -1;
+    }
+    return row;
+}
+
+void account_email_changed(const char *old_email, int index)
+{
+    if (strcmp(old_email, account_email(index)) != 0)
+    {
+        hash_index_remove(email_index, old_email, index);
+        index_account(index);
+    }
+}
+
+void account_set_password(int index, const char *password)
+{
+    user_t *user = &account_at(index)->data.user;
+    if (strcmp(user->password, password) != 0)
+    {
+        strcpy(user->password, password);
+        account_ledger(index)->password_generation++;
+    }
+}
+
+static const char *borrowing_key(int list, int row)
+{
+    return list == BORROWINGS_BY_USER ? borrowing_user(row) : borrowing_title(row);
+}
+
+// Appends a row to the end of its list for one key.
+static int link_borrowing(int list, int row)
+{
+    borrowing_link_t *link = &borrowing_row(row)->links[list];
+    int first = hash_index_find(borrowing_heads[list], borrowing_key(list, row));
+    link->next = -1;
+    if (first == -1)
+    {
+        link->prev = row;
+        return hash_index_insert(borrowing_heads[list], row);
+    }
+    borrowing_link_t *first_link = &borrowing_row(first)->links[list];
+    link->prev = first_link->prev;
+    borrowing_row(first_link->prev)->links[list].next = row;
+    first_link->prev = row;
+    return 0;
+}
+
+static void unlink_borrowing(int list, int row)
+{
+    const borrowing_link_t *link = &borrowing_row(row)->links[list];
+    int next = link->next;
+    int prev = link->prev;
+    if (borrowing_row(prev)->links[list].next != row)
+    {
+        // The first row: prev is the last one, whose next is -1.
+        hash_index_remove(borrowing_heads[list], borrowing_key(list, row), row);
+        if (next != -1)
+        {
+            borrowing_row(next)->links[list].prev = prev;
+            hash_index_insert(borrowing_heads[list], next);
+        }
+        return;
+    }
+    borrowing_row(prev)->links[list].next = next;
+    if (next != -1)
+    {
+        borrowing_row(next)->links[list].prev = prev;
+    }
+    else
+    {
+        int first = hash_index_find(borrowing_heads[list], borrowing_key(list, row));
+        borrowing_row(first)->links[list].prev = prev;
+    }
+}
+
+static void free_borrowing_row(int row)
+{
+    borrowing_row_t *entry = borrowing_row(row);
+    memset(entry, 0, sizeof(*entry));
+    entry->links[0].next = tables->free_borrowing;
+    tables->free_borrowing = row;
+}
+
+int add_borrowing(const borrowing_t *borrowing)
+{
+    int row = tables->free_borrowing;
+    if (row != -1)
+    {
+        tables->free_borrowing = borrowing_row(row)->links[0].next;
+    }
+    else if ((row = table_append(tables->borrowings)) < 0)
+    {
+        return -1;
+    }
+    borrowing_row_t *entry = borrowing_row(row);
+    entry->borrowing = *borrowing;
+    entry->in_use = 1;
+    if (link_borrowing(BORROWINGS_BY_USER, row) < 0)
+    {
+        free_borrowing_row(row);
+        return -1;
+    }
+    if (link_borrowing(BORROWINGS_BY_TITLE, row) < 0)
+    {
+        unlink_borrowing(BORROWINGS_BY_USER, row);
+        free_borrowing_row(row);
+        return -1;
+    }
+    overdue_track(row);
+    tables->borrowing_count++;
+    return row;
+}
+
+void remove_borrowing(int row)
+{
+    overdue_untrack(row);
+    unlink_borrowing(BORROWINGS_BY_USER, row);
+    unlink_borrowing(BORROWINGS_BY_TITLE, row);
+    free_borrowing_row(row);
+    tables->borrowing_count--;
+}
+
+int first_borrowing(int list, const char *key)
+{
+    return hash_index_find(borrowing_heads[list], key);
+}
+
+int next_borrowing(int list, int row)
+{
+    return borrowing_row(row)->links[list].next;
+}
+
+int count_borrowings(int list, const char *key)
+{
+    int count = 0;
+    for (int row = first_borrowing(list, key); row != -1; row = next_borrowing(list, row))
+    {
+        count++;
+    }
+    return count;
+}
+
+static int loans_of_title(const char *title)
+{
+    return count_borrowings(BORROWINGS_BY_TITLE, title);
+}
+
+int find_borrowing(const char *user_email, const char *book_title)
+{
+    for (int row = first_borrowing(BORROWINGS_BY_USER, user_email); row != -1;
+         row = next_borrowing(BORROWINGS_BY_USER, row))
+    {
+        if (strcmp(borrowing_at(row)->book_title, book_title) == 0)
+        {
+            return row;
+        }
+    }
+    return -1;
+}
+
+// The borrowing with this user, title and due date, as an accrual record
+// names it.
+static int find_borrowing_due(const borrowing_t *borrowing)
+{
+    for (int row = first_borrowing(BORROWINGS_BY_USER, borrowing->user_email); row != -1;
+         row = next_borrowing(BORROWINGS_BY_USER, row))
+    {
+        const borrowing_t *candidate = borrowing_at(row);
+        if (strcmp(candidate->book_title, borrowing->book_title) == 0 &&
+            candidate->due_date_timestamp == borrowing->due_date_timestamp)
+        {
+            return row;
+        }
+    }
+    return -1;
+}
+
+// Member lines are name|email|phone|password.
+static int parse_member(const text_field_t *fields, int count, member_t *member)
+{
+    return count >= 4 && text_field_copy(member->name, sizeof(member->name), fields[0]) == 0 &&
+                   text_field_copy(member->email, sizeof(member->email), fields[1]) == 0 &&
+                   text_field_copy(member->phone, sizeof(member->phone), fields[2]) == 0 &&
+                   text_field_copy(member->password, sizeof(member->password), fields[3]) == 0
+               ? 0
+               : -1;
+}
+
+// User lines add payment_due and fines_due; older ones stop after
+// payment_due or even after the password.
+static int parse_user(const text_field_t *fields, int count, user_t *user)
+{
+    if (count < 4 || text_field_copy(user->name, sizeof(user->name), fields[0]) < 0 ||
+        text_field_copy(user->email, sizeof(user->email), fields[1]) < 0 ||
+        text_field_copy(user->phone, sizeof(user->phone), fields[2]) < 0 ||
+        text_field_copy(user->password, sizeof(user->password), fields[3]) < 0)
+    {
+        return -1;
+    }
+    // As with sscanf, fines_due is only read if payment_due is a number
+    // right up to its `|`.
+    if (count > 4 && text_field_int(fields[4], &user->payment_due) == 0 && count > 5)
+    {
+        text_field_int(fields[5], &user->fines_due);
+    }
+    return 0;
+}
+
+static void load_accounts_of_type(const char *path, int type)
+{
+    text_file_t file;
+    if (text_file_open(&file, path) < 0)
+    {
+        return;
+    }
+    text_field_t fields[6];
+    int count;
+    while ((count = text_file_next_line(&file, fields, 6)) >= 0)
+    {
+        account_t account = {.type = type};
+        int parsed = type == 0 ? parse_member(fields, count, &account.data.member)
+                               : parse_user(fields, count, &account.data.user);
+        if (parsed == 0 && add_account(&account) < 0)
+        {
+            break;
+        }
+    }
+    text_file_close(&file);
+}
+
+// members.txt and users.txt share one thread and load one after the
+// other: an account's row is its number, members first, and payments.db
+// names accounts by row, so the rows must come out in file order.
+void load_accounts_from_file(void)
+{
+    load_accounts_of_type(MEMBER_FILE, 0);
+    load_accounts_of_type(USERS_FILE, 1);
+    printf("Loaded %d accounts from file.\n", tables->accounts->count);
+}
+
+void load_books_from_file(void)
+{
+    int added = book_store_import(BOOK_FILE);
+    if (added < 0)
+    {
+        printf("Book file not found. Starting with an empty book list.\n");
+        return;
+    }
+    printf("Imported %d books from %s into %s.\n", added, BOOK_FILE, BOOK_STORE_FILE);
+}
+
+// Borrowing lines are email|title|due_timestamp.
+void load_borrowings_from_file(void)
+{
+    text_file_t file;
+    if (text_file_open(&file, BORROWINGS_FILE) < 0)
+    {
+        return;
+    }
+    text_field_t fields[3];
+    int count;
+    while ((count = text_file_next_line(&file, fields, 3)) >= 0)
+    {
+        borrowing_t borrowing;
+        memset(&borrowing, 0, sizeof(borrowing));
+        long long due;
+        if (count < 3 || text_field_copy(borrowing.user_email, sizeof(borrowing.user_email), fields[0]) < 0 ||
+            text_field_copy(borrowing.book_title, sizeof(borrowing.book_title), fields[1]) < 0 ||
+            text_field_long(fields[2], &due) < 0)
+        {
+            continue;
+        }
+        borrowing.due_date_timestamp = (time_t)due;
+        if (add_borrowing(&borrowing) < 0)
+        {
+            break;
+        }
+    }
+    text_file_close(&file);
+    printf("Loaded %d borrowings from file.\n", tables->borrowing_count);
+}
+
+// Accounts, books and borrowings feed separate tables, so each table's
+// files get a thread of their own.
+typedef struct
+{
+    void (*load)(void);
+    pthread_t thread;
+    int threaded;
+} table_load_t;
+
+static void *table_load_main(void *arg)
+{
+    ((table_load_t *)arg)->load();
+    return NULL;
+}
+
+static void start_load(table_load_t *load)
+{
+    load->threaded = pthread_create(&load->thread, NULL, table_load_main, load) == 0;
+    if (!load->threaded)
+    {
+        load->load();
+    }
+}
+
+// Copies src into a fixed-size field, zero-filling the rest so no stale
+// bytes end up in the log.
+static void copy_key(char *dest, const char *src, size_t size)
+{
+    memset(dest, 0, size);
+    if (src)
+    {
+        strncpy(dest, src, size - 1);
+    }
+}
+
+void log_user_put(const char *old_email, const user_t *user)
+{
+    wal_user_put_t record;
+    copy_key(record.old_email, old_email, sizeof(record.old_email));
+    record.user = *user;
+    pending_record(&pending_users, WAL_USER_PUT, &record, sizeof(record));
+}
+
+void log_borrowing_add(const borrowing_t *record)
+{
+    pending_record(&pending_borrowings, WAL_BORROWING_ADD, record, sizeof(*record));
+}
+
+void log_borrowing_delete(const char *user_email, const char *book_title)
+{
+    wal_borrowing_delete_t record;
+    copy_key(record.user_email, user_email, sizeof(record.user_email));
+    copy_key(record.book_title, book_title, sizeof(record.book_title));
+    pending_record(&pending_borrowings, WAL_BORROWING_DELETE, &record, sizeof(record));
+}
+
+void log_borrowing_accrue(const borrowing_t *borrowing, int days)
+{
+    wal_borrowing_accrue_t record;
+    memset(&record, 0, sizeof(record));
+    record.borrowing = *borrowing;
+    record.days = days;
+    pending_record(&pending_borrowings, WAL_BORROWING_ACCRUE, &record, sizeof(record));
+}
+
+// Book records from an older version's log are replayed onto a plain
+// array, the way that version kept its books: titles can repeat there, and
+// which copy a lookup finds depends on the array order. The result goes
+// into the book store in that order at the end of the load.
+static book_t *legacy_books;
+static int legacy_book_count;
+static int legacy_book_cap;
+
+static int legacy_book_append(const book_t *book)
+{
+    if (legacy_book_count == legacy_book_cap)
+    {
+        int new_cap = legacy_book_cap * 2;
+        book_t *grown = realloc(legacy_books, new_cap * sizeof(book_t));
+        if (grown == NULL)
+        {
+            perror("Error replaying books");
+            return -1;
+        }
+        legacy_books = grown;
+        legacy_book_cap = new_cap;
+    }
+    legacy_books[legacy_book_count++] = *book;
+    return 0;
+}
+
+static int legacy_books_begin(void)
+{
+    if (legacy_books)
+    {
+        return 0;
+    }
+    legacy_book_cap = 128;
+    legacy_books = malloc(legacy_book_cap * sizeof(book_t));
+    if (legacy_books == NULL)
+    {
+        perror("Error replaying books");
+        return -1;
+    }
+    for (int slot = book_store_next(0); slot != -1; slot = book_store_next(slot + 1))
+    {
+        if (legacy_book_append(book_store_get(slot)) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int find_legacy_book(const char *title)
+{
+    for (int i = 0; i < legacy_book_count; i++)
+    {
+        if (strcmp(legacy_books[i].title, title) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Replays one record onto the tables, mirroring what the handler did.
+static void apply_record(int type, const void *payload, size_t len)
+{
+    switch (type)
+    {
+    case WAL_USER_PUT:
+    {
+        if (len != sizeof(wal_user_put_t))
+        {
+            break;
+        }
+        wal_user_put_t record;
+        memcpy(&record, payload, sizeof(record));
+        int account_type;
+        int index = record.old_email[0] ? find_account_by_email(record.old_email, &account_type) : -1;
+        if (index == -1)
+        {
+            account_t account = {.type = 1, .data.user = record.user};
+            if (add_account(&account) < 0)
+            {
+                fprintf(stderr, "Log replay: out of memory, dropping %s.\n", record.user.email);
+            }
+            return;
+        }
+        account_at(index)->type = 1;
+        account_at(index)->data.user = record.user;
+        account_email_changed(record.old_email, index);
+        return;
+    }
+    case WAL_BOOK_PUT:
+    {
+        if (len != sizeof(wal_book_put_t))
+        {
+            break;
+        }
+        wal_book_put_t record;
+        memcpy(&record, payload, sizeof(record));
+        if (legacy_books_begin() < 0)
+        {
+            return;
+        }
+        int index = record.old_title[0] ? find_legacy_book(record.old_title) : -1;
+        if (index == -1)
+        {
+            legacy_book_append(&record.book);
+            return;
+        }
+        legacy_books[index] = record.book;
+        return;
+    }
+    case WAL_BOOK_DELETE:
+    {
+        if (len != sizeof(wal_book_delete_t))
+        {
+            break;
+        }
+        wal_book_delete_t record;
+        memcpy(&record, payload, sizeof(record));
+        if (legacy_books_begin() < 0)
+        {
+            return;
+        }
+        int index = find_legacy_book(record.title);
+        if (index != -1)
+        {
+            memmove(&legacy_books[index], &legacy_books[index + 1],
+                    (legacy_book_count - index - 1) * sizeof(book_t));
+            legacy_book_count--;
+        }
+        return;
+    }
+    case WAL_BORROWING_ADD:
+    {
+        if (len != sizeof(borrowing_t))
+        {
+            break;
+        }
+        borrowing_t record;
+        memcpy(&record, payload, sizeof(record));
+        if (add_borrowing(&record) < 0)
+        {
+            fprintf(stderr, "Log replay: out of memory, dropping a borrowing.\n");
+        }
+        return;
+    }
+    case WAL_BORROWING_DELETE:
+    {
+        if (len != sizeof(wal_borrowing_delete_t))
+        {
+            break;
+        }
+        wal_borrowing_delete_t record;
+        memcpy(&record, payload, sizeof(record));
+        int index = find_borrowing(record.user_email, record.book_title);
+        if (index != -1)
+        {
+            remove_borrowing(index);
+        }
+        return;
+    }
+    case WAL_BORROWING_ACCRUE:
+    {
+        if (len != sizeof(wal_borrowing_accrue_t))
+        {
+            break;
+        }
+        wal_borrowing_accrue_t record;
+        memcpy(&record, payload, sizeof(record));
+        int index = find_borrowing_due(&record.borrowing);
+        if (index != -1 && record.days > borrowing_row(index)->accrued_days)
+        {
+            overdue_accrue(index, record.days);
+        }
+        return;
+    }
+    }
+    fprintf(stderr, "Log replay: skipping malformed record of type %d.\n", type);
+}
+
+int storage_load(void)
+{
+    int created;
+    if (book_store_open(BOOK_STORE_FILE, INITIAL_BOOKS, &created) < 0)
+    {
+        return -1;
+    }
+    int snapshot_books;
+    long first_seq = snapshot_load(&snapshot_books);
+    if (first_seq < 0)
+    {
+        return -1;
+    }
+    long count = 0;
+    for (int i = 0; i < tables->accounts->count; i++)
+    {
+        index_account(i);
+        if (append_account_ledger() < 0)
+        {
+            return -1;
+        }
+    }
+    if (first_seq == 0)
+    {
+        table_load_t loads[] = {{load_accounts_from_file}, {load_borrowings_from_file}, {load_books_from_file}};
+        int load_count = created ? 3 : 2;
+        for (int i = 0; i < load_count; i++)
+        {
+            start_load(&loads[i]);
+        }
+        for (int i = 0; i < load_count; i++)
+        {
+            if (loads[i].threaded)
+            {
+                pthread_join(loads[i].thread, NULL);
+            }
+        }
+        count = wal_replay(WAL_FILE, apply_record);
+        if (count < 0)
+        {
+            return -1;
+        }
+        first_seq = 1;
+    }
+    // Segments are numbered without gaps; replay them up to the first
+    // missing one and keep appending to the last.
+    unsigned seq = first_seq;
+    for (;; seq++)
+    {
+        char path[64];
+        wal_segment_path(path, sizeof(path), seq);
+        if (access(path, F_OK) != 0)
+        {
+            break;
+        }
+        long replayed = wal_replay(path, apply_record);
+        if (replayed < 0)
+        {
+            return -1;
+        }
+        count += replayed;
+    }
+    if (seq > first_seq)
+    {
+        seq--;
+    }
+    printf("Replayed %ld log records.\n", count);
+    // Payments name accounts by row, so they go on once every account,
+    // including those signed up since the snapshot, is back in its row.
+    if (payment_ledger_load() < 0)
+    {
+        return -1;
+    }
+    int replayed_books = legacy_books != NULL;
+    if (legacy_books)
+    {
+        book_store_clear();
+        for (int i = 0; i < legacy_book_count; i++)
+        {
+            book_store_add(&legacy_books[i]);
+        }
+        free(legacy_books);
+        legacy_books = NULL;
+        legacy_book_count = legacy_book_cap = 0;
+    }
+    // The borrowings are final now; bring copies back in step with them
+    // if a crash came between a borrow or return and its log record.
+    book_store_settle_loans(loans_of_title);
+    printf("Book store holds %d books.\n", book_store_count());
+    if (wal_init(first_seq, seq) < 0 || book_store_sync() < 0)
+    {
+        return -1;
+    }
+    if (snapshot_books || replayed_books)
+    {
+        // Books from before the book store are in it now. Replaying the
+        // same records onto it again would not give the same result, so
+        // retire the log they came from.
+        return snapshot_take();
+    }
+    return 0;
+}
+
+// Records the payment in the ledger table and queues it for the ledger
+// file.
+static void add_to_ledger(const char *email, int amount, int type)
+{
+    int row = hash_index_find(email_index, email);
+    Payment payment;
+    if (row >= 0 && payment_add(row, amount, type, &payment) == 0 &&
+        pending_reserve(&pending_payments, sizeof(payment)) == 0)
+    {
+        memcpy(pending_payments.buf + pending_payments.len, &payment, sizeof(payment));
+        pending_payments.len += sizeof(payment);
+    }
+}
+
+void save_payment_to_file(const char *email, int amount)
+{
+    add_to_ledger(email, amount, PAYMENT_FEE);
+    printf("Payment recorded for user: %s\n", email);
+}
+
+void save_fine_to_file(const char *email, int amount)
+{
+    add_to_ledger(email, amount, PAYMENT_FINE);
+    printf("Fine recorded for user: %s\n", email);
+}
+
+// The payments buffered under the accounts lock go out in one write.
+static int append_payments(void)
+{
+    if (pending_payments.len == 0)
+    {
+        return 0;
+    }
+    unsynced_files |= STORAGE_LEDGER;
+    uint64_t started = metrics_now_ns();
+    int rc = payment_ledger_append(pending_payments.buf, pending_payments.len);
+    metrics_record_write(METRIC_FILE_LEDGER, rc < 0, metrics_now_ns() - started);
+    pending_payments.len = 0;
+    return rc;
+}
+
+int storage_flush(int lock_mask)
+{
+    int rc = 0;
+    if ((lock_mask & LOCK_BOOKS) && book_store_dirty())
+    {
+        uint64_t started = metrics_now_ns();
+        rc = book_store_flush();
+        unsynced_files |= STORAGE_BOOKS;
+        metrics_record_write(METRIC_FILE_BOOKS, rc < 0, metrics_now_ns() - started);
+    }
+    // The log records of every locked table go out in one write.
+    struct iovec iov[2];
+    int count = 0;
+    pending_lines_t *logs[2] = {
+        (lock_mask & LOCK_ACCOUNTS) ? &pending_users : NULL,
+        (lock_mask & LOCK_BORROWINGS) ? &pending_borrowings : NULL,
+    };
+    for (int i = 0; i < 2; i++)
+    {
+        if (logs[i] && logs[i]->len > 0)
+        {
+            iov[count].iov_base = logs[i]->buf;
+            iov[count].iov_len = logs[i]->len;
+            count++;
+            logs[i]->len = 0;
+        }
+    }
+    if (count > 0)
+    {
+        uint64_t started = metrics_now_ns();
+        rc |= wal_append(iov, count);
+        unsynced_files |= STORAGE_WAL;
+        metrics_record_write(METRIC_FILE_WAL, rc < 0, metrics_now_ns() - started);
+    }
+    if (lock_mask & LOCK_ACCOUNTS)
+    {
+        rc |= append_payments();
+    }
+    return rc ? -1 : 0;
+}
+
+int storage_take_unsynced(void)
+{
+    int files = unsynced_files;
+    unsynced_files = 0;
+    return files;
+}
+
+int storage_sync(int files)
+{
+    int rc = 0;
+    if (files & STORAGE_WAL)
+    {
+        rc |= wal_sync();
+    }
+    if (files & STORAGE_BOOKS)
+    {
+        rc |= book_store_sync();
+    }
+    if (files & STORAGE_LEDGER)
+    {
+        rc |= payment_ledger_sync();
+    }
+    return rc ? -1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "types.h"
+#include "book.h"
+#include "book_store.h"
+#include "table.h"
+#include "timer_wheel.h"
+
+#define MEMBER_FILE "members.txt"
+#define USERS_FILE "users.txt"
+#define PAYMENTS_FILE "payments.txt" // before the payments ledger; read once to import
+#define FINES_FILE "fines.txt"
+#define BORROWINGS_FILE "borrowings.txt"
+#define INITIAL_BOOKS 1024 // capacity of a new book store; it grows as needed
+
+// The in-memory tables are authoritative. Handlers change them while
+// holding the matching table lock (see locks.h) and log each changed row;
+// storage_flush() then appends the records to the write-ahead log (wal.h)
+// in one write, so a borrow costs one small append whatever the size of
+// the table. Snapshots (snapshot.h) bound how much of the log a restart
+// has to replay. Books are not logged: they are changed in place in the
+// mapped book store (book_store.h).
+//
+// Borrowings sit on two lists threaded through their rows, one per user
+// and one per title, and a hash index on each key finds the first row of
+// its list. Finding a user's or a title's borrowings walks only those.
+// Rows of returned books go on a free list for the next borrowing, so a
+// row keeps its number for as long as the borrowing lasts.
+enum
+{
+    BORROWINGS_BY_USER,
+    BORROWINGS_BY_TITLE
+};
+
+typedef struct
+{
+    int next; // -1 at the end of the list
+    int prev; // in the first row of a list: the last row
+} borrowing_link_t;
+
+typedef struct
+{
+    borrowing_t borrowing;
+    int in_use;
+    borrowing_link_t links[2]; // by BORROWINGS_BY_*; links[0].next chains free rows
+    // Overdue tracking (overdue.h): the next time the fine changes, the
+    // days of fine already added to the user's fines_due, and the place on
+    // the overdue list.
+    timer_link_t timer;
+    int accrued_days;
+    int overdue;
+    int overdue_next;
+    int overdue_prev;
+} borrowing_row_t;
+
+// What an account has paid and been fined in all, and its newest record
+// of each type in the payments ledger (payment.h), by PAYMENT_FEE and
+// PAYMENT_FINE, or -1. Row i belongs to account row i. Kept in memory
+// only and rebuilt at start.
+typedef struct
+{
+    long long paid;
+    long long fined;
+    int last[2];
+    uint32_t password_generation; // bumped on each password change; ends session tokens
+} account_ledger_t;
+
+// The tables live in shared memory so that every server process (see
+// `server -p`) works on the same data. They grow a chunk at a time
+// (table.h) and rows never move, so there is no limit on their size but
+// the arena.
+typedef struct
+{
+    table_t *accounts;   // account_t rows
+    table_t *ledgers;    // account_ledger_t rows, one per account
+    table_t *borrowings; // borrowing_row_t rows, in use or free
+    int borrowing_count; // rows in use
+    int free_borrowing;  // first free row, or -1
+} shared_tables_t;
+
+extern shared_tables_t *tables;
+
+static inline account_t *account_at(int row)
+{
+    return table_row(tables->accounts, row);
+}
+
+static inline account_ledger_t *account_ledger(int row)
+{
+    return table_row(tables->ledgers, row);
+}
+
+static inline borrowing_row_t *borrowing_row(int row)
+{
+    return table_row(tables->borrowings, row);
+}
+
+static inline borrowing_t *borrowing_at(int row)
+{
+    return &borrowing_row(row)->borrowing;
+}
+
+// Allocates the tables from the shared arena. Call before loading them.
+int storage_init(void);
+
+void load_accounts_from_file(void);
+void load_books_from_file(void);
+void load_borrowings_from_file(void);
+
+// Maps the book store and fills the tables at startup: from the snapshot
+// if there is one, otherwise from the text files, then replays the log on
+// top. Sets the log up for appending.
+int storage_load(void);
+
+// Accounts are found through a hash index on email (hash_index.h), so
+// adding one and changing an email have to go through these.
+int find_account_by_email(const char *email, int *account_type);
+
+// Appends an account and indexes it. Returns its index, or -1 if the
+// arena is out of memory.
+int add_account(const account_t *account);
+
+// Re-files an account whose email was old_email; a no-op if it is the
+// same.
+void account_email_changed(const char *old_email, int index);
+
+// Sets a user's password, counting it as a change if it differs, so that
+// session tokens issued before it stop working.
+void account_set_password(int index, const char *password);
+
+// The oldest borrowing of this title by this user, or -1.
+int find_borrowing(const char *user_email, const char *book_title);
+
+// Stores a borrowing and links it into its lists. Returns its row, or -1
+// if the arena is out of memory.
+int add_borrowing(const borrowing_t *borrowing);
+
+void remove_borrowing(int row);
+
+// Walk the borrowings of one user or one title (list is a BORROWINGS_BY_*
+// value). Both return -1 at the end. A user's borrowings come oldest
+// first.
+int first_borrowing(int list, const char *key);
+int next_borrowing(int list, int row);
+
+// How many borrowings one user or one title has.
+int count_borrowings(int list, const char *key);
+
+// Log records for changed rows. A put names the row by its key before the
+// change (NULL for a new row) and carries the row as it is now.
+void log_user_put(const char *old_email, const user_t *user);
+void log_borrowing_add(const borrowing_t *record);
+void log_borrowing_delete(const char *user_email, const char *book_title);
+void log_borrowing_accrue(const borrowing_t *borrowing, int days);
+
+// Payments ledger records (payment.h), appended to its file by the next
+// storage_flush() of the accounts. Both also add to the account's totals;
+// the caller holds the accounts write lock.
+void save_payment_to_file(const char *email, int amount);
+void save_fine_to_file(const char *email, int amount);
+
+// Writes out everything pending for the tables in lock_mask, and starts
+// writeback of changed book slots if LOCK_BOOKS is in it. The caller
+// must hold those tables' write locks. Returns -1 if a file could not be
+// written.
+int storage_flush(int lock_mask);
+
+// What storage_flush() wrote to, for storage_sync().
+#define STORAGE_WAL (1 << 0)
+#define STORAGE_BOOKS (1 << 1)
+#define STORAGE_LEDGER (1 << 2)
+
+// Returns the STORAGE_* files the calling thread has written since it last
+// asked, and forgets them.
+int storage_take_unsynced(void);
+
+// Waits until everything written to the given files is on disk. Needs no
+// table lock, so one call can cover writes from many requests.
+int storage_sync(int files);
+
+#endif // STORAGE_H
\ No newline at end of file
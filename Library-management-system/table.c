@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "table.h"
+#include "shared_mem.h"
+
+table_t *table_create(size_t row_size)
+{
+    table_t *table = shared_alloc(sizeof(*table));
+    if (table != NULL)
+    {
+        table->row_size = row_size;
+    }
+    return table;
+}
+
+// Makes sure rows up to count have a chunk.
+static int table_reserve(table_t *table, int count)
+{
+    while (table->chunk_count * TABLE_CHUNK_ROWS < count)
+    {
+        if (table->chunk_count == TABLE_MAX_CHUNKS)
+        {
+            fprintf(stderr, "Table full.\n");
+            return -1;
+        }
+        char *chunk = shared_alloc(TABLE_CHUNK_ROWS * table->row_size);
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        table->chunks[table->chunk_count++] = chunk;
+    }
+    return 0;
+}
+
+int table_append(table_t *table)
+{
+    if (table_reserve(table, table->count + 1) < 0)
+    {
+        return -1;
+    }
+    int row = table->count++;
+    // A chunk kept by table_clear() or table_remove() may hold old rows.
+    memset(table_row(table, row), 0, table->row_size);
+    return row;
+}
+
+void table_remove(table_t *table, int row)
+{
+    // One chunk-sized run at a time, carrying the first row of each chunk
+    // back into the end of the one before.
+    for (int i = row; i < table->count - 1;)
+    {
+        int chunk_end = (i | (TABLE_CHUNK_ROWS - 1)) + 1;
+        int last = chunk_end < table->count ? chunk_end - 1 : table->count - 1;
+        memmove(table_row(table, i), table_row(table, i + 1), (size_t)(last - i) * table->row_size);
+        if (last + 1 < table->count)
+        {
+            memcpy(table_row(table, last), table_row(table, last + 1), table->row_size);
+        }
+        i = last + 1;
+    }
+    table->count--;
+}
+
+void table_clear(table_t *table)
+{
+    table->count = 0;
+}
+
+void table_copy_out(const table_t *table, void *dest, int count)
+{
+    char *out = dest;
+    for (int row = 0; row < count; row += TABLE_CHUNK_ROWS)
+    {
+        int rows = count - row < TABLE_CHUNK_ROWS ? count - row : TABLE_CHUNK_ROWS;
+        memcpy(out + (size_t)row * table->row_size, table_row(table, row), (size_t)rows * table->row_size);
+    }
+}
+
+int table_copy_in(table_t *table, const void *src, int count)
+{
+    if (table_reserve(table, table->count + count) < 0)
+    {
+        return -1;
+    }
+    const char *in = src;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(table_row(table, table->count++), in + (size_t)i * table->row_size, table->row_size);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stddef.h>
+
+// A growable array of fixed-size rows in the shared arena. Rows live in
+// chunks of TABLE_CHUNK_ROWS that are allocated as the table fills and
+// never move, so a row number, or a pointer to the row, stays valid while
+// the row exists, and growing costs one chunk allocation, never a copy.
+#define TABLE_CHUNK_BITS 12
+#define TABLE_CHUNK_ROWS (1 << TABLE_CHUNK_BITS)
+#define TABLE_MAX_CHUNKS (1 << 16) // room for 268M rows
+
+typedef struct
+{
+    size_t row_size;
+    int count;
+    int chunk_count;
+    char *chunks[TABLE_MAX_CHUNKS];
+} table_t;
+
+// Creates an empty table. Call before forking.
+table_t *table_create(size_t row_size);
+
+static inline void *table_row(const table_t *table, int row)
+{
+    return table->chunks[row >> TABLE_CHUNK_BITS] + (size_t)(row & (TABLE_CHUNK_ROWS - 1)) * table->row_size;
+}
+
+// Adds a zeroed row at the end and returns its number, or -1 once the
+// arena is exhausted.
+int table_append(table_t *table);
+
+// Removes a row, moving the ones after it down by one.
+void table_remove(table_t *table, int row);
+
+// Drops every row. The chunks are kept for reuse.
+void table_clear(table_t *table);
+
+// Copy count rows between the table and a flat array: out copies the
+// first count rows, in appends them. table_copy_in returns -1 once the
+// arena is exhausted.
+void table_copy_out(const table_t *table, void *dest, int count);
+int table_copy_in(table_t *table, const void *src, int count);
+
+#endif // TABLE_H
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "text_scan.h"
+
+#define BLOCK_SIZE 64
+
+int text_file_open(text_file_t *file, const char *path)
+{
+    memset(file, 0, sizeof(*file));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0)
+    {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            perror("Error mapping data file");
+            close(fd);
+            return -1;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        file->data = data;
+        file->size = st.st_size;
+    }
+    close(fd);
+    file->block = -(size_t)BLOCK_SIZE; // the first scan moves on to block 0
+    return 0;
+}
+
+void text_file_close(text_file_t *file)
+{
+    if (file->data != NULL)
+    {
+        munmap((void *)file->data, file->size);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+// Bit i is set where block[i] is a `|` or a newline. The mapping starts on
+// a page boundary, so whole blocks are aligned and never cross the end of
+// the mapping; the last, partial block is done byte by byte.
+static uint64_t delimiter_mask(const char *block, size_t len)
+{
+    uint64_t mask = 0;
+#ifdef __SSE2__
+    if (len == BLOCK_SIZE)
+    {
+        const __m128i bar = _mm_set1_epi8('|');
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (int i = 0; i < BLOCK_SIZE; i += 16)
+        {
+            __m128i bytes = _mm_load_si128((const __m128i *)(block + i));
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, bar), _mm_cmpeq_epi8(bytes, newline));
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(hits) << i;
+        }
+        return mask;
+    }
+#endif
+    for (size_t i = 0; i < len; i++)
+    {
+        if (block[i] == '|' || block[i] == '\n')
+        {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+// Offset of the next delimiter, or the file size if there is none.
+static size_t next_delimiter(text_file_t *file)
+{
+    while (file->mask == 0)
+    {
+        file->block += BLOCK_SIZE;
+        if (file->block >= file->size)
+        {
+            file->block = file->size;
+            return file->size;
+        }
+        size_t len = file->size - file->block;
+        file->mask = delimiter_mask(file->data + file->block, len < BLOCK_SIZE ? len : BLOCK_SIZE);
+    }
+    size_t offset = file->block + __builtin_ctzll(file->mask);
+    file->mask &= file->mask - 1;
+    return offset;
+}
+
+int text_file_next_line(text_file_t *file, text_field_t *fields, int max)
+{
+    if (file->pos >= file->size)
+    {
+        return -1;
+    }
+    int count = 0;
+    size_t start = file->pos;
+    for (;;)
+    {
+        size_t end = next_delimiter(file);
+        int last = end == file->size || file->data[end] == '\n';
+        if (count < max)
+        {
+            size_t len = end - start;
+            if (last && len > 0 && file->data[end - 1] == '\r')
+            {
+                len--;
+            }
+            fields[count].ptr = file->data + start;
+            fields[count].len = len;
+        }
+        count++;
+        start = end + 1;
+        if (last)
+        {
+            break;
+        }
+    }
+    file->pos = start;
+    return count;
+}
+
+int text_field_copy(char *dest, size_t size, text_field_t field)
+{
+    if (field.len >= size)
+    {
+        return -1;
+    }
+    memcpy(dest, field.ptr, field.len);
+    dest[field.len] = '\0';
+    return 0;
+}
+
+int text_field_long(text_field_t field, long long *value)
+{
+    const char *p = field.ptr;
+    const char *end = p + field.len;
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+    }
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return -1;
+    }
+    long long result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    *value = negative ? -result : result;
+    return end - p;
+}
+
+int text_field_int(text_field_t field, int *value)
+{
+    long long result;
+    int rest = text_field_long(field, &result);
+    if (rest >= 0)
+    {
+        *value = (int)result;
+    }
+    return rest;
+}
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+int text_field_unlabel(text_field_t *field, const char *label)
+{
+    const char *p = field->ptr;
+    const char *end = field->ptr + field->len;
+    while (p < end && is_blank(*p))
+    {
+        p++;
+    }
+    size_t label_len = strlen(label);
+    if ((size_t)(end - p) < label_len || memcmp(p, label, label_len) != 0)
+    {
+        return -1;
+    }
+    p += label_len;
+    while (p < end && is_blank(*p))
+    {
+        p++;
+    }
+    if (p == end || *p != ':')
+    {
+        return -1;
+    }
+    p++;
+    while (p < end && is_blank(*p))
+    {
+        p++;
+    }
+    while (end > p && is_blank(end[-1]))
+    {
+        end--;
+    }
+    field->ptr = p;
+    field->len = end - p;
+    return 0;
+}
\ No newline at end of file
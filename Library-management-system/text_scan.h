@@ -0,0 +1,52 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads the `|`-separated data files in one pass. The file is mapped, and
+// the scanner finds every `|` and newline in it 64 bytes at a time with
+// SSE2 compares, so a line costs a few bit operations rather than a call
+// per character. Fields point into the mapping; nothing is copied until
+// the caller stores a value.
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} text_field_t;
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    size_t pos;    // start of the next line
+    size_t block;  // offset of the 64 bytes that mask describes
+    uint64_t mask; // delimiters in that block not yet returned
+} text_file_t;
+
+// Maps path for reading. Returns -1 if it cannot be opened.
+int text_file_open(text_file_t *file, const char *path);
+void text_file_close(text_file_t *file);
+
+// Splits the next line at `|` and stores up to max fields, without the
+// newline or a trailing carriage return. Returns how many fields the line
+// has, which may be more than max, or -1 at the end of the file.
+int text_file_next_line(text_file_t *file, text_field_t *fields, int max);
+
+// Copies a field into a buffer of size bytes and terminates it. Returns
+// -1 if it does not fit, as sscanf's %49[^|] would then fail the line.
+int text_field_copy(char *dest, size_t size, text_field_t field);
+
+// Parses a decimal number after optional blanks and a sign, as %d does.
+// Returns -1 if there are no digits, otherwise how many characters follow
+// the number: sscanf("%d|") fails on anything but 0, while a number at the
+// end of a line may be followed by anything.
+int text_field_int(text_field_t field, int *value);
+int text_field_long(text_field_t field, long long *value);
+
+// Strips "label :" or "label:" from the front of a field, along with the
+// blanks around the value, for the `Label : value` lines of older files.
+// Returns -1 if the field does not start with the label.
+int text_field_unlabel(text_field_t *field, const char *label);
+
+#endif // TEXT_SCAN_H
\ No newline at end of file
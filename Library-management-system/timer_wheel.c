@@ -0,0 +1,212 @@
+#include "timer_wheel.h"
+#include "shared_mem.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SPAN(level) ((int64_t)1 << (TIMER_WHEEL_BITS * ((level) + 1)))
+#define FIRING_SLOT (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+
+_Static_assert(TIMER_WHEEL_SLOTS == 64, "occupied keeps one bit per slot in a uint64_t");
+
+struct timer_wheel
+{
+    timer_link_fn link_of;
+    int64_t next; // the next second to process; every timer before it has fired
+    int slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // first row, or -1
+    uint64_t occupied[TIMER_WHEEL_LEVELS];            // bit i set while slots[level][i] holds a row
+    // The slot being fired, moved out so that timers added meanwhile
+    // cannot land in it.
+    int firing;
+};
+
+timer_wheel_t *timer_wheel_create(int64_t now, timer_link_fn link_of)
+{
+    timer_wheel_t *wheel = shared_alloc(sizeof(*wheel));
+    if (wheel == NULL)
+    {
+        return NULL;
+    }
+    wheel->link_of = link_of;
+    wheel->next = now;
+    wheel->firing = -1;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        wheel->occupied[level] = 0;
+        for (int i = 0; i < TIMER_WHEEL_SLOTS; i++)
+        {
+            wheel->slots[level][i] = -1;
+        }
+    }
+    return wheel;
+}
+
+void timer_wheel_init_link(timer_link_t *link)
+{
+    link->next = -1;
+    link->prev = -1;
+    link->slot = -1;
+}
+
+static int *slot_head(timer_wheel_t *wheel, int slot)
+{
+    if (slot == FIRING_SLOT)
+    {
+        return &wheel->firing;
+    }
+    return &wheel->slots[slot / TIMER_WHEEL_SLOTS][slot % TIMER_WHEEL_SLOTS];
+}
+
+// Files a row in the slot its expiry falls in, seen from wheel->next.
+static void place(timer_wheel_t *wheel, int row)
+{
+    timer_link_t *link = wheel->link_of(row);
+    int64_t expires = link->expires;
+    int64_t delta = expires - wheel->next;
+    int level = 0;
+    if (delta < 0)
+    {
+        expires = wheel->next;
+    }
+    else
+    {
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= LEVEL_SPAN(level))
+        {
+            level++;
+        }
+        if (delta >= LEVEL_SPAN(level))
+        {
+            // Past the top level: park it in its furthest slot, from where
+            // it is filed again on the way down.
+            expires = wheel->next + LEVEL_SPAN(level) - 1;
+        }
+    }
+    int index = (expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+    link->slot = level * TIMER_WHEEL_SLOTS + index;
+    int *head = &wheel->slots[level][index];
+    link->prev = -1;
+    link->next = *head;
+    if (*head != -1)
+    {
+        wheel->link_of(*head)->prev = row;
+    }
+    *head = row;
+    wheel->occupied[level] |= 1ull << index;
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, int row)
+{
+    timer_link_t *link = wheel->link_of(row);
+    if (link->slot == -1)
+    {
+        return;
+    }
+    if (link->prev != -1)
+    {
+        wheel->link_of(link->prev)->next = link->next;
+    }
+    else
+    {
+        *slot_head(wheel, link->slot) = link->next;
+        if (link->next == -1 && link->slot != FIRING_SLOT)
+        {
+            wheel->occupied[link->slot / TIMER_WHEEL_SLOTS] &= ~(1ull << (link->slot % TIMER_WHEEL_SLOTS));
+        }
+    }
+    if (link->next != -1)
+    {
+        wheel->link_of(link->next)->prev = link->prev;
+    }
+    timer_wheel_init_link(link);
+}
+
+void timer_wheel_add(timer_wheel_t *wheel, int row, int64_t expires)
+{
+    timer_wheel_cancel(wheel, row);
+    wheel->link_of(row)->expires = expires;
+    place(wheel, row);
+}
+
+// Refiles everything in one slot of a higher level into the levels below.
+// Returns the slot's index, which is 0 when the next level up wraps too.
+static int cascade(timer_wheel_t *wheel, int level)
+{
+    int index = (wheel->next >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+    int row = wheel->slots[level][index];
+    wheel->slots[level][index] = -1;
+    wheel->occupied[level] &= ~(1ull << index);
+    while (row != -1)
+    {
+        int next = wheel->link_of(row)->next;
+        place(wheel, row);
+        row = next;
+    }
+    return index;
+}
+
+// The first second from wheel->next on at which a slot holding timers is
+// fired (level 0) or cascaded (higher levels), or INT64_MAX if the wheel
+// is empty. A higher level's current slot was cascaded when its span
+// began, so it is next cascaded a full turn later.
+static int64_t next_event(const timer_wheel_t *wheel)
+{
+    int64_t first = INT64_MAX;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        uint64_t bits = wheel->occupied[level];
+        if (bits == 0)
+        {
+            continue;
+        }
+        int shift = TIMER_WHEEL_BITS * level;
+        int64_t span = wheel->next >> shift;
+        int skip = level == 0 ? 0 : 1;
+        int rotate = (int)((span + skip) & SLOT_MASK);
+        if (rotate != 0)
+        {
+            bits = bits >> rotate | bits << (TIMER_WHEEL_SLOTS - rotate);
+        }
+        int64_t at = (span + skip + __builtin_ctzll(bits)) << shift;
+        if (at < first)
+        {
+            first = at;
+        }
+    }
+    return first;
+}
+
+void timer_wheel_advance(timer_wheel_t *wheel, int64_t now, void (*fire)(int row, void *arg), void *arg)
+{
+    while (wheel->next <= now)
+    {
+        int index = wheel->next & SLOT_MASK;
+        for (int level = 1; index == 0 && level < TIMER_WHEEL_LEVELS; level++)
+        {
+            if (cascade(wheel, level) != 0)
+            {
+                break;
+            }
+        }
+        if (wheel->slots[0][index] == -1)
+        {
+            // Nothing due this second: jump to the next one that has
+            // anything to fire or cascade, so that catching up after a
+            // long quiet spell does not walk every second in between.
+            int64_t event = next_event(wheel);
+            wheel->next = event <= now ? event : now + 1;
+            continue;
+        }
+        wheel->next++;
+        wheel->firing = wheel->slots[0][index];
+        wheel->slots[0][index] = -1;
+        wheel->occupied[0] &= ~(1ull << index);
+        for (int row = wheel->firing; row != -1; row = wheel->link_of(row)->next)
+        {
+            wheel->link_of(row)->slot = FIRING_SLOT;
+        }
+        while (wheel->firing != -1)
+        {
+            int row = wheel->firing;
+            timer_wheel_cancel(wheel, row);
+            fire(row, arg);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// A hierarchical timer wheel over the rows of a table, in whole seconds.
+// Level 0 has a slot per second for the next 64 seconds, and each level
+// above covers 64 times the span of the one below. A timer is filed in
+// the lowest level whose span reaches it and is moved down a level each
+// time the level below wraps around. Adding, cancelling and firing a
+// timer are O(1). Each level keeps a bitmap of its slots that hold
+// timers, so advancing jumps straight over seconds with nothing due: a
+// catch-up after hours without a call costs no more than the timers it
+// fires and moves down.
+//
+// Rows carry their own timer_link_t (returned by link_of), so a timer
+// needs no allocation. The wheel lives in the shared arena; the caller
+// serializes all calls with the table's write lock.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4 // 2^24 seconds, about 194 days; later timers wait in the top level
+
+typedef struct
+{
+    int64_t expires;
+    int next;
+    int prev;
+    int slot; // level * TIMER_WHEEL_SLOTS + index, or -1 when not pending
+} timer_link_t;
+
+typedef timer_link_t *(*timer_link_fn)(int row);
+
+typedef struct timer_wheel timer_wheel_t;
+
+// Creates a wheel whose clock starts at now.
+timer_wheel_t *timer_wheel_create(int64_t now, timer_link_fn link_of);
+
+// Sets a row's timer to fire at expires, replacing any pending one. A time
+// already passed fires at the next tick.
+void timer_wheel_add(timer_wheel_t *wheel, int row, int64_t expires);
+
+void timer_wheel_cancel(timer_wheel_t *wheel, int row);
+
+// Marks a row's link as holding no timer; call once for every new row.
+void timer_wheel_init_link(timer_link_t *link);
+
+// Moves the clock forward to now, calling fire for every timer that comes
+// due on the way, in order of expiry to the second. fire may add or cancel
+// any timer, including the one that fired.
+void timer_wheel_advance(timer_wheel_t *wheel, int64_t now, void (*fire)(int row, void *arg), void *arg);
+
+#endif // TIMER_WHEEL_H
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "timer_wheel.h"
+#include "shared_mem.h"
+
+// Checks the timer wheel (timer_wheel.h) against a plain array of expiry
+// times. Random adds, cancels and clock moves, from single seconds to
+// jumps of over a year, must fire every timer in the advance that passes
+// its second, never earlier, in order of expiry. Fire callbacks re-arm
+// and cancel timers as the overdue sweep and the token table do. Exits
+// non-zero on failure.
+
+#define ROWS 2000
+#define STEPS 200000
+#define NOT_PENDING -1
+
+static timer_link_t links[ROWS];
+// Second each pending timer must fire at: its expiry, or the wheel's next
+// tick for one added with its time already passed.
+static int64_t due[ROWS];
+static timer_wheel_t *wheel;
+static int64_t next_tick; // the wheel's next second to process
+static int64_t advancing_to;
+static int64_t last_fired;
+static unsigned seed;
+static unsigned run; // seed the run started from
+static long fired;
+static long failures;
+
+static timer_link_t *link_of(int row)
+{
+    return &links[row];
+}
+
+static int64_t random_delay(void)
+{
+    switch (rand_r(&seed) % 5)
+    {
+    case 0:
+        return rand_r(&seed) % 70; // level 0
+    case 1:
+        return rand_r(&seed) % 5000;
+    case 2:
+        return rand_r(&seed) % 400000;
+    case 3:
+        return (int64_t)rand_r(&seed) % 40000000; // past the top level
+    default:
+        return -(rand_r(&seed) % 10); // already passed
+    }
+}
+
+static void add(int row, int64_t expires)
+{
+    timer_wheel_add(wheel, row, expires);
+    due[row] = expires > next_tick ? expires : next_tick;
+}
+
+static void cancel(int row)
+{
+    timer_wheel_cancel(wheel, row);
+    due[row] = NOT_PENDING;
+}
+
+static void fail(const char *what, int row)
+{
+    if (failures++ < 10)
+    {
+        printf("FAIL: seed %u: %s: row %d due %lld, wheel from %lld to %lld\n", run, what, row,
+               (long long)due[row], (long long)next_tick, (long long)advancing_to);
+    }
+}
+
+static void fire(int row, void *arg)
+{
+    if (due[row] == NOT_PENDING)
+    {
+        fail("fired a timer not pending", row);
+        return;
+    }
+    if (due[row] < next_tick || due[row] > advancing_to)
+    {
+        fail("fired outside the advance that passes it", row);
+    }
+    if (due[row] < last_fired)
+    {
+        fail("fired out of order", row);
+    }
+    last_fired = due[row];
+    due[row] = NOT_PENDING;
+    fired++;
+    // Later timers added from a callback are filed from the second being
+    // fired, so they go by their expiry alone.
+    int action = rand_r(&seed) % 4;
+    if (action == 0)
+    {
+        timer_wheel_add(wheel, row, last_fired + 1 + rand_r(&seed) % 100000);
+        due[row] = links[row].expires;
+    }
+    else if (action == 1)
+    {
+        int other = rand_r(&seed) % ROWS;
+        timer_wheel_add(wheel, other, last_fired + 1 + rand_r(&seed) % 200);
+        due[other] = links[other].expires;
+    }
+    else if (action == 2)
+    {
+        cancel(rand_r(&seed) % ROWS);
+    }
+}
+
+static void advance(int64_t now)
+{
+    advancing_to = now;
+    last_fired = INT64_MIN;
+    timer_wheel_advance(wheel, now, fire, NULL);
+    for (int row = 0; row < ROWS; row++)
+    {
+        if (due[row] != NOT_PENDING && due[row] <= now)
+        {
+            fail("not fired in the advance that passes it", row);
+            due[row] = NOT_PENDING;
+        }
+    }
+    if (now >= next_tick)
+    {
+        next_tick = now + 1;
+    }
+}
+
+static int run_seed(unsigned run_seed)
+{
+    run = run_seed;
+    seed = run_seed;
+    fired = 0;
+    failures = 0;
+    next_tick = 1000000;
+    wheel = timer_wheel_create(next_tick, link_of);
+    if (wheel == NULL)
+    {
+        fprintf(stderr, "Out of arena memory.\n");
+        return -1;
+    }
+    for (int row = 0; row < ROWS; row++)
+    {
+        timer_wheel_init_link(&links[row]);
+        due[row] = NOT_PENDING;
+    }
+    int64_t now = next_tick - 1;
+    for (int step = 0; step < STEPS; step++)
+    {
+        int row = rand_r(&seed) % ROWS;
+        int op = rand_r(&seed) % 10;
+        if (op < 4)
+        {
+            add(row, now + random_delay());
+        }
+        else if (op < 5)
+        {
+            cancel(row);
+        }
+        else
+        {
+            // Mostly a second or two, as with steady traffic, then now and
+            // then a quiet spell of hours to weeks.
+            int kind = rand_r(&seed) % 20;
+            if (kind < 16)
+            {
+                now += rand_r(&seed) % 3;
+            }
+            else
+            {
+                now += rand_r(&seed) % (kind < 19 ? 20000 : 40000000);
+            }
+            advance(now);
+        }
+    }
+    // Run the clock out far enough for every timer left to fire.
+    advance(now + 2 * ((int64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) + 100000000);
+    if (failures > 0)
+    {
+        printf("FAIL: seed %u: %ld failures\n", run, failures);
+        return -1;
+    }
+    printf("ok: seed %u: %ld timers fired\n", run, fired);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int seeds = argc > 1 ? atoi(argv[1]) : 8;
+    if (seeds < 1)
+    {
+        fprintf(stderr, "Usage: %s [seeds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (shared_arena_init(1 << 20) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    int failed = 0;
+    for (int i = 1; i <= seeds; i++)
+    {
+        failed |= run_seed(i);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
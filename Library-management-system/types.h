@@ -7,7 +7,6 @@
 #define MAX_EMAIL_LEN 50
 #define MAX_PHONE_LEN 15
 #define MAX_PASSWD_LEN 50
-#define MAX_ACCOUNTS 200
 
 // Book data structure definitions
 #define MAX_TITLE_LEN 100
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring_loop.h"
+#include "session.h"
+#include "worker_pool.h"
+#include "metrics.h"
+
+// Each submission's user_data is a session pointer with the operation kind
+// in its low bits (sessions come from calloc, so those bits are free).
+enum
+{
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,
+    OP_COMPLETION
+};
+#define OP_MASK 7u
+
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail;  // next free SQE, published to *sq_tail on enter
+    unsigned submitted; // SQEs the kernel has consumed
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *buf_ring;
+    unsigned short buf_tail;
+    char *buf_base;
+} uring_t;
+
+static int active_sessions = 0;
+static client_session_t *closed_sessions = NULL;
+
+static int ring_setup(uring_t *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0)
+    {
+        perror("io_uring_setup failed");
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+    {
+        fprintf(stderr, "io_uring on this kernel is too old.\n");
+        close(ring->fd);
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    char *rings = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        perror("io_uring mmap failed");
+        close(ring->fd);
+        return -1;
+    }
+    ring->sq_head = (unsigned *)(rings + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(rings + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *)(rings + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    // SQEs are always used in ring order, so the index array is fixed.
+    unsigned *sq_array = (unsigned *)(rings + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++)
+    {
+        sq_array[i] = i;
+    }
+    ring->sqe_tail = *ring->sq_tail;
+    ring->submitted = ring->sqe_tail;
+    return 0;
+}
+
+// Hands a receive buffer (back) to the kernel.
+static void recycle_buffer(uring_t *ring, unsigned short bid)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_NUM_BUFS - 1)];
+    buf->addr = (uintptr_t)(ring->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int register_buffers(uring_t *ring)
+{
+    ring->buf_ring = mmap(NULL, URING_NUM_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buf_base = malloc((size_t)URING_NUM_BUFS * URING_BUF_SIZE);
+    if (ring->buf_ring == MAP_FAILED || ring->buf_base == NULL)
+    {
+        perror("Error allocating receive buffers");
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_NUM_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        perror("io_uring buffer ring registration failed");
+        return -1;
+    }
+    ring->buf_tail = 0;
+    for (unsigned i = 0; i < URING_NUM_BUFS; i++)
+    {
+        recycle_buffer(ring, i);
+    }
+    return 0;
+}
+
+// Submits every queued SQE and, if wait is set, blocks until at least one
+// completion is available. This is the loop's only blocking syscall.
+static int ring_enter(uring_t *ring, int wait)
+{
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->sqe_tail - ring->submitted;
+    int ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait ? 1 : 0,
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret < 0)
+    {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        {
+            return 0;
+        }
+        perror("io_uring_enter failed");
+        return -1;
+    }
+    ring->submitted += ret;
+    return 0;
+}
+
+// Returns a zeroed SQE, flushing the queue to the kernel first if it is
+// full. Returns NULL only if that flush fails.
+static struct io_uring_sqe *get_sqe(uring_t *ring)
+{
+    if (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        if (ring_enter(ring, 0) < 0 ||
+            ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static int arm_accept(uring_t *ring, int listen_fd)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = OP_ACCEPT;
+    return 0;
+}
+
+static int arm_completion_poll(uring_t *ring, int done_fd)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = done_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = OP_COMPLETION;
+    return 0;
+}
+
+static void release_session(client_session_t *session)
+{
+    session->next_closed = closed_sessions;
+    closed_sessions = session;
+}
+
+static void free_closed_sessions(void)
+{
+    while (closed_sessions)
+    {
+        client_session_t *next = closed_sessions->next_closed;
+        session_free(closed_sessions);
+        closed_sessions = next;
+    }
+}
+
+// A closed session is freed once no worker and no submitted operation can
+// refer to it any more.
+static void release_if_idle(client_session_t *session)
+{
+    if (session->closing && !session->busy && session->pending_ops == 0)
+    {
+        release_session(session);
+    }
+}
+
+// Shutting the socket down makes any recv or send still in flight complete
+// straight away.
+static void close_session(client_session_t *session)
+{
+    if (session->closing)
+    {
+        return;
+    }
+    shutdown(session->fd, SHUT_RDWR);
+    close(session->fd);
+    session->closing = 1;
+    active_sessions--;
+    metrics_session_closed();
+    printf("Client disconnected. Active sessions: %d\n", active_sessions);
+    release_if_idle(session);
+}
+
+// Keeps one recv armed per session while its input buffer can take a whole
+// receive buffer; otherwise reading pauses until requests drain it.
+static int arm_recv(uring_t *ring, client_session_t *session)
+{
+    if (session->recv_armed || session->closing || session->read_closed)
+    {
+        return 0;
+    }
+    if (session_reserve_input(session, URING_BUF_SIZE) == 0)
+    {
+        return 0;
+    }
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = session->fd;
+    sqe->len = URING_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = (uintptr_t)session | OP_RECV;
+    session->recv_armed = 1;
+    session->pending_ops++;
+    return 0;
+}
+
+// Gathers the queued replies into one SENDMSG. The kernel reads the iovecs
+// and the replies they point at while it is in flight; replies queued in
+// the meantime are only picked up by the next send.
+static int start_send(uring_t *ring, client_session_t *session)
+{
+    if (session->sending)
+    {
+        return 0;
+    }
+    int count = session_output_iov(session, session->out_iov, OUT_IOV_MAX);
+    if (count == 0)
+    {
+        return 0;
+    }
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    memset(&session->out_msg, 0, sizeof(session->out_msg));
+    session->out_msg.msg_iov = session->out_iov;
+    session->out_msg.msg_iovlen = count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = session->fd;
+    sqe->addr = (uintptr_t)&session->out_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uintptr_t)session | OP_SEND;
+    session->sending = 1;
+    session->pending_ops++;
+    return 0;
+}
+
+// Runs the next buffered request (its reply queues behind any send still
+// in flight) and keeps reading. A read-closed session is closed once its
+// last reply has gone out.
+static void advance_session(uring_t *ring, client_session_t *session)
+{
+    if (session_dispatch_input(session) < 0 ||
+        arm_recv(ring, session) < 0 || session_drained(session))
+    {
+        close_session(session);
+    }
+}
+
+static void accept_client(uring_t *ring, int client_fd)
+{
+    client_session_t *session = calloc(1, sizeof(*session));
+    if (session == NULL)
+    {
+        perror("Error allocating session");
+        close(client_fd);
+        return;
+    }
+    session->fd = client_fd;
+    active_sessions++;
+    metrics_session_opened();
+    printf("Connection accepted. Active sessions: %d\n", active_sessions);
+    advance_session(ring, session);
+}
+
+static void handle_recv(uring_t *ring, client_session_t *session, int res, unsigned flags)
+{
+    session->pending_ops--;
+    session->recv_armed = 0;
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && !session->closing)
+        {
+            // arm_recv() reserved room for a whole buffer.
+            memcpy(session->in_buf + session->in_len, ring->buf_base + (size_t)bid * URING_BUF_SIZE, res);
+            session->in_len += res;
+            metrics_add_bytes_in(res);
+        }
+        recycle_buffer(ring, bid);
+    }
+    if (session->closing)
+    {
+        release_if_idle(session);
+    }
+    else if (res == -ENOBUFS)
+    {
+        // Every buffer was in use for a moment; try again.
+        advance_session(ring, session);
+    }
+    else if (res < 0)
+    {
+        close_session(session);
+    }
+    else
+    {
+        // At end of input the frames already buffered are still answered.
+        if (res == 0)
+        {
+            session->read_closed = 1;
+        }
+        advance_session(ring, session);
+    }
+}
+
+static void handle_send(uring_t *ring, client_session_t *session, int res)
+{
+    session->pending_ops--;
+    session->sending = 0;
+    if (session->closing)
+    {
+        release_if_idle(session);
+        return;
+    }
+    if (res < 0)
+    {
+        close_session(session);
+        return;
+    }
+    session_output_sent(session, res);
+    metrics_add_bytes_out(res);
+    if (start_send(ring, session) < 0)
+    {
+        close_session(session);
+        return;
+    }
+    advance_session(ring, session);
+}
+
+static void complete_requests(uring_t *ring)
+{
+    work_item_t *item = worker_pool_take_completed();
+    while (item)
+    {
+        work_item_t *next = item->next;
+        client_session_t *session = item->session;
+        session->busy = 0;
+        if (session->closing)
+        {
+            work_item_free(item);
+            release_if_idle(session);
+        }
+        else
+        {
+            // The session now owns the item and frees it once it is sent.
+            session_queue_response(session, item);
+            if (start_send(ring, session) < 0)
+            {
+                close_session(session);
+            }
+            else
+            {
+                advance_session(ring, session);
+            }
+        }
+        item = next;
+    }
+}
+
+int run_uring_loop(int listen_fd, int num_workers)
+{
+    uring_t ring;
+    if (ring_setup(&ring) < 0 || register_buffers(&ring) < 0)
+    {
+        return -1;
+    }
+    int done_fd = worker_pool_start(num_workers);
+    if (done_fd < 0 || arm_accept(&ring, listen_fd) < 0 || arm_completion_poll(&ring, done_fd) < 0)
+    {
+        return -1;
+    }
+    printf("Using the io_uring backend.\n");
+
+    while (1)
+    {
+        // Submit everything queued by the last pass; only sleep when there
+        // is nothing left to reap.
+        int idle = *ring.cq_head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        if ((idle || ring.sqe_tail != ring.submitted) && ring_enter(&ring, idle) < 0)
+        {
+            return -1;
+        }
+
+        unsigned head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &ring.cqes[head & ring.cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+            client_session_t *session = (client_session_t *)(uintptr_t)(user_data & ~(uint64_t)OP_MASK);
+            switch (user_data & OP_MASK)
+            {
+            case OP_ACCEPT:
+                if (res >= 0)
+                {
+                    accept_client(&ring, res);
+                }
+                else
+                {
+                    fprintf(stderr, "accept failed: %s\n", strerror(-res));
+                }
+                if (!(flags & IORING_CQE_F_MORE) && arm_accept(&ring, listen_fd) < 0)
+                {
+                    return -1;
+                }
+                break;
+            case OP_COMPLETION:
+                complete_requests(&ring);
+                if (!(flags & IORING_CQE_F_MORE) && arm_completion_poll(&ring, done_fd) < 0)
+                {
+                    return -1;
+                }
+                break;
+            case OP_RECV:
+                handle_recv(&ring, session, res, flags);
+                break;
+            case OP_SEND:
+                handle_send(&ring, session, res);
+                break;
+            }
+        }
+        worker_pool_flush();
+        free_closed_sessions();
+    }
+}
\ No newline at end of file
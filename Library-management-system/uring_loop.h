@@ -0,0 +1,17 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#define URING_ENTRIES 4096
+// Receive buffers handed to the kernel up front; a recv picks whichever is
+// free, so idle connections do not pin any buffer memory.
+#define URING_NUM_BUFS 1024 // power of two
+#define URING_BUF_SIZE 4096
+#define URING_BUF_GROUP 0
+
+// Same contract as run_event_loop(), but all socket I/O goes through one
+// io_uring: a multishot accept, recvs into a registered buffer ring and
+// sends, submitted together with a single io_uring_enter per loop pass.
+// Returns -1 at once if the kernel does not support io_uring.
+int run_uring_loop(int listen_fd, int num_workers);
+
+#endif // URING_LOOP_H
\ No newline at end of file
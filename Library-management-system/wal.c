@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "wal.h"
+#include "shared_mem.h"
+
+// Shared by all server processes.
+typedef struct
+{
+    unsigned seq;       // segment appends go to
+    unsigned first_seq; // oldest segment still on disk
+    uint64_t bytes;     // appended to seq so far
+} wal_state_t;
+
+static wal_state_t *state = NULL;
+
+// Per process: the segment wal_fd has open. Appends under different table
+// locks can run at once, so switching segments, and syncing, take
+// segment_lock; the common path only reads open_seq.
+static int wal_fd = -1;
+static unsigned open_seq = 0;
+static int wal_unsynced = 0; // wal_fd has appends not yet synced
+static pthread_mutex_t segment_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+uint32_t wal_crc32(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&crc_once, crc_init);
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len--)
+    {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void wal_encode(char *dest, int type, const void *payload, size_t len)
+{
+    wal_header_t header;
+    unsigned char type_byte = (unsigned char)type;
+    header.len = (uint32_t)(1 + len);
+    header.crc = wal_crc32(wal_crc32(0, &type_byte, 1), payload, len);
+    memcpy(dest, &header, sizeof(header));
+    dest[sizeof(header)] = (char)type_byte;
+    memcpy(dest + sizeof(header) + 1, payload, len);
+}
+
+void wal_segment_path(char *path, size_t size, unsigned seq)
+{
+    snprintf(path, size, "%s.%u", WAL_FILE, seq);
+}
+
+long wal_replay(const char *path, void (*apply)(int type, const void *payload, size_t len))
+{
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        perror("Error opening log");
+        return -1;
+    }
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) < 0 || (st.st_size > 0 && (data = malloc(st.st_size)) == NULL))
+    {
+        perror("Error reading log");
+        close(fd);
+        return -1;
+    }
+    size_t size = 0;
+    while (size < (size_t)st.st_size)
+    {
+        ssize_t n = read(fd, data + size, st.st_size - size);
+        if (n <= 0)
+        {
+            break;
+        }
+        size += n;
+    }
+
+    long count = 0;
+    size_t offset = 0;
+    while (size - offset >= sizeof(wal_header_t) + 1)
+    {
+        wal_header_t header;
+        memcpy(&header, data + offset, sizeof(header));
+        const char *body = data + offset + sizeof(header);
+        if (header.len == 0 || header.len > size - offset - sizeof(header) ||
+            wal_crc32(0, body, header.len) != header.crc)
+        {
+            break;
+        }
+        apply((unsigned char)body[0], body + 1, header.len - 1);
+        offset += sizeof(header) + header.len;
+        count++;
+    }
+    if (offset < (size_t)st.st_size)
+    {
+        fprintf(stderr, "Discarding %zu bytes of torn or corrupt log after record %ld.\n",
+                (size_t)st.st_size - offset, count);
+        if (ftruncate(fd, offset) < 0)
+        {
+            perror("Error truncating log");
+        }
+    }
+    free(data);
+    close(fd);
+    return count;
+}
+
+int wal_init(unsigned first_seq, unsigned seq)
+{
+    state = shared_alloc(sizeof(*state));
+    if (state == NULL)
+    {
+        return -1;
+    }
+    state->seq = seq;
+    state->first_seq = first_seq;
+    char path[64];
+    for (unsigned old = first_seq - 1; old > 0; old--)
+    {
+        wal_segment_path(path, sizeof(path), old);
+        if (unlink(path) < 0)
+        {
+            break;
+        }
+    }
+    // Count what an earlier run left in the segment towards the next
+    // snapshot.
+    struct stat st;
+    wal_segment_path(path, sizeof(path), seq);
+    if (stat(path, &st) == 0)
+    {
+        state->bytes = st.st_size;
+    }
+    return 0;
+}
+
+// Makes sure wal_fd is the current segment; another process may have
+// rotated since this one last wrote.
+static int open_segment(void)
+{
+    unsigned seq = __atomic_load_n(&state->seq, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&open_seq, __ATOMIC_ACQUIRE) == seq)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&segment_lock);
+    int rc = 0;
+    if (open_seq != seq)
+    {
+        char path[64];
+        wal_segment_path(path, sizeof(path), seq);
+        int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            perror("Error opening log for appending");
+            rc = -1;
+        }
+        else
+        {
+            // wal_sync() only sees the current segment, so whatever is
+            // unsynced in the old one is synced before letting go of it.
+            if (wal_fd >= 0)
+            {
+                if (wal_unsynced && fdatasync(wal_fd) < 0)
+                {
+                    perror("Error syncing log");
+                }
+                close(wal_fd);
+            }
+            wal_fd = fd;
+            wal_unsynced = 0;
+            __atomic_store_n(&open_seq, seq, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&segment_lock);
+    return rc;
+}
+
+int wal_append(const struct iovec *iov, int count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (open_segment() < 0)
+    {
+        return -1;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    __atomic_fetch_add(&state->bytes, total, __ATOMIC_RELAXED);
+    // O_APPEND writes to a regular file are not interleaved with others,
+    // but may in theory come up short; finish the rest in order.
+    struct iovec rest[count];
+    memcpy(rest, iov, count * sizeof(*iov));
+    struct iovec *next = rest;
+    while (total > 0)
+    {
+        ssize_t n = writev(wal_fd, next, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error appending to log");
+            return -1;
+        }
+        total -= n;
+        while (count > 0 && (size_t)n >= next->iov_len)
+        {
+            n -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0)
+        {
+            next->iov_base = (char *)next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+    // Set only once the data is written, so that a wal_sync() that clears
+    // it covers everything appended before.
+    __atomic_store_n(&wal_unsynced, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int wal_sync(void)
+{
+    pthread_mutex_lock(&segment_lock);
+    int rc = 0;
+    if (wal_fd >= 0 && __atomic_exchange_n(&wal_unsynced, 0, __ATOMIC_ACQUIRE))
+    {
+        rc = fdatasync(wal_fd);
+        if (rc < 0)
+        {
+            perror("Error syncing log");
+        }
+    }
+    pthread_mutex_unlock(&segment_lock);
+    return rc;
+}
+
+uint64_t wal_segment_bytes(void)
+{
+    return __atomic_load_n(&state->bytes, __ATOMIC_RELAXED);
+}
+
+unsigned wal_rotate(void)
+{
+    __atomic_store_n(&state->bytes, 0, __ATOMIC_RELAXED);
+    return __atomic_add_fetch(&state->seq, 1, __ATOMIC_RELEASE);
+}
+
+void wal_remove_before(unsigned seq)
+{
+    char path[64];
+    for (; state->first_seq < seq; state->first_seq++)
+    {
+        wal_segment_path(path, sizeof(path), state->first_seq);
+        if (unlink(path) < 0 && errno != ENOENT)
+        {
+            perror("Error removing log segment");
+        }
+    }
+    if (unlink(WAL_FILE) < 0 && errno != ENOENT)
+    {
+        perror("Error removing old log");
+    }
+}
\ No newline at end of file
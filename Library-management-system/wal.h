@@ -0,0 +1,62 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// The log is a run of numbered segments, library.wal.1, library.wal.2 and
+// so on. A snapshot (snapshot.h) starts a new segment and, once it is on
+// disk, deletes the ones it covers. library.wal is the single-file log of
+// older versions; it is still replayed if found.
+#define WAL_FILE "library.wal"
+
+// On disk every record is a header followed by a one-byte type and the
+// payload. The CRC covers type and payload, so a record torn by a crash
+// is recognised on replay and everything from it onward is cut off.
+typedef struct
+{
+    uint32_t len; // type byte + payload
+    uint32_t crc;
+} wal_header_t;
+
+// Bytes one record with a payload of len bytes takes up.
+#define WAL_RECORD_SIZE(len) (sizeof(wal_header_t) + 1 + (len))
+
+uint32_t wal_crc32(uint32_t crc, const void *data, size_t len);
+
+// Writes one record into dest, which must hold WAL_RECORD_SIZE(len) bytes.
+void wal_encode(char *dest, int type, const void *payload, size_t len);
+
+void wal_segment_path(char *path, size_t size, unsigned seq);
+
+// Calls apply for every intact record in path, in order, then truncates
+// the file after the last one. A missing file counts as empty. Returns the
+// number of records replayed, or -1 if the file could not be read.
+long wal_replay(const char *path, void (*apply)(int type, const void *payload, size_t len));
+
+// Sets up the shared log state: appends go to segment seq, and segments
+// before first_seq are covered by the snapshot (any left over from a crash
+// are deleted now). Call once, after the replay and before forking.
+int wal_init(unsigned first_seq, unsigned seq);
+
+// Appends already encoded records with a single write. The caller holds
+// the write lock of every table the records belong to; concurrent callers
+// never interleave within a call.
+int wal_append(const struct iovec *iov, int count);
+
+// Waits until everything this process appended is on disk.
+int wal_sync(void);
+
+// Bytes appended to the current segment so far.
+uint64_t wal_segment_bytes(void);
+
+// Moves appends on to a new segment and returns its number. The caller
+// must keep every table from changing (read locks on all of them), so the
+// tables then hold exactly what the earlier segments describe.
+unsigned wal_rotate(void);
+
+// Deletes every segment numbered below seq.
+void wal_remove_before(unsigned seq);
+
+#endif // WAL_H
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "worker_pool.h"
+#include "command.h"
+#include "commit.h"
+#include "storage.h"
+#include "buffer_pool.h"
+
+// Items kept for reuse: enough for a few thousand requests in flight.
+#define MAX_FREE_ITEMS 4096
+
+static buffer_pool_t free_items = BUFFER_POOL_INIT(sizeof(work_item_t), MAX_FREE_ITEMS);
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static work_item_t *queue_head = NULL;
+static work_item_t *queue_tail = NULL;
+static int idle_workers = 0;
+
+// Items submitted since the last worker_pool_flush(). Only the event loop
+// thread touches these.
+static work_item_t *held_head = NULL;
+static work_item_t *held_tail = NULL;
+static int held_count = 0;
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static work_item_t *done_head = NULL;
+static work_item_t *done_tail = NULL;
+static int done_fd = -1;
+
+static void *worker_main(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL)
+        {
+            idle_workers++;
+            pthread_cond_wait(&queue_ready, &queue_lock);
+            idle_workers--;
+        }
+        work_item_t *item = queue_head;
+        queue_head = item->next;
+        if (queue_head == NULL)
+        {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        item->next = NULL;
+        item->reply = (reply_t){item->response, 0, sizeof(item->response), 0};
+        reply_set(&item->reply, "");
+        handle_client_request(item->session, item->request, &item->reply);
+        commit_request(item, storage_take_unsynced());
+    }
+    return NULL;
+}
+
+void worker_pool_complete(work_item_t *item)
+{
+    pthread_mutex_lock(&done_lock);
+    int was_empty = done_head == NULL;
+    if (done_tail)
+    {
+        done_tail->next = item;
+    }
+    else
+    {
+        done_head = item;
+    }
+    done_tail = item;
+    pthread_mutex_unlock(&done_lock);
+
+    // One wakeup per batch is enough; the loop drains the whole list.
+    if (was_empty)
+    {
+        uint64_t one = 1;
+        if (write(done_fd, &one, sizeof(one)) < 0)
+        {
+            perror("eventfd write failed");
+        }
+    }
+}
+
+int worker_pool_start(int num_threads)
+{
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (done_fd < 0)
+    {
+        perror("eventfd failed");
+        return -1;
+    }
+    if (commit_start() < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker_main, NULL) != 0)
+        {
+            perror("Error creating worker thread");
+            return -1;
+        }
+        pthread_detach(tid);
+    }
+    printf("Started %d worker threads.\n", num_threads);
+    return done_fd;
+}
+
+void worker_pool_submit(work_item_t *item)
+{
+    item->next = NULL;
+    if (held_tail)
+    {
+        held_tail->next = item;
+    }
+    else
+    {
+        held_head = item;
+    }
+    held_tail = item;
+    held_count++;
+}
+
+void worker_pool_flush(void)
+{
+    if (held_head == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail)
+    {
+        queue_tail->next = held_head;
+    }
+    else
+    {
+        queue_head = held_head;
+    }
+    queue_tail = held_tail;
+    // Wake no more workers than there are items; each wakeup is a syscall.
+    if (held_count >= idle_workers)
+    {
+        pthread_cond_broadcast(&queue_ready);
+    }
+    else
+    {
+        for (int i = 0; i < held_count; i++)
+        {
+            pthread_cond_signal(&queue_ready);
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+    held_head = NULL;
+    held_tail = NULL;
+    held_count = 0;
+}
+
+work_item_t *worker_pool_take_completed(void)
+{
+    uint64_t count;
+    if (read(done_fd, &count, sizeof(count)) < 0)
+    {
+        // EAGAIN just means another drain already cleared it.
+    }
+    pthread_mutex_lock(&done_lock);
+    work_item_t *items = done_head;
+    done_head = NULL;
+    done_tail = NULL;
+    pthread_mutex_unlock(&done_lock);
+    return items;
+}
+
+work_item_t *work_item_alloc(void)
+{
+    work_item_t *item = buffer_pool_get(&free_items);
+    if (item)
+    {
+        item->reply.heap = 0;
+    }
+    return item;
+}
+
+void work_item_free(work_item_t *item)
+{
+    reply_free(&item->reply);
+    buffer_pool_put(&free_items, item);
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+
+#include "session.h"
+#include "command.h"
+#include "protocol.h"
+
+// A request handed from the event loop to a worker thread. The worker fills
+// in reply (which starts out pointing at response and may move to the heap
+// for large replies) and hands the item back through the completion queue.
+// Items are reused through a buffer pool (buffer_pool.h).
+typedef struct work_item
+{
+    client_session_t *session;
+    char *request; // one frame body, NUL-terminated, in the session's arena
+    char response[RESPONSE_BUF_LEN];
+    reply_t reply;
+    // Once answered: the frame header and how much of header + body the
+    // session has sent.
+    unsigned char header[FRAME_HEADER_LEN];
+    size_t out_sent;
+    uint64_t commit_ns; // when it started waiting for its changes to be synced
+    struct work_item *next;
+} work_item_t;
+
+// Starts num_threads workers, and the commit thread if the commit policy
+// has one (see commit.h). Returns an eventfd that becomes readable
+// whenever finished items are waiting, or -1 on failure.
+int worker_pool_start(int num_threads);
+
+// Queues an item for the workers. Never blocks on request processing.
+// Items are held back until worker_pool_flush(), so a loop pass that
+// dispatches many requests takes the queue lock and wakes workers once.
+void worker_pool_submit(work_item_t *item);
+void worker_pool_flush(void);
+
+// Puts an answered item on the completion queue. Workers do this through
+// commit_request(), once the request's changes are durable.
+void worker_pool_complete(work_item_t *item);
+
+// Takes every finished item (oldest first) and clears the eventfd.
+work_item_t *worker_pool_take_completed(void);
+
+// Takes an item from the pool, or NULL if out of memory. Only the event
+// loop thread may call these two.
+work_item_t *work_item_alloc(void);
+
+// Returns a finished item to the pool, freeing a reply that grew onto
+// the heap.
+void work_item_free(work_item_t *item);
+
+#endif // WORKER_POOL_H
\ No newline at end of file